@@ -35,13 +35,6 @@
 
 #include "../firmware_image.h"
 
-struct fw_subsys_info_a {
-	unsigned char type;
-	unsigned int size;
-	unsigned int flash_addr;
-	const unsigned char *data;
-};
-
 struct config_info_a {
 	unsigned char data[2048];
 	unsigned int size;
@@ -61,7 +54,6 @@ struct firmware_summary_a {
 	unsigned char bus_type;
 	unsigned char flash_protect;
 	unsigned char reserved[8];
-	struct fw_subsys_info_a subsys[47];
 };
 #pragma pack()
 
@@ -80,6 +72,7 @@ protected:
 	int GetDataFromFile(const char *filename);
 
 private:
+	int CheckFirmware();
 	int ParseFirmware();
 
 	unsigned char m_firmwarePID[8];
@@ -31,19 +31,22 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "../checksum.h"
 #include "../gtp_util.h"
 #include "brla.h"
 #include "brla_update.h"
 
 #define ISP_RAM_ADDR 0x29400
 
-int BrlAUpdate::Run(void *para)
+int BrlAUpdate::Run(void *para) { return RunSteps(para); }
+
+UpdateTask BrlAUpdate::Flow(void *para)
 {
 	int ret;
 
 	if (!m_Initialized) {
 		gdix_err("Can't Process Update Before Initialized.\n");
-		return -EINVAL;
+		co_return -EINVAL;
 	}
 	// get all parameter
 	pGTUpdatePara parameter = (pGTUpdatePara)para;
@@ -52,31 +55,31 @@ int BrlAUpdate::Run(void *para)
 		ret = check_update();
 		if (ret < 0) {
 			gdix_info("Upgrades are not allowed\n");
-			return ret;
+			co_return ret;
 		} else if (ret == 0) {
 			gdix_info("Skip upgrade\n");
-			return 0;
+			co_return 0;
 		}
 		gdix_info("Ready to upgrade\n");
 	} else {
 		gdix_info("Force to upgrade\n");
 	}
 
-	ret = prepareUpdate();
+	ret = co_await prepareUpdate();
 	if (ret < 0) {
 		gdix_err("Failed prepare update\n");
-		return ret;
+		co_return ret;
 	}
 
-	ret = fw_update(parameter->firmwareFlag);
+	ret = co_await flashFirmware(parameter->firmwareFlag);
 	if (ret < 0) {
 		gdix_err("Failed update\n");
-		return ret;
+		co_return ret;
 	}
 
 	gdix_info("Success update\n");
 
-	return 0;
+	co_return 0;
 }
 
 int BrlAUpdate::check_update()
@@ -103,7 +106,7 @@ int BrlAUpdate::check_update()
 	return 0;
 }
 
-int BrlAUpdate::prepareUpdate()
+UpdateTask BrlAUpdate::prepareUpdate()
 {
 	uint8_t tempBuf[5] = {0};
 	uint8_t recvBuf[5] = {0};
@@ -117,10 +120,10 @@ int BrlAUpdate::prepareUpdate()
 	ret = dev->SendCmd(0x10, tempBuf, 1);
 	if (ret < 0) {
 		gdix_err("Failed send minisystem cmd\n");
-		return ret;
+		co_return ret;
 	}
 	while (retry--) {
-		usleep(200000);
+		co_await update_sleep(200000);
 		ret = dev->Read(0x5095, tempBuf, 1);
 		if (ret == 1 && tempBuf[0] == 0xDD)
 			break;
@@ -128,7 +131,7 @@ int BrlAUpdate::prepareUpdate()
 	if (retry < 0) {
 		gdix_err("Failed switch minisystem ret=%d flag=0x%02x\n", ret,
 				 tempBuf[0]);
-		return -EINVAL;
+		co_return -EINVAL;
 	}
 	gdix_info("Switch mini system successfully\n");
 
@@ -136,21 +139,21 @@ int BrlAUpdate::prepareUpdate()
 	tempBuf[0] = 0x01;
 	for (int i = 0; i < 3; i++) {
 		ret = dev->SendCmd(0x11, tempBuf, 1);
-		usleep(2000);
+		co_await update_sleep(2000);
 	}
 	if (ret < 0) {
 		gdix_err("Failed send erase flash cmd\n");
-		return ret;
+		co_return ret;
 	}
 
 	retry = 10;
 	memset(tempBuf, 0x55, 5);
 	while (retry--) {
-		usleep(10000);
+		co_await update_sleep(10000);
 		ret = dev->Write(ISP_RAM_ADDR, tempBuf, 5);
 		if (ret < 0) {
 			gdix_err("Failed write sram, ret=%d\n", ret);
-			return ret;
+			co_return ret;
 		}
 		ret = dev->Read(ISP_RAM_ADDR, recvBuf, 5);
 		if (!memcmp(tempBuf, recvBuf, 5))
@@ -159,41 +162,52 @@ int BrlAUpdate::prepareUpdate()
 	if (retry < 0) {
 		gdix_err("Read back failed, ret=%d buf:%02x %02x %02x %02x %02x\n", ret,
 				 recvBuf[0], recvBuf[1], recvBuf[2], recvBuf[3], recvBuf[4]);
-		return -EINVAL;
+		co_return -EINVAL;
 	}
 
 	gdix_info("Updata prepare OK\n");
-	return 0;
+	co_return 0;
 }
 
-int BrlAUpdate::flashSubSystem(struct fw_subsys_info_a *subsys)
+UpdateTask BrlAUpdate::flashSubSystem(const struct image_subsys *subsys)
 {
 	uint32_t data_size = 0;
 	uint32_t offset = 0;
 	uint32_t temp_addr = subsys->flash_addr;
-	uint32_t total_size = subsys->size;
+	uint32_t total_size = subsys->len;
 	uint32_t checksum;
 	uint8_t cmdBuf[10] = {0};
+	uint8_t window[FW_CHUNK_SIZE];
+	const uint8_t *data;
 	uint8_t flag;
 	int retry;
-	uint32_t i;
 	int ret;
 
 	while (total_size > 0) {
 		data_size = total_size > 4096 ? 4096 : total_size;
 
+		/* an image that is not resident is read a chunk at a time */
+		if (subsys->data) {
+			data = &subsys->data[offset];
+		} else {
+			ret = image->ReadData(subsys->offset + offset, window, data_size);
+			if (ret < 0)
+				co_return ret;
+			data = window;
+		}
+
 		/* send fw data to dram */
-		ret = dev->Write(ISP_RAM_ADDR, &subsys->data[offset], data_size);
+		ret = dev->Write(ISP_RAM_ADDR, data, data_size);
 		if (ret < 0) {
 			gdix_err("Write fw data failed\n");
-			return ret;
+			co_return ret;
 		}
 
 		/* send checksum */
-		for (i = 0, checksum = 0; i < data_size; i += 2) {
-			checksum +=
-				subsys->data[offset + i] + (subsys->data[offset + i + 1] << 8);
-		}
+		if (subsys->sums)
+			checksum = subsys->sums[offset / FW_CHUNK_SIZE];
+		else
+			checksum = gdix_sum_u16_le(data, data_size);
 
 		cmdBuf[0] = (data_size >> 8) & 0xFF;
 		cmdBuf[1] = data_size & 0xFF;
@@ -208,39 +222,39 @@ int BrlAUpdate::flashSubSystem(struct fw_subsys_info_a *subsys)
 		ret = dev->SendCmd(0x12, cmdBuf, 10);
 		if (ret < 0) {
 			gdix_err("Failed send start update cmd\n");
-			return ret;
+			co_return ret;
 		}
 
 		/* wait update finish */
 		retry = 10;
 		while (retry--) {
-			usleep(20000);
+			co_await update_sleep(20000);
 			ret = dev->Read(0x5096, &flag, 1);
 			if (ret == 1 && flag == 0xAA)
 				break;
 		}
 		if (retry < 0) {
 			gdix_err("Failed get valid ack, ret=%d flag=0x%02x\n", ret, flag);
-			return -EINVAL;
+			co_return -EINVAL;
 		}
 
 		gdix_info("Flash package ok, addr:0x%06x\n", temp_addr);
+		chunk_acked(data_size);
 
 		offset += data_size;
 		temp_addr += data_size;
 		total_size -= data_size;
 	}
 
-	return 0;
+	co_return 0;
 }
 
 #define CFG_MAX_SIZE 4096
-int BrlAUpdate::fw_update(unsigned int firmware_flag)
+UpdateTask BrlAUpdate::flashFirmware(unsigned int firmware_flag)
 {
-	struct firmware_summary_a *fw_info =
-		(struct firmware_summary_a *)image->GetFirmwareSummary();
-	struct fw_subsys_info_a *fw_x;
-	struct fw_subsys_info_a subsys_cfg;
+	const struct image_subsys *fw_x;
+	const struct image_config *cfg;
+	struct image_subsys subsys_cfg;
 	int i;
 	int ret;
 	uint8_t buf[1];
@@ -252,33 +266,42 @@ int BrlAUpdate::fw_update(unsigned int firmware_flag)
 	gdix_info("IN\n");
 	/* flash config */
 	if (image->HasConfig()) {
-		memcpy(temp_buf,
-			   image->GetFirmwareData() + image->GetFirmwareSize() + 64,
-			   image->GetConfigSize());
+		cfg = image->FindConfig(sensor_id());
+		if (!cfg) {
+			gdix_err("No config in image\n");
+			co_return -EINVAL;
+		}
+		if (cfg->len > CFG_MAX_SIZE) {
+			gdix_err("Invalid config size:%d\n", cfg->len);
+			co_return -EINVAL;
+		}
+		memcpy(temp_buf, cfg->data, cfg->len);
 
+		/* config is flashed as a whole sector, padded with 0 */
+		memset(&subsys_cfg, 0, sizeof(subsys_cfg));
 		subsys_cfg.data = temp_buf;
-		subsys_cfg.size = CFG_MAX_SIZE;
+		subsys_cfg.len = CFG_MAX_SIZE;
 		subsys_cfg.flash_addr = 0x3E000;
 		subsys_cfg.type = 4;
-		ret = flashSubSystem(&subsys_cfg);
+		ret = co_await flashSubSystem(&subsys_cfg);
 		if (ret < 0) {
 			gdix_err("failed flash config with ISP\n");
-			return ret;
+			co_return ret;
 		}
 		gdix_info("success flash config with ISP\n");
-		usleep(20000);
+		co_await update_sleep(20000);
 	}
 
-	for (i = 1; i < fw_info->subsys_num; i++) {
-		fw_x = &fw_info->subsys[i];
+	for (i = 1; i < image->GetSubsysNum(); i++) {
+		fw_x = image->GetSubsys(i);
 		if (fw_x->type == (uint8_t)firmware_flag) {
 			gdix_info("skip type[%02X] subsystem[%d]\n", fw_x->type, i);
 			continue;
 		}
-		ret = flashSubSystem(fw_x);
+		ret = co_await flashSubSystem(fw_x);
 		if (ret < 0) {
 			gdix_err("-------- Failed flash subsystem %d --------\n", i);
-			return ret;
+			co_return ret;
 		}
 		gdix_info("-------- Success flash subsystem %d --------\n", i);
 	}
@@ -289,9 +312,9 @@ int BrlAUpdate::fw_update(unsigned int firmware_flag)
 	ret = dev->SendCmd(0x13, buf, 1);
 	if (ret < 0) {
 		gdix_err("Failed reset IC\n");
-		return ret;
+		co_return ret;
 	}
-	usleep(100000);
+	co_await update_sleep(100000);
 
 	/* compare version */
 	dev->SetBasicProperties();
@@ -309,8 +332,8 @@ int BrlAUpdate::fw_update(unsigned int firmware_flag)
 		gdix_info("Current version:%d.%d\n", dev->GetFirmwareVersionMajor(),
 				  dev->GetFirmwareVersionMinor());
 		gdix_info("Firmware version:%d.%d\n", majorVer, minorVer);
-		return -1;
+		co_return -1;
 	}
 
-	return 0;
+	co_return 0;
 }
@@ -34,14 +34,16 @@ class BrlAUpdate : public GTupdate
 {
 public:
 	int Run(void *para);
+	int Plan() { return check_update(); }
 
 protected:
 	int check_update();
-	int fw_update(unsigned int firmware_flag);
+	UpdateTask Flow(void *para);
 
 private:
-	int prepareUpdate();
-	int flashSubSystem(struct fw_subsys_info_a *subsys);
+	UpdateTask prepareUpdate();
+	UpdateTask flashFirmware(unsigned int firmware_flag);
+	UpdateTask flashSubSystem(const struct image_subsys *subsys);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bundle.h"
+#include "gtp_util.h"
+
+/*
+ * Layout: header, the sorted entries, then the images, each starting on
+ * a BUNDLE_ALIGN boundary. All fields are little endian.
+ */
+#define BUNDLE_MAGIC "GDIXBDL"
+#define BUNDLE_VERSION 1
+#define BUNDLE_ALIGN 16
+#define BUNDLE_MAX_ENTRIES 4096
+#define BUNDLE_COPY_WINDOW 4096
+
+struct bundle_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_num;
+	uint32_t entry_hash;
+	uint32_t reserved;
+};
+
+static uint32_t bundle_hash(const void *buf, unsigned int len)
+{
+	const unsigned char *data = (const unsigned char *)buf;
+	uint32_t hash = 0x811C9DC5;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+/* order of the index, version last so a key's newest image sorts last */
+static int entry_cmp(const struct bundle_entry *a, const struct bundle_entry *b)
+{
+	int ret;
+
+	if (a->family != b->family)
+		return a->family < b->family ? -1 : 1;
+	ret = memcmp(a->pid, b->pid, BUNDLE_PID_LEN);
+	if (ret)
+		return ret;
+	if (a->sensor_id != b->sensor_id)
+		return a->sensor_id < b->sensor_id ? -1 : 1;
+	if (a->ver_major != b->ver_major)
+		return a->ver_major < b->ver_major ? -1 : 1;
+	if (a->ver_minor != b->ver_minor)
+		return a->ver_minor < b->ver_minor ? -1 : 1;
+	return 0;
+}
+
+static int item_cmp(const void *a, const void *b)
+{
+	return entry_cmp(&((const struct bundle_item *)a)->entry,
+					 &((const struct bundle_item *)b)->entry);
+}
+
+FirmwareBundle::FirmwareBundle()
+{
+	m_file = NULL;
+	m_entries = NULL;
+	m_entryNum = 0;
+}
+
+FirmwareBundle::~FirmwareBundle() { Close(); }
+
+bool FirmwareBundle::IsBundle(const char *filename)
+{
+	char magic[8];
+	bool ret = false;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	if (read(fd, magic, sizeof(magic)) == sizeof(magic))
+		ret = !memcmp(magic, BUNDLE_MAGIC, sizeof(magic));
+	close(fd);
+	return ret;
+}
+
+/* PIDs are compared up to their first NUL */
+void FirmwareBundle::SetPid(struct bundle_entry *entry,
+							const unsigned char *pid)
+{
+	int i;
+
+	memset(entry->pid, 0, BUNDLE_PID_LEN);
+	for (i = 0; pid && i < BUNDLE_PID_LEN && pid[i]; i++)
+		entry->pid[i] = pid[i];
+}
+
+int FirmwareBundle::Open(const char *filename, bool stream)
+{
+	struct bundle_header header;
+	unsigned int size;
+	int i;
+
+	Close();
+	m_file = ImageFile::Open(filename, stream);
+	if (!m_file)
+		return -1;
+
+	if (m_file->Read(0, (unsigned char *)&header, sizeof(header)) < 0 ||
+		memcmp(header.magic, BUNDLE_MAGIC, sizeof(header.magic)) ||
+		header.version != BUNDLE_VERSION ||
+		header.entry_num > BUNDLE_MAX_ENTRIES) {
+		gdix_err("Invalid bundle file:%s\n", filename);
+		goto err;
+	}
+
+	size = header.entry_num * sizeof(struct bundle_entry);
+	m_entries = new struct bundle_entry[header.entry_num];
+	if (m_file->Read(sizeof(header), (unsigned char *)m_entries, size) < 0 ||
+		bundle_hash(m_entries, size) != header.entry_hash) {
+		gdix_err("Bundle index is corrupted\n");
+		goto err;
+	}
+
+	for (i = 0; i < (int)header.entry_num; i++) {
+		if (m_entries[i].offset > (uint64_t)m_file->GetSize() ||
+			m_entries[i].len > m_file->GetSize() - m_entries[i].offset ||
+			(i && entry_cmp(&m_entries[i - 1], &m_entries[i]) >= 0)) {
+			gdix_err("Bad bundle entry %d\n", i);
+			goto err;
+		}
+	}
+	m_entryNum = header.entry_num;
+	gdix_dbg("Bundle %s has %d images\n", filename, m_entryNum);
+	return 0;
+
+err:
+	Close();
+	return -1;
+}
+
+void FirmwareBundle::Close()
+{
+	delete[] m_entries;
+	m_entries = NULL;
+	m_entryNum = 0;
+	if (m_file) {
+		m_file->Release();
+		m_file = NULL;
+	}
+}
+
+const struct bundle_entry *FirmwareBundle::GetEntry(int index)
+{
+	if (index < 0 || index >= m_entryNum)
+		return NULL;
+	return &m_entries[index];
+}
+
+/* last entry not above key, NULL if there is none */
+const struct bundle_entry *
+FirmwareBundle::Search(const struct bundle_entry *key)
+{
+	int low = 0, high = m_entryNum, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (entry_cmp(&m_entries[mid], key) <= 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low ? &m_entries[low - 1] : NULL;
+}
+
+/* an image for this very sensor wins over one for any sensor */
+const struct bundle_entry *FirmwareBundle::Find(uint32_t family,
+												const unsigned char *pid,
+												unsigned char sensorID)
+{
+	const struct bundle_entry *entry;
+	struct bundle_entry key;
+	int pass;
+
+	memset(&key, 0, sizeof(key));
+	key.family = family;
+	SetPid(&key, pid);
+	key.ver_major = 0xFFFFFFFF;
+	key.ver_minor = 0xFFFFFFFF;
+
+	for (pass = 0; pass < 2; pass++) {
+		key.sensor_id = pass ? BUNDLE_ANY_SENSOR : sensorID;
+		entry = Search(&key);
+		if (entry && entry->family == key.family &&
+			!memcmp(entry->pid, key.pid, BUNDLE_PID_LEN) &&
+			entry->sensor_id == key.sensor_id)
+			return entry;
+	}
+	return NULL;
+}
+
+ImageFile *FirmwareBundle::OpenEntry(const struct bundle_entry *entry)
+{
+	if (!m_file)
+		return NULL;
+	return ImageFile::OpenSlice(m_file, entry->offset, entry->len);
+}
+
+static int copy_image(int fd, ImageFile *file)
+{
+	unsigned char window[BUNDLE_COPY_WINDOW];
+	unsigned int offset, len;
+
+	for (offset = 0; offset < (unsigned int)file->GetSize(); offset += len) {
+		len = file->GetSize() - offset;
+		if (len > BUNDLE_COPY_WINDOW)
+			len = BUNDLE_COPY_WINDOW;
+		if (file->Read(offset, window, len) < 0 ||
+			write(fd, window, len) != (int)len)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Sort the items and write them out as a bundle, written aside and
+ * renamed so the items may come from the bundle being replaced.
+ */
+int FirmwareBundle::Create(const char *filename, struct bundle_item *items,
+						   int num)
+{
+	static const unsigned char pad[BUNDLE_ALIGN] = {0};
+	struct bundle_header header;
+	struct bundle_entry *entries;
+	char tmpname[PATH_MAX];
+	uint64_t offset;
+	int fd, i, ret = -1;
+
+	if (num <= 0 || num > BUNDLE_MAX_ENTRIES)
+		return -1;
+
+	qsort(items, num, sizeof(*items), item_cmp);
+	entries = new struct bundle_entry[num];
+	offset = sizeof(header) + num * sizeof(*entries);
+	for (i = 0; i < num; i++) {
+		if (i && !item_cmp(&items[i - 1], &items[i])) {
+			gdix_err("Duplicate image PID %.8s sensor 0x%x\n",
+					 items[i].entry.pid, items[i].entry.sensor_id);
+			goto out;
+		}
+		offset = (offset + BUNDLE_ALIGN - 1) & ~(uint64_t)(BUNDLE_ALIGN - 1);
+		entries[i] = items[i].entry;
+		entries[i].offset = offset;
+		entries[i].len = items[i].file->GetSize();
+		offset += entries[i].len;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+	header.version = BUNDLE_VERSION;
+	header.entry_num = num;
+	header.entry_hash = bundle_hash(entries, num * sizeof(*entries));
+
+	if (snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, getpid()) >=
+		(int)sizeof(tmpname))
+		goto out;
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		gdix_err("Can't create %s, %s\n", tmpname, strerror(errno));
+		goto out;
+	}
+
+	offset = sizeof(header) + num * sizeof(*entries);
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+		write(fd, entries, num * sizeof(*entries)) !=
+			(int)(num * sizeof(*entries)))
+		goto err_write;
+	for (i = 0; i < num; i++) {
+		if (write(fd, pad, entries[i].offset - offset) !=
+				(int)(entries[i].offset - offset) ||
+			copy_image(fd, items[i].file) < 0)
+			goto err_write;
+		offset = entries[i].offset + entries[i].len;
+	}
+	if (fsync(fd) < 0)
+		goto err_write;
+	close(fd);
+
+	if (rename(tmpname, filename) < 0) {
+		gdix_err("Failed rename %s, %s\n", tmpname, strerror(errno));
+		unlink(tmpname);
+		goto out;
+	}
+	ret = 0;
+	goto out;
+
+err_write:
+	gdix_err("Failed write bundle, %s\n", strerror(errno));
+	close(fd);
+	unlink(tmpname);
+out:
+	delete[] entries;
+	return ret;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BUNDLE_H_
+#define _BUNDLE_H_
+
+#include <stdint.h>
+
+#include "image_file.h"
+
+#define BUNDLE_PID_LEN 8
+/* image carries the configs of all sensors */
+#define BUNDLE_ANY_SENSOR 0xFFFFFFFF
+
+/*
+ * Index entry of one image. Entries are sorted by family, PID, sensor
+ * ID and then version, so the newest image for a device is the last
+ * one of its key.
+ */
+struct bundle_entry {
+	uint32_t family;
+	unsigned char pid[BUNDLE_PID_LEN]; /* zero padded */
+	uint32_t sensor_id;
+	uint32_t ver_major;
+	uint32_t ver_minor;
+	uint32_t reserved;
+	uint64_t offset; /* from the start of the bundle */
+	uint64_t len;
+};
+
+/* one image to put in a bundle, the whole of file */
+struct bundle_item {
+	struct bundle_entry entry;
+	ImageFile *file;
+};
+
+/*
+ * Single file holding the images of many devices in their own family
+ * formats. Images are used in place through a slice of the bundle
+ * mapping, nothing is extracted.
+ */
+class FirmwareBundle
+{
+public:
+	FirmwareBundle();
+	~FirmwareBundle();
+
+	static bool IsBundle(const char *filename);
+	static void SetPid(struct bundle_entry *entry, const unsigned char *pid);
+	static int Create(const char *filename, struct bundle_item *items,
+					  int num);
+
+	int Open(const char *filename, bool stream = false);
+	void Close();
+	int GetEntryNum() { return m_entryNum; }
+	/* the file was rewritten since it was opened */
+	bool Changed() { return m_file && m_file->Changed(); }
+	const struct bundle_entry *GetEntry(int index);
+	/* newest image for a device, NULL if the bundle has none */
+	const struct bundle_entry *Find(uint32_t family, const unsigned char *pid,
+									unsigned char sensorID);
+	/* slice of the bundle holding entry, release it when done */
+	ImageFile *OpenEntry(const struct bundle_entry *entry);
+
+private:
+	const struct bundle_entry *Search(const struct bundle_entry *key);
+
+	ImageFile *m_file;
+	struct bundle_entry *m_entries;
+	int m_entryNum;
+};
+
+#endif
@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bundle.h"
+#include "catalog.h"
+#include "gtp_util.h"
+#include "image_index.h"
+
+/*
+ * Layout: header, the sorted entries, then the path table holding the
+ * NUL terminated absolute path of every file. All fields are little
+ * endian.
+ */
+#define CATALOG_MAGIC "GDIXCAT"
+#define CATALOG_VERSION 1
+#define CATALOG_MAX_ENTRIES (1024 * 1024)
+/* directories nested deeper are not scanned */
+#define CATALOG_MAX_DEPTH 32
+
+struct catalog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_num;
+	uint32_t path_size;
+	uint32_t hash; /* of the entries and the path table */
+};
+
+struct catalog_item {
+	struct catalog_entry entry;
+	char *path;
+};
+
+struct catalog_list {
+	struct catalog_item *items;
+	int num;
+	int max;
+};
+
+static uint32_t catalog_hash(uint32_t hash, const void *buf, unsigned int len)
+{
+	const unsigned char *data = (const unsigned char *)buf;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+static int entry_cmp(const struct catalog_entry *a,
+					 const struct catalog_entry *b)
+{
+	int ret;
+
+	if (a->family != b->family)
+		return a->family < b->family ? -1 : 1;
+	ret = memcmp(a->pid, b->pid, CATALOG_PID_LEN);
+	if (ret)
+		return ret;
+	if (a->sensor_id != b->sensor_id)
+		return a->sensor_id < b->sensor_id ? -1 : 1;
+	if (a->ver_major != b->ver_major)
+		return a->ver_major < b->ver_major ? -1 : 1;
+	if (a->ver_minor != b->ver_minor)
+		return a->ver_minor < b->ver_minor ? -1 : 1;
+	return 0;
+}
+
+/* files with the same key are ordered by path so builds are repeatable */
+static int item_cmp(const void *a, const void *b)
+{
+	const struct catalog_item *x = (const struct catalog_item *)a;
+	const struct catalog_item *y = (const struct catalog_item *)b;
+	int ret;
+
+	ret = entry_cmp(&x->entry, &y->entry);
+	if (ret)
+		return ret;
+	return strcmp(x->path, y->path);
+}
+
+static int add_item(struct catalog_list *list,
+					const struct catalog_entry *entry, const char *path)
+{
+	struct catalog_item *items;
+
+	if (list->num >= CATALOG_MAX_ENTRIES) {
+		gdix_err("Too many catalog entries\n");
+		return -1;
+	}
+	if (list->num == list->max) {
+		list->max = list->max ? list->max * 2 : 64;
+		items = new struct catalog_item[list->max];
+		if (list->num)
+			memcpy(items, list->items, list->num * sizeof(*items));
+		delete[] list->items;
+		list->items = items;
+	}
+	list->items[list->num].entry = *entry;
+	list->items[list->num].path = strdup(path);
+	list->num++;
+	return 0;
+}
+
+static bool has_suffix(const char *name, const char *suffix)
+{
+	size_t len = strlen(name), slen = strlen(suffix);
+
+	return len >= slen && !strcmp(name + len - slen, suffix);
+}
+
+/* one entry per sensor the image has a config for */
+static int scan_file(struct catalog_list *list, uint32_t family,
+					 FirmwareImage *image, const char *path, off_t size)
+{
+	const struct image_config *config;
+	struct catalog_entry entry;
+	char realName[PATH_MAX];
+	int i, j, num, ret = 0;
+
+	if (has_suffix(path, IMAGE_INDEX_SUFFIX) ||
+		FirmwareBundle::IsBundle(path) || FirmwareCatalog::IsCatalog(path))
+		return 0;
+	if (!realpath(path, realName))
+		return 0;
+	if (image->Initialize(realName)) {
+		gdix_dbg("Skip %s, not a firmware of this family\n", realName);
+		return 0;
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	entry.family = family;
+	for (i = 0; i < CATALOG_PID_LEN && image->GetProductID()[i]; i++)
+		entry.pid[i] = image->GetProductID()[i];
+	entry.ver_major = image->GetFirmwareVersionMajor();
+	entry.ver_minor = image->GetFirmwareVersionMinor();
+	if (image->GetVendorID())
+		memcpy(entry.vid, image->GetVendorID(), sizeof(entry.vid));
+	entry.config_id = image->GetConfigID();
+	entry.size = size;
+	entry.hash = image->GetImageHash();
+
+	num = image->GetConfigNum();
+	for (i = 0; i < num && !ret; i++) {
+		config = image->GetConfig(i);
+		for (j = 0; j < i; j++) {
+			if (image->GetConfig(j)->sensor_id == config->sensor_id)
+				break;
+		}
+		if (j < i)
+			continue;
+		entry.sensor_id = config->sensor_id;
+		ret = add_item(list, &entry, realName);
+	}
+	if (!num) {
+		entry.sensor_id = CATALOG_ANY_SENSOR;
+		ret = add_item(list, &entry, realName);
+	}
+	image->Close();
+
+	if (!ret)
+		gdix_info("Add %s, PID %.8s version 0x%x 0x%x\n", realName, entry.pid,
+				  entry.ver_major, entry.ver_minor);
+	return ret;
+}
+
+static int scan_dir(struct catalog_list *list, uint32_t family,
+					FirmwareImage *image, const char *dir, int depth)
+{
+	struct dirent *dent;
+	struct stat st;
+	char path[PATH_MAX];
+	DIR *dp;
+	int ret = 0;
+
+	if (depth > CATALOG_MAX_DEPTH)
+		return 0;
+	dp = opendir(dir);
+	if (!dp) {
+		gdix_err("Can't open %s, %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	while (!ret && (dent = readdir(dp)) != NULL) {
+		if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, ".."))
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir, dent->d_name) >=
+			(int)sizeof(path))
+			continue;
+		/* linked files are taken, linked directories are not followed */
+		if (lstat(path, &st) < 0)
+			continue;
+		if (S_ISDIR(st.st_mode)) {
+			ret = scan_dir(list, family, image, path, depth + 1);
+			continue;
+		}
+		if (S_ISLNK(st.st_mode) && stat(path, &st) < 0)
+			continue;
+		if (S_ISREG(st.st_mode) && st.st_size > 0)
+			ret = scan_file(list, family, image, path, st.st_size);
+	}
+	closedir(dp);
+	return ret;
+}
+
+FirmwareCatalog::FirmwareCatalog()
+{
+	m_file = NULL;
+	m_entries = NULL;
+	m_entryNum = 0;
+	m_paths = NULL;
+	m_pathSize = 0;
+}
+
+FirmwareCatalog::~FirmwareCatalog() { Close(); }
+
+bool FirmwareCatalog::IsCatalog(const char *filename)
+{
+	char magic[8];
+	bool ret = false;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	if (read(fd, magic, sizeof(magic)) == sizeof(magic))
+		ret = !memcmp(magic, CATALOG_MAGIC, sizeof(magic));
+	close(fd);
+	return ret;
+}
+
+int FirmwareCatalog::Open(const char *filename)
+{
+	const struct catalog_header *header;
+	const unsigned char *data;
+	unsigned int size, i;
+
+	Close();
+	m_file = ImageFile::Open(filename);
+	if (!m_file)
+		return -1;
+	data = m_file->GetData();
+	size = m_file->GetSize();
+
+	header = (const struct catalog_header *)data;
+	if (!data || size < sizeof(*header) ||
+		memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) ||
+		header->version != CATALOG_VERSION ||
+		header->entry_num > CATALOG_MAX_ENTRIES ||
+		size != sizeof(*header) +
+					header->entry_num * sizeof(struct catalog_entry) +
+					header->path_size ||
+		!header->path_size) {
+		gdix_err("Invalid catalog file:%s\n", filename);
+		goto err;
+	}
+	if (catalog_hash(0x811C9DC5, data + sizeof(*header),
+					 size - sizeof(*header)) != header->hash) {
+		gdix_err("Catalog %s is corrupted\n", filename);
+		goto err;
+	}
+
+	m_entries = (const struct catalog_entry *)(data + sizeof(*header));
+	m_paths = (const char *)&m_entries[header->entry_num];
+	m_pathSize = header->path_size;
+	if (m_paths[m_pathSize - 1] != '\0')
+		goto err_entry;
+	for (i = 0; i < header->entry_num; i++) {
+		if (m_entries[i].path >= m_pathSize ||
+			(i && entry_cmp(&m_entries[i - 1], &m_entries[i]) > 0))
+			goto err_entry;
+	}
+	m_entryNum = header->entry_num;
+	gdix_dbg("Catalog %s has %d entries\n", filename, m_entryNum);
+	return 0;
+
+err_entry:
+	gdix_err("Bad entry in catalog %s\n", filename);
+err:
+	Close();
+	return -1;
+}
+
+void FirmwareCatalog::Close()
+{
+	m_entries = NULL;
+	m_entryNum = 0;
+	m_paths = NULL;
+	m_pathSize = 0;
+	if (m_file) {
+		m_file->Release();
+		m_file = NULL;
+	}
+}
+
+const struct catalog_entry *FirmwareCatalog::GetEntry(int index)
+{
+	if (index < 0 || index >= m_entryNum)
+		return NULL;
+	return &m_entries[index];
+}
+
+const char *FirmwareCatalog::GetPath(const struct catalog_entry *entry)
+{
+	return &m_paths[entry->path];
+}
+
+/* last entry not above key, NULL if there is none */
+const struct catalog_entry *
+FirmwareCatalog::Search(const struct catalog_entry *key)
+{
+	int low = 0, high = m_entryNum, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (entry_cmp(&m_entries[mid], key) <= 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low ? &m_entries[low - 1] : NULL;
+}
+
+/* an image for this very sensor wins over one for any sensor */
+const struct catalog_entry *FirmwareCatalog::Find(uint32_t family,
+												  const unsigned char *pid,
+												  unsigned char sensorID)
+{
+	const struct catalog_entry *entry;
+	struct catalog_entry key;
+	int i, pass;
+
+	memset(&key, 0, sizeof(key));
+	key.family = family;
+	for (i = 0; pid && i < CATALOG_PID_LEN && pid[i]; i++)
+		key.pid[i] = pid[i];
+	key.ver_major = 0xFFFFFFFF;
+	key.ver_minor = 0xFFFFFFFF;
+
+	for (pass = 0; pass < 2; pass++) {
+		key.sensor_id = pass ? CATALOG_ANY_SENSOR : sensorID;
+		entry = Search(&key);
+		if (entry && entry->family == key.family &&
+			!memcmp(entry->pid, key.pid, CATALOG_PID_LEN) &&
+			entry->sensor_id == key.sensor_id)
+			return entry;
+	}
+	return NULL;
+}
+
+/* number of entries written, -1 on failure */
+static int write_catalog(const char *filename, struct catalog_list *list)
+{
+	struct catalog_header header;
+	struct catalog_entry *entries;
+	char *paths = NULL;
+	char tmpname[PATH_MAX];
+	unsigned int pathSize = 0, len;
+	int fd, i, num = 0, ret = -1;
+
+	for (i = 0; i < list->num; i++)
+		pathSize += strlen(list->items[i].path) + 1;
+	paths = new char[pathSize];
+
+	/* the entries of one file are added in a row, they share the path */
+	pathSize = 0;
+	for (i = 0; i < list->num; i++) {
+		if (i && !strcmp(list->items[i].path, list->items[i - 1].path)) {
+			list->items[i].entry.path = list->items[i - 1].entry.path;
+			continue;
+		}
+		len = strlen(list->items[i].path) + 1;
+		memcpy(&paths[pathSize], list->items[i].path, len);
+		list->items[i].entry.path = pathSize;
+		pathSize += len;
+	}
+
+	/* a file reached through a link too is listed once */
+	qsort(list->items, list->num, sizeof(*list->items), item_cmp);
+	entries = new struct catalog_entry[list->num];
+	for (i = 0; i < list->num; i++) {
+		if (num && !item_cmp(&list->items[i - 1], &list->items[i]))
+			continue;
+		entries[num++] = list->items[i].entry;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+	header.version = CATALOG_VERSION;
+	header.entry_num = num;
+	header.path_size = pathSize;
+	header.hash = catalog_hash(0x811C9DC5, entries, num * sizeof(*entries));
+	header.hash = catalog_hash(header.hash, paths, pathSize);
+
+	if (snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, getpid()) >=
+		(int)sizeof(tmpname))
+		goto out;
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		gdix_err("Can't create %s, %s\n", tmpname, strerror(errno));
+		goto out;
+	}
+
+	len = num * sizeof(*entries);
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+		write(fd, entries, len) != (int)len ||
+		write(fd, paths, pathSize) != (int)pathSize || fsync(fd) < 0) {
+		gdix_err("Failed write catalog, %s\n", strerror(errno));
+		close(fd);
+		unlink(tmpname);
+		goto out;
+	}
+	close(fd);
+
+	if (rename(tmpname, filename) < 0) {
+		gdix_err("Failed rename %s, %s\n", tmpname, strerror(errno));
+		unlink(tmpname);
+		goto out;
+	}
+	ret = num;
+
+out:
+	delete[] paths;
+	delete[] entries;
+	return ret;
+}
+
+int FirmwareCatalog::Build(const char *filename, uint32_t family,
+						   FirmwareImage *image, int num, char **dirs)
+{
+	struct catalog_list list = {NULL, 0, 0};
+	const struct catalog_entry *entry;
+	FirmwareCatalog old;
+	int i, ret = -1;
+
+	if (IsCatalog(filename) && old.Open(filename) < 0)
+		return -1;
+
+	for (i = 0; i < num; i++) {
+		if (scan_dir(&list, family, image, dirs[i], 0) < 0)
+			goto out;
+	}
+	for (i = 0; i < old.GetEntryNum(); i++) {
+		entry = old.GetEntry(i);
+		if (entry->family != family &&
+			add_item(&list, entry, old.GetPath(entry)) < 0)
+			goto out;
+	}
+	if (!list.num) {
+		gdix_err("No firmware found\n");
+		goto out;
+	}
+
+	ret = write_catalog(filename, &list);
+	if (ret > 0) {
+		printf("catalog %s holds %d entries\n", filename, ret);
+		ret = 0;
+	}
+
+out:
+	for (i = 0; i < list.num; i++)
+		free(list.items[i].path);
+	delete[] list.items;
+	return ret;
+}
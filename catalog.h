@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#include <stdint.h>
+
+#include "firmware_image.h"
+#include "image_file.h"
+
+#define CATALOG_PID_LEN 8
+/* image carries the configs of all sensors */
+#define CATALOG_ANY_SENSOR IMAGE_CFG_ANY_SENSOR
+
+/*
+ * One image file, or one sensor of it when the file has sensor specific
+ * configs. Sorted like bundle entries: family, PID, sensor ID, version.
+ */
+struct catalog_entry {
+	uint32_t family;
+	unsigned char pid[CATALOG_PID_LEN]; /* zero padded */
+	uint32_t sensor_id;
+	uint32_t ver_major;
+	uint32_t ver_minor;
+	unsigned char vid[4];
+	uint32_t config_id;
+	uint32_t size; /* of the file */
+	uint32_t hash; /* FirmwareImage::GetImageHash() */
+	uint32_t path; /* offset in the path table */
+	uint32_t reserved;
+};
+
+/*
+ * Index of the firmware files under some directories. The catalog file
+ * is mapped and searched in place, finding the file for a device takes
+ * one binary search and no image is opened.
+ */
+class FirmwareCatalog
+{
+public:
+	FirmwareCatalog();
+	~FirmwareCatalog();
+
+	static bool IsCatalog(const char *filename);
+	/*
+	 * Parse every file under dirs with image and replace the family's
+	 * entries of the catalog by the ones found, other families are kept
+	 */
+	static int Build(const char *filename, uint32_t family,
+					 FirmwareImage *image, int num, char **dirs);
+
+	int Open(const char *filename);
+	void Close();
+	int GetEntryNum() { return m_entryNum; }
+	const struct catalog_entry *GetEntry(int index);
+	const char *GetPath(const struct catalog_entry *entry);
+	/* newest image for a device, NULL if there is none */
+	const struct catalog_entry *Find(uint32_t family, const unsigned char *pid,
+									 unsigned char sensorID);
+
+private:
+	const struct catalog_entry *Search(const struct catalog_entry *key);
+
+	ImageFile *m_file;
+	const struct catalog_entry *m_entries;
+	int m_entryNum;
+	const char *m_paths;
+	unsigned int m_pathSize;
+};
+
+#endif
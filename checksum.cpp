@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CHECKSUM_NEON
+#endif
+
+uint32_t gdix_sum_u8_scalar(const uint8_t *data, unsigned int len)
+{
+	uint32_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		sum += data[i];
+	return sum;
+}
+
+uint32_t gdix_sum_u16_le_scalar(const uint8_t *data, unsigned int len)
+{
+	uint32_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += data[i] + (data[i + 1] << 8);
+	if (len & 1)
+		sum += data[len - 1];
+	return sum;
+}
+
+uint32_t gdix_sum_u16_be_scalar(const uint8_t *data, unsigned int len)
+{
+	uint32_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (data[i] << 8) + data[i + 1];
+	if (len & 1)
+		sum += data[len - 1] << 8;
+	return sum;
+}
+
+static const struct checksum_ops scalar_ops = {
+	"scalar",
+	gdix_sum_u8_scalar,
+	gdix_sum_u16_le_scalar,
+	gdix_sum_u16_be_scalar,
+};
+
+#ifdef CHECKSUM_X86
+/*
+ * psadbw against zero sums 8 bytes into a 64 bit lane, it can't
+ * overflow for any image size. For the u16 sums even and odd bytes
+ * are summed apart and the high byte sum is shifted afterwards.
+ */
+__attribute__((target("sse2"))) static void
+sse2_sum_bytes(const uint8_t *data, unsigned int blocks, uint64_t *even,
+			   uint64_t *odd)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask = _mm_set1_epi16(0x00FF);
+	__m128i acc_even = _mm_setzero_si128();
+	__m128i acc_odd = _mm_setzero_si128();
+	__m128i v;
+	unsigned int i;
+
+	for (i = 0; i < blocks; i++) {
+		v = _mm_loadu_si128((const __m128i *)(data + i * 16));
+		acc_even = _mm_add_epi64(acc_even,
+								 _mm_sad_epu8(_mm_and_si128(v, mask), zero));
+		acc_odd = _mm_add_epi64(acc_odd, _mm_sad_epu8(_mm_srli_epi16(v, 8),
+													   zero));
+	}
+	acc_even = _mm_add_epi64(acc_even, _mm_unpackhi_epi64(acc_even, acc_even));
+	acc_odd = _mm_add_epi64(acc_odd, _mm_unpackhi_epi64(acc_odd, acc_odd));
+	*even = (uint64_t)_mm_cvtsi128_si32(acc_even);
+	*odd = (uint64_t)_mm_cvtsi128_si32(acc_odd);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_sum_bytes(const uint8_t *data, unsigned int blocks, uint64_t *even,
+			   uint64_t *odd)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i mask = _mm256_set1_epi16(0x00FF);
+	__m256i acc_even = _mm256_setzero_si256();
+	__m256i acc_odd = _mm256_setzero_si256();
+	__m256i v;
+	__m128i e, o;
+	unsigned int i;
+
+	for (i = 0; i < blocks; i++) {
+		v = _mm256_loadu_si256((const __m256i *)(data + i * 32));
+		acc_even = _mm256_add_epi64(
+			acc_even, _mm256_sad_epu8(_mm256_and_si256(v, mask), zero));
+		acc_odd = _mm256_add_epi64(
+			acc_odd, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+	}
+	e = _mm_add_epi64(_mm256_castsi256_si128(acc_even),
+					  _mm256_extracti128_si256(acc_even, 1));
+	o = _mm_add_epi64(_mm256_castsi256_si128(acc_odd),
+					  _mm256_extracti128_si256(acc_odd, 1));
+	e = _mm_add_epi64(e, _mm_unpackhi_epi64(e, e));
+	o = _mm_add_epi64(o, _mm_unpackhi_epi64(o, o));
+	*even = (uint64_t)_mm_cvtsi128_si32(e);
+	*odd = (uint64_t)_mm_cvtsi128_si32(o);
+}
+
+#define X86_KERNELS(isa, width)                                                \
+	static uint32_t isa##_sum_u8(const uint8_t *data, unsigned int len)        \
+	{                                                                          \
+		unsigned int blocks = len / width;                                     \
+		uint64_t even, odd;                                                    \
+		isa##_sum_bytes(data, blocks, &even, &odd);                            \
+		return (uint32_t)(even + odd) +                                        \
+			   gdix_sum_u8_scalar(data + blocks * width, len % width);         \
+	}                                                                          \
+	static uint32_t isa##_sum_u16_le(const uint8_t *data, unsigned int len)    \
+	{                                                                          \
+		unsigned int blocks = len / width;                                     \
+		uint64_t even, odd;                                                    \
+		isa##_sum_bytes(data, blocks, &even, &odd);                            \
+		return (uint32_t)(even + (odd << 8)) +                                 \
+			   gdix_sum_u16_le_scalar(data + blocks * width, len % width);     \
+	}                                                                          \
+	static uint32_t isa##_sum_u16_be(const uint8_t *data, unsigned int len)    \
+	{                                                                          \
+		unsigned int blocks = len / width;                                     \
+		uint64_t even, odd;                                                    \
+		isa##_sum_bytes(data, blocks, &even, &odd);                            \
+		return (uint32_t)((even << 8) + odd) +                                 \
+			   gdix_sum_u16_be_scalar(data + blocks * width, len % width);     \
+	}                                                                          \
+	static const struct checksum_ops isa##_ops = {                             \
+		#isa,                                                                  \
+		isa##_sum_u8,                                                          \
+		isa##_sum_u16_le,                                                      \
+		isa##_sum_u16_be,                                                      \
+	};
+
+X86_KERNELS(sse2, 16)
+X86_KERNELS(avx2, 32)
+#endif
+
+#ifdef CHECKSUM_NEON
+/* vld2 splits even and odd bytes, pairwise widening adds can't overflow */
+static void neon_sum_bytes(const uint8_t *data, unsigned int blocks,
+						   uint64_t *even, uint64_t *odd)
+{
+	uint32x4_t acc_even = vdupq_n_u32(0);
+	uint32x4_t acc_odd = vdupq_n_u32(0);
+	uint64_t sum_even = 0, sum_odd = 0;
+	uint8x16x2_t v;
+	unsigned int i;
+
+	for (i = 0; i < blocks; i++) {
+		v = vld2q_u8(data + i * 32);
+		acc_even = vpadalq_u16(acc_even, vpaddlq_u8(v.val[0]));
+		acc_odd = vpadalq_u16(acc_odd, vpaddlq_u8(v.val[1]));
+		/* flush before the 32 bit lanes could wrap */
+		if ((i & 0xFFFF) == 0xFFFF) {
+			sum_even += vaddlvq_u32(acc_even);
+			sum_odd += vaddlvq_u32(acc_odd);
+			acc_even = vdupq_n_u32(0);
+			acc_odd = vdupq_n_u32(0);
+		}
+	}
+	*even = sum_even + vaddlvq_u32(acc_even);
+	*odd = sum_odd + vaddlvq_u32(acc_odd);
+}
+
+static uint32_t neon_sum_u8(const uint8_t *data, unsigned int len)
+{
+	unsigned int blocks = len / 32;
+	uint64_t even, odd;
+
+	neon_sum_bytes(data, blocks, &even, &odd);
+	return (uint32_t)(even + odd) +
+		   gdix_sum_u8_scalar(data + blocks * 32, len % 32);
+}
+
+static uint32_t neon_sum_u16_le(const uint8_t *data, unsigned int len)
+{
+	unsigned int blocks = len / 32;
+	uint64_t even, odd;
+
+	neon_sum_bytes(data, blocks, &even, &odd);
+	return (uint32_t)(even + (odd << 8)) +
+		   gdix_sum_u16_le_scalar(data + blocks * 32, len % 32);
+}
+
+static uint32_t neon_sum_u16_be(const uint8_t *data, unsigned int len)
+{
+	unsigned int blocks = len / 32;
+	uint64_t even, odd;
+
+	neon_sum_bytes(data, blocks, &even, &odd);
+	return (uint32_t)((even << 8) + odd) +
+		   gdix_sum_u16_be_scalar(data + blocks * 32, len % 32);
+}
+
+static const struct checksum_ops neon_ops = {
+	"neon",
+	neon_sum_u8,
+	neon_sum_u16_le,
+	neon_sum_u16_be,
+};
+#endif
+
+/* kernels in order of preference, the last one is the reference */
+static const struct checksum_ops *checksum_kernels[] = {
+#if defined(CHECKSUM_X86)
+	&avx2_ops,
+	&sse2_ops,
+#elif defined(CHECKSUM_NEON)
+	&neon_ops,
+#endif
+	&scalar_ops,
+};
+
+static bool checksum_usable(const struct checksum_ops *ops)
+{
+#if defined(CHECKSUM_X86)
+	__builtin_cpu_init();
+	if (ops == &avx2_ops)
+		return __builtin_cpu_supports("avx2");
+	if (ops == &sse2_ops)
+		return __builtin_cpu_supports("sse2");
+#endif
+	return true;
+}
+
+static const struct checksum_ops *checksum_ops()
+{
+	static const struct checksum_ops *ops = gdix_checksum_kernel(0);
+	return ops;
+}
+
+uint32_t gdix_sum_u8(const uint8_t *data, unsigned int len)
+{
+	return checksum_ops()->u8(data, len);
+}
+
+uint32_t gdix_sum_u16_le(const uint8_t *data, unsigned int len)
+{
+	return checksum_ops()->u16_le(data, len);
+}
+
+uint32_t gdix_sum_u16_be(const uint8_t *data, unsigned int len)
+{
+	return checksum_ops()->u16_be(data, len);
+}
+
+const char *gdix_checksum_impl() { return checksum_ops()->name; }
+
+const struct checksum_ops *gdix_checksum_kernel(int index)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(checksum_kernels) / sizeof(*checksum_kernels);
+		 i++) {
+		if (!checksum_usable(checksum_kernels[i]))
+			continue;
+		if (!index--)
+			return checksum_kernels[i];
+	}
+	return NULL;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+#include <stdint.h>
+
+/*
+ * Checksums used by the images and the flash protocols, all of them
+ * wrap at 32 bits, callers truncate to the width their format uses.
+ * For the u16 sums an odd trailing byte is added as if padded with 0.
+ *
+ * The vector kernel is picked once at runtime, the _scalar versions
+ * are the reference implementation.
+ */
+
+/* sum of bytes */
+uint32_t gdix_sum_u8(const uint8_t *data, unsigned int len);
+/* sum of little endian u16 words */
+uint32_t gdix_sum_u16_le(const uint8_t *data, unsigned int len);
+/* sum of big endian u16 words */
+uint32_t gdix_sum_u16_be(const uint8_t *data, unsigned int len);
+
+uint32_t gdix_sum_u8_scalar(const uint8_t *data, unsigned int len);
+uint32_t gdix_sum_u16_le_scalar(const uint8_t *data, unsigned int len);
+uint32_t gdix_sum_u16_be_scalar(const uint8_t *data, unsigned int len);
+
+struct checksum_ops {
+	const char *name;
+	uint32_t (*u8)(const uint8_t *data, unsigned int len);
+	uint32_t (*u16_le)(const uint8_t *data, unsigned int len);
+	uint32_t (*u16_be)(const uint8_t *data, unsigned int len);
+};
+
+/* name of the kernel in use, for debug log */
+const char *gdix_checksum_impl();
+/*
+ * kernels the CPU can run, best first and the scalar one last, NULL
+ * past the end. The one in use is index 0.
+ */
+const struct checksum_ops *gdix_checksum_kernel(int index);
+
+#endif
@@ -0,0 +1,455 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "gtp_util.h"
+
+/* udev may still be setting up a new node */
+#define DAEMON_PROBE_RETRY 50
+#define DAEMON_PROBE_WAIT_US 20000
+#define DAEMON_REPLY_LEN (DAEMON_MAX_DEVICES * 80)
+
+static const char *state_names[] = {"probing", "checking", "ok", "failed",
+									"ignored"};
+
+static long now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+UpdateDaemon::UpdateDaemon()
+{
+	m_socketName = NULL;
+	m_listenFd = -1;
+	m_inotifyFd = -1;
+	m_quit = false;
+	m_update = NULL;
+	m_reload = NULL;
+	m_ctx = NULL;
+	memset(m_devices, 0, sizeof(m_devices));
+	m_deviceNum = 0;
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_idle, NULL);
+}
+
+UpdateDaemon::~UpdateDaemon()
+{
+	Close();
+	pthread_cond_destroy(&m_idle);
+	pthread_mutex_destroy(&m_lock);
+}
+
+int UpdateDaemon::Open(const char *socketName)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socketName) >= sizeof(addr.sun_path)) {
+		gdix_err("Socket name too long:%s\n", socketName);
+		return -1;
+	}
+	strcpy(addr.sun_path, socketName);
+
+	m_inotifyFd = inotify_init1(IN_CLOEXEC);
+	if (m_inotifyFd < 0 ||
+		inotify_add_watch(m_inotifyFd, "/dev", IN_CREATE | IN_DELETE) < 0) {
+		gdix_err("Failed watch /dev, %s\n", strerror(errno));
+		goto err;
+	}
+
+	m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_listenFd < 0) {
+		gdix_err("Failed create socket, %s\n", strerror(errno));
+		goto err;
+	}
+	/* a socket left by a daemon that died */
+	unlink(socketName);
+	if (bind(m_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(m_listenFd, 8) < 0) {
+		gdix_err("Failed listen on %s, %s\n", socketName, strerror(errno));
+		goto err;
+	}
+	m_socketName = socketName;
+	return 0;
+
+err:
+	Close();
+	return -1;
+}
+
+void UpdateDaemon::Close()
+{
+	if (m_listenFd >= 0)
+		close(m_listenFd);
+	if (m_inotifyFd >= 0)
+		close(m_inotifyFd);
+	if (m_socketName)
+		unlink(m_socketName);
+	m_listenFd = -1;
+	m_inotifyFd = -1;
+	m_socketName = NULL;
+}
+
+struct daemon_device *UpdateDaemon::GetDevice(const char *name, bool add)
+{
+	struct daemon_device *dev;
+	int i;
+
+	for (i = 0; i < m_deviceNum; i++) {
+		if (!strcmp(m_devices[i].name, name))
+			return &m_devices[i];
+	}
+	if (!add)
+		return NULL;
+	if (m_deviceNum >= DAEMON_MAX_DEVICES) {
+		gdix_err("Too many devices, max %d\n", DAEMON_MAX_DEVICES);
+		return NULL;
+	}
+
+	dev = &m_devices[m_deviceNum++];
+	dev->daemon = this;
+	snprintf(dev->name, sizeof(dev->name), "%.*s", (int)sizeof(dev->name) - 1,
+			 name);
+	return dev;
+}
+
+/* check a device now, or once more after the running check */
+void UpdateDaemon::Kick(struct daemon_device *dev)
+{
+	pthread_t thread;
+	int ret;
+
+	pthread_mutex_lock(&m_lock);
+	if (dev->busy) {
+		dev->recheck = true;
+		pthread_mutex_unlock(&m_lock);
+		return;
+	}
+	dev->busy = true;
+	ret = pthread_create(&thread, NULL, Worker, dev);
+	if (ret) {
+		gdix_err("Failed start worker of %s, %s\n", dev->name, strerror(ret));
+		dev->busy = false;
+	} else {
+		pthread_detach(thread);
+	}
+	pthread_mutex_unlock(&m_lock);
+}
+
+void *UpdateDaemon::Worker(void *arg)
+{
+	struct daemon_device *dev = (struct daemon_device *)arg;
+	UpdateDaemon *daemon = dev->daemon;
+	struct hid_node node;
+	bool present, again;
+	int ret, retry, state;
+	long start, elapsed;
+
+	do {
+		pthread_mutex_lock(&daemon->m_lock);
+		dev->recheck = false;
+		dev->state = DEV_PROBING;
+		pthread_mutex_unlock(&daemon->m_lock);
+
+		memset(&node, 0, sizeof(node));
+		for (retry = 0; retry < DAEMON_PROBE_RETRY; retry++) {
+			ret = gdix_probe_node(dev->name, &node);
+			pthread_mutex_lock(&daemon->m_lock);
+			present = dev->present;
+			pthread_mutex_unlock(&daemon->m_lock);
+			if (ret >= 0 || !present)
+				break;
+			usleep(DAEMON_PROBE_WAIT_US);
+		}
+
+		start = now_ms();
+		pthread_mutex_lock(&daemon->m_lock);
+		dev->node = node;
+		if (ret > 0)
+			dev->state = DEV_CHECKING;
+		pthread_mutex_unlock(&daemon->m_lock);
+		if (ret > 0) {
+			gdix_info("%s %04x:%04x arrived, checking\n", node.path,
+					  node.vendor, node.product);
+			ret = daemon->m_update(&node, daemon->m_ctx);
+			state = ret > 0 ? DEV_IGNORED : ret ? DEV_FAILED : DEV_OK;
+		} else {
+			state = ret ? DEV_FAILED : DEV_IGNORED;
+		}
+		elapsed = now_ms() - start;
+
+		pthread_mutex_lock(&daemon->m_lock);
+		dev->state = state;
+		dev->result = ret;
+		dev->elapsed_ms = elapsed;
+		again = dev->recheck && dev->present;
+		if (!again) {
+			dev->busy = false;
+			pthread_cond_broadcast(&daemon->m_idle);
+		}
+		pthread_mutex_unlock(&daemon->m_lock);
+		if (ret <= 0 && dev->node.vendor)
+			gdix_info("%s %s, ret=%d, %ld ms\n", dev->node.path,
+					  state_names[state], ret, elapsed);
+	} while (again);
+	return NULL;
+}
+
+void UpdateDaemon::Arrive(const char *name)
+{
+	struct daemon_device *dev = GetDevice(name, true);
+
+	if (!dev)
+		return;
+	pthread_mutex_lock(&m_lock);
+	dev->present = true;
+	pthread_mutex_unlock(&m_lock);
+	Kick(dev);
+}
+
+/* a check running on it fails by itself */
+void UpdateDaemon::Leave(const char *name)
+{
+	struct daemon_device *dev = GetDevice(name, false);
+
+	if (!dev)
+		return;
+	pthread_mutex_lock(&m_lock);
+	dev->present = false;
+	pthread_mutex_unlock(&m_lock);
+	gdix_dbg("/dev/%s removed\n", name);
+}
+
+/* nodes present but not known, at start and when events were lost */
+void UpdateDaemon::Scan()
+{
+	struct daemon_device *dev;
+	struct dirent *ent;
+	DIR *dir;
+
+	dir = opendir("/dev");
+	if (!dir) {
+		gdix_err("Failed list /dev, %s\n", strerror(errno));
+		return;
+	}
+	while ((ent = readdir(dir)) != NULL) {
+		if (!gdix_is_hidraw(ent->d_name))
+			continue;
+		dev = GetDevice(ent->d_name, false);
+		if (!dev || !dev->present)
+			Arrive(ent->d_name);
+	}
+	closedir(dir);
+}
+
+void UpdateDaemon::HandleEvents()
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *ptr;
+
+	len = read(m_inotifyFd, buf, sizeof(buf));
+	if (len <= 0)
+		return;
+	for (ptr = buf; ptr < buf + len; ptr += sizeof(*ev) + ev->len) {
+		ev = (const struct inotify_event *)ptr;
+		if (ev->mask & IN_Q_OVERFLOW) {
+			Scan();
+			continue;
+		}
+		if (!ev->len || !gdix_is_hidraw(ev->name))
+			continue;
+		if (ev->mask & IN_CREATE)
+			Arrive(ev->name);
+		else if (ev->mask & IN_DELETE)
+			Leave(ev->name);
+	}
+}
+
+/* m_lock is held */
+int UpdateDaemon::BusyNum()
+{
+	int i, num = 0;
+
+	for (i = 0; i < m_deviceNum; i++) {
+		if (m_devices[i].busy)
+			num++;
+	}
+	return num;
+}
+
+int UpdateDaemon::Command(const char *cmd, char *reply, int len)
+{
+	struct daemon_device *dev;
+	const char *arg;
+	int i, busy, pos = 0;
+
+	if (!strcmp(cmd, "status")) {
+		pthread_mutex_lock(&m_lock);
+		for (i = 0; i < m_deviceNum && pos < len; i++) {
+			dev = &m_devices[i];
+			if (!dev->present || dev->node.vendor != GOODIX_VENDOR_ID)
+				continue;
+			pos += snprintf(reply + pos, len - pos,
+							"%s %04x:%04x %s ret=%d %ld ms\n", dev->node.path,
+							dev->node.vendor, dev->node.product,
+							state_names[dev->state], dev->result,
+							dev->elapsed_ms);
+		}
+		pthread_mutex_unlock(&m_lock);
+		return 0;
+	}
+
+	if (!strncmp(cmd, "check", 5) && (!cmd[5] || cmd[5] == ' ')) {
+		arg = cmd[5] ? cmd + 6 : NULL;
+		if (arg && !strncmp(arg, "/dev/", 5))
+			arg += 5;
+		if (arg) {
+			dev = GetDevice(arg, false);
+			if (!dev || !dev->present) {
+				snprintf(reply, len, "no device %s\n", arg);
+				return -1;
+			}
+			Kick(dev);
+		} else {
+			for (i = 0; i < m_deviceNum; i++) {
+				if (m_devices[i].present &&
+					m_devices[i].node.vendor == GOODIX_VENDOR_ID)
+					Kick(&m_devices[i]);
+			}
+		}
+		snprintf(reply, len, "ok\n");
+		return 0;
+	}
+
+	/* checks only start from this thread, none starts while reloading */
+	if (!strcmp(cmd, "reload")) {
+		pthread_mutex_lock(&m_lock);
+		busy = BusyNum();
+		pthread_mutex_unlock(&m_lock);
+		if (busy) {
+			snprintf(reply, len, "busy\n");
+			return -1;
+		}
+		if (m_reload(m_ctx)) {
+			snprintf(reply, len, "failed\n");
+			return -1;
+		}
+		snprintf(reply, len, "ok\n");
+		return 0;
+	}
+
+	if (!strcmp(cmd, "quit")) {
+		m_quit = true;
+		snprintf(reply, len, "bye\n");
+		return 0;
+	}
+
+	snprintf(reply, len, "unknown command %s\n", cmd);
+	return -1;
+}
+
+/* one command per connection */
+void UpdateDaemon::HandleClient()
+{
+	struct timeval tv = {1, 0};
+	char cmd[DAEMON_CMD_LEN];
+	char *reply, *end;
+	ssize_t len, pos = 0;
+	int fd;
+
+	fd = accept4(m_listenFd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+	/* a stuck client must not hold up hotplug */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	while (pos < (ssize_t)sizeof(cmd) - 1) {
+		len = read(fd, cmd + pos, sizeof(cmd) - 1 - pos);
+		if (len <= 0)
+			break;
+		pos += len;
+		if (memchr(cmd, '\n', pos))
+			break;
+	}
+	cmd[pos] = '\0';
+	end = strpbrk(cmd, "\r\n");
+	if (end)
+		*end = '\0';
+
+	reply = new char[DAEMON_REPLY_LEN];
+	reply[0] = '\0';
+	gdix_dbg("command:%s\n", cmd);
+	Command(cmd, reply, DAEMON_REPLY_LEN);
+	send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+	delete[] reply;
+	close(fd);
+}
+
+int UpdateDaemon::Run(daemon_update_func update, daemon_reload_func reload,
+					  void *ctx)
+{
+	struct pollfd fds[2];
+	int ret;
+
+	m_update = update;
+	m_reload = reload;
+	m_ctx = ctx;
+	m_quit = false;
+	Scan();
+
+	fds[0].fd = m_inotifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = m_listenFd;
+	fds[1].events = POLLIN;
+	while (!m_quit) {
+		ret = poll(fds, 2, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			gdix_err("poll failed, %s\n", strerror(errno));
+			break;
+		}
+		if (fds[0].revents & POLLIN)
+			HandleEvents();
+		if (fds[1].revents & POLLIN)
+			HandleClient();
+	}
+
+	/* let running updates finish, a cut off flash is worse */
+	pthread_mutex_lock(&m_lock);
+	while (BusyNum())
+		pthread_cond_wait(&m_idle, &m_lock);
+	pthread_mutex_unlock(&m_lock);
+	return m_quit ? 0 : -1;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <pthread.h>
+
+#include "discover.h"
+
+#define DAEMON_MAX_DEVICES 256
+#define DAEMON_CMD_LEN 256
+
+/*
+ * check a device that showed up and update it when needed, 0 if it is
+ * up to date afterwards, 1 if the device is not handled
+ */
+typedef int (*daemon_update_func)(const struct hid_node *node, void *ctx);
+/* parse the images again, 0 on success */
+typedef int (*daemon_reload_func)(void *ctx);
+
+enum DAEMON_STATE {
+	DEV_PROBING,
+	DEV_CHECKING,
+	DEV_OK,
+	DEV_FAILED,
+	DEV_IGNORED, /* not Goodix, or no image for it */
+};
+
+class UpdateDaemon;
+
+struct daemon_device {
+	UpdateDaemon *daemon;
+	char name[HID_NODE_PATH_LEN]; /* hidrawN */
+	struct hid_node node;
+	bool present;
+	bool busy;	  /* a worker runs for it */
+	bool recheck; /* check again when the worker is done */
+	int state;
+	int result;
+	long elapsed_ms;
+};
+
+/*
+ * Resident updater. New hidraw nodes are seen through inotify on /dev
+ * and checked against the images parsed at start, each one in its own
+ * worker. It is controlled by one line commands on a Unix socket:
+ * status, check [hidrawN], reload and quit.
+ */
+class UpdateDaemon
+{
+public:
+	UpdateDaemon();
+	~UpdateDaemon();
+
+	int Open(const char *socketName);
+	void Close();
+	/* serve until quit, the devices already present are checked first */
+	int Run(daemon_update_func update, daemon_reload_func reload, void *ctx);
+
+private:
+	static void *Worker(void *arg);
+	struct daemon_device *GetDevice(const char *name, bool add);
+	void Kick(struct daemon_device *dev);
+	void Arrive(const char *name);
+	void Leave(const char *name);
+	void Scan();
+	void HandleEvents();
+	void HandleClient();
+	int Command(const char *cmd, char *reply, int len);
+	int BusyNum();
+
+	const char *m_socketName;
+	int m_listenFd;
+	int m_inotifyFd;
+	bool m_quit;
+	daemon_update_func m_update;
+	daemon_reload_func m_reload;
+	void *m_ctx;
+	struct daemon_device m_devices[DAEMON_MAX_DEVICES];
+	int m_deviceNum;
+	pthread_mutex_t m_lock; /* guards the devices */
+	pthread_cond_t m_idle;	/* signaled when a worker ends */
+};
+
+#endif
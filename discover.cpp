@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/hidraw.h>
+#include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "discover.h"
+#include "gtp_util.h"
+
+bool gdix_is_hidraw(const char *name)
+{
+	return !strncmp(name, "hidraw", 6) &&
+		   strlen(name) < HID_NODE_PATH_LEN - strlen("/dev/");
+}
+
+static int node_number(const char *path)
+{
+	return atoi(path + strlen("/dev/hidraw"));
+}
+
+static int node_cmp(const void *a, const void *b)
+{
+	return node_number(((const struct hid_node *)a)->path) -
+		   node_number(((const struct hid_node *)b)->path);
+}
+
+/* the IDs come from the node itself, no report is exchanged */
+int gdix_probe_node(const char *name, struct hid_node *node)
+{
+	struct hidraw_devinfo info;
+	int fd, ret;
+
+	snprintf(node->path, sizeof(node->path), "/dev/%s", name);
+	fd = open(node->path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		gdix_dbg("skip %s, %s\n", node->path, strerror(errno));
+		return -1;
+	}
+	ret = ioctl(fd, HIDIOCGRAWINFO, &info);
+	/* the buses the updater talks over, not uhid or bluetooth */
+	if (ret < 0 || (uint16_t)info.vendor != GOODIX_VENDOR_ID ||
+		!gdix_bus_name(info.bustype)) {
+		close(fd);
+		return ret < 0 ? -1 : 0;
+	}
+	memset(node->phys, 0, sizeof(node->phys));
+	if (ioctl(fd, HIDIOCGRAWPHYS(sizeof(node->phys) - 1), node->phys) < 0)
+		node->phys[0] = '\0';
+	close(fd);
+
+	node->bustype = info.bustype;
+	node->vendor = info.vendor;
+	node->product = info.product;
+	return 1;
+}
+
+/*
+ * One walk of the hidraw class directory lists every node, /dev is only
+ * scanned when sysfs is not mounted.
+ */
+int gdix_discover(struct hid_node *nodes, int max)
+{
+	struct dirent *ent;
+	DIR *dir;
+	int num = 0;
+
+	dir = opendir("/sys/class/hidraw");
+	if (!dir)
+		dir = opendir("/dev");
+	if (!dir) {
+		gdix_err("Failed list hidraw nodes, %s\n", strerror(errno));
+		return -1;
+	}
+
+	while ((ent = readdir(dir)) != NULL) {
+		if (!gdix_is_hidraw(ent->d_name))
+			continue;
+		if (num >= max) {
+			gdix_err("Too many devices, max %d\n", max);
+			break;
+		}
+		if (gdix_probe_node(ent->d_name, &nodes[num]) > 0) {
+			gdix_dbg("%s %04x:%04x bus 0x%x\n", nodes[num].path,
+					 nodes[num].vendor, nodes[num].product,
+					 nodes[num].bustype);
+			num++;
+		}
+	}
+	closedir(dir);
+
+	qsort(nodes, num, sizeof(*nodes), node_cmp);
+	return num;
+}
+
+const char *gdix_bus_name(uint32_t bustype)
+{
+	switch (bustype) {
+	case BUS_USB:
+		return "usb";
+	case BUS_I2C:
+		return "i2c";
+	case BUS_SPI:
+		return "spi";
+	}
+	return NULL;
+}
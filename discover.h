@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _DISCOVER_H_
+#define _DISCOVER_H_
+
+#include <stdint.h>
+
+#define GOODIX_VENDOR_ID 0x27C6
+#define HID_NODE_PATH_LEN 32
+#define HID_NODE_PHYS_LEN 128
+
+struct hid_node {
+	char path[HID_NODE_PATH_LEN]; /* /dev/hidrawN */
+	uint32_t bustype;			  /* BUS_USB, BUS_I2C... */
+	uint16_t vendor;
+	uint16_t product;
+	char phys[HID_NODE_PHYS_LEN]; /* e.g. usb-0000:00:14.0-3/input0 */
+};
+
+/*
+ * Find the Goodix hidraw nodes, at most max of them, sorted by node
+ * number. Returns the number found or -1 if no node can be listed.
+ */
+int gdix_discover(struct hid_node *nodes, int max);
+/* name is a hidraw node of /dev */
+bool gdix_is_hidraw(const char *name);
+/*
+ * IDs of the node /dev/name, 1 for a Goodix device on usb, i2c or spi, 0
+ * for another one, -1 if the node can't be opened yet
+ */
+int gdix_probe_node(const char *name, struct hid_node *node);
+/* usb, i2c, spi or NULL */
+const char *gdix_bus_name(uint32_t bustype);
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <regex.h>
+
+#include "berlin_a/brla.h"
+#include "berlin_a/brla_firmware_image.h"
+#include "berlin_a/brla_update.h"
+#include "family.h"
+#include "gt7868q/gt7868q.h"
+#include "gt7868q/gt7868q_firmware_image.h"
+#include "gt7868q/gt7868q_update.h"
+#include "gtp_util.h"
+#include "gtx2/gtx2.h"
+#include "gtx2/gtx2_firmware_image.h"
+#include "gtx2/gtx2_update.h"
+#include "gtx3/gtx3.h"
+#include "gtx3/gtx3_firmware_image.h"
+#include "gtx3/gtx3_update.h"
+#include "gtx5/gtx5.h"
+#include "gtx5/gtx5_firmware_image.h"
+#include "gtx5/gtx5_update.h"
+#include "gtx8/gtx8.h"
+#include "gtx8/gtx8_firmware_image.h"
+#include "gtx8/gtx8_update.h"
+#include "gtx9/gtx9.h"
+#include "gtx9/gtx9_firmware_image.h"
+#include "gtx9/gtx9_update.h"
+
+/* family of a 4 digit hex PID */
+int gdix_family_from_pid(const char *pid)
+{
+	regmatch_t pamtch[1];
+	regex_t reg_pid;
+	int chipType = GDIX_ERR_FAMILY;
+
+	regcomp(&reg_pid, "^011[0-9A-Fa-f]$", REG_EXTENDED); // phoenix pid 011x
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match phoenix pid 011x\n");
+		chipType = TYPE_PHOENIX;
+	}
+	regfree(&reg_pid);
+
+	regcomp(&reg_pid, "^0[eE][0-9A-Fa-f]{2}$",
+			REG_EXTENDED); // phoenix pid 0exx
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match phoenix pid 0exx\n");
+		chipType = TYPE_PHOENIX;
+	}
+	regfree(&reg_pid);
+
+	regcomp(&reg_pid, "^01[fF][0-9A-Fa-f]$",
+			REG_EXTENDED); // mouse pad pid 01fx
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match mousepad pid 01fx\n");
+		chipType = TYPE_MOUSEPAD;
+	}
+	regfree(&reg_pid);
+
+	regcomp(&reg_pid, "^0[fF][0-9A-Fa-f]{2}$",
+			REG_EXTENDED); // mouse pad pid 0fxx
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match mousepad pid 0fxx\n");
+		chipType = TYPE_MOUSEPAD;
+	}
+	regfree(&reg_pid);
+
+	regcomp(&reg_pid, "^01[eE][0-7]$",
+			REG_EXTENDED); // 7863 windows pid 01e0~01e7
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match GT7863 pid 01e0_01e7\n");
+		chipType = TYPE_NORMANDYL;
+	}
+	regfree(&reg_pid);
+
+	regcomp(&reg_pid, "^0[dD][0-7][0-9A-Fa-f]$",
+			REG_EXTENDED); // 7863 chrome pid 0d00~0d7f
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match GT7863 pid 0d00_0d7f\n");
+		chipType = TYPE_NORMANDYL;
+	}
+	regfree(&reg_pid);
+
+	regcomp(&reg_pid, "^0[dD][8-9A-Ba-b][0-9A-Fa-f]$",
+			REG_EXTENDED); // 7868Q chrome pid 0d80~0dbf
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match GT7868Q pid 0d80_0dbf\n");
+		chipType = TYPE_YELLOWSTONE;
+	}
+	regfree(&reg_pid);
+
+	/* 0EB* 0EC* is BerlinB */
+	regcomp(&reg_pid, "^0[eE][bBcC][0-9A-Fa-f]$", REG_EXTENDED);
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match BerlinB pid 0EBx\n");
+		chipType = TYPE_BERLINB;
+	}
+	regfree(&reg_pid);
+
+	/* 0EA5~0EAF is BerlinB */
+	regcomp(&reg_pid, "^0[eE][aA][5-9A-Fa-f]$", REG_EXTENDED);
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match BerlinB pid 0EA5~0EAF\n");
+		chipType = TYPE_BERLINB;
+	}
+	regfree(&reg_pid);
+
+	/* 0Cxx is BerlinB */
+	regcomp(&reg_pid, "^0[cC][0-9A-Fa-f]{2}$", REG_EXTENDED);
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match BerlinB pid 0Cxx\n");
+		chipType = TYPE_BERLINB;
+	}
+	regfree(&reg_pid);
+
+	/* 0F60~0F7F is BerlinA */
+	regcomp(&reg_pid, "^0[fF][6-7][0-9A-Fa-f]$", REG_EXTENDED);
+	if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
+		gdix_dbg("pid match BerlinA pid 0F60~0F7F\n");
+		chipType = TYPE_BERLINA;
+	}
+	regfree(&reg_pid);
+
+	return chipType;
+}
+
+const char *gdix_family_name(int chipType)
+{
+	switch (chipType) {
+	case TYPE_PHOENIX:
+		return "phoenix";
+	case TYPE_NANJING:
+		return "nanjing";
+	case TYPE_MOUSEPAD:
+		return "mousepad";
+	case TYPE_NORMANDYL:
+		return "normandyL";
+	case TYPE_YELLOWSTONE:
+		return "yellowstone";
+	case TYPE_BERLINA:
+		return "berlinA";
+	case TYPE_BERLINB:
+		return "berlinB";
+	}
+	return "unknown";
+}
+
+/* family of a series number like 8589 or 7288 */
+int gdix_family_from_series(const char *series)
+{
+	regex_t reg_x3xx;
+	regex_t reg_x5xx;
+	regex_t reg_x2xx;
+	regex_t reg_x8xx;
+	regex_t reg_x9xx;
+	regex_t reg_7868;
+	regex_t reg_brla;
+	regmatch_t pamtch[1]; // match container
+	int chipType;
+
+	regcomp(&reg_x3xx, "^[0-9]3[0-9]{2}", REG_EXTENDED);
+	regcomp(&reg_x5xx, "^[0-9]5[0-9]{2}", REG_EXTENDED);
+	regcomp(&reg_x2xx, "^[0-9]2[0-9]{2}", REG_EXTENDED);
+	regcomp(&reg_x8xx, "^[0-9]8[0-9]{2}", REG_EXTENDED);
+	regcomp(&reg_x9xx, "^[0-9]9[0-9]{2}", REG_EXTENDED);
+	regcomp(&reg_7868, "^7868", REG_EXTENDED);
+	regcomp(&reg_brla, "^7726", REG_EXTENDED);
+
+	if (REG_NOERROR == regexec(&reg_x3xx, series, 1, pamtch, 0))
+		chipType = TYPE_PHOENIX; // 7388 match
+	else if (REG_NOERROR == regexec(&reg_x5xx, series, 1, pamtch, 0))
+		chipType = TYPE_NANJING; // 8589 match
+	else if (REG_NOERROR == regexec(&reg_x2xx, series, 1, pamtch, 0))
+		chipType = TYPE_MOUSEPAD; // 7288 match
+	else if (REG_NOERROR == regexec(&reg_x8xx, series, 1, pamtch, 0))
+		chipType = TYPE_NORMANDYL; // 7863 match
+	else if (REG_NOERROR == regexec(&reg_x9xx, series, 1, pamtch, 0))
+		chipType = TYPE_BERLINB; // 9966 match
+	else if (REG_NOERROR == regexec(&reg_7868, series, 1, pamtch, 0))
+		chipType = TYPE_YELLOWSTONE; // 7868 match
+	else if (REG_NOERROR == regexec(&reg_brla, series, 1, pamtch, 0))
+		chipType = TYPE_BERLINA; // 7726 match
+	else
+		chipType = GDIX_ERR_FAMILY; // no match
+
+	regfree(&reg_x3xx);
+	regfree(&reg_x5xx);
+	regfree(&reg_x2xx);
+	regfree(&reg_x8xx);
+	regfree(&reg_x9xx);
+	regfree(&reg_7868);
+	regfree(&reg_brla);
+	return chipType;
+}
+
+GTmodel *family_new_device(int chipType)
+{
+	switch (chipType) {
+	case TYPE_MOUSEPAD:
+		return new GTx2Device;
+	case TYPE_NANJING:
+		return new GTx5Device;
+	case TYPE_PHOENIX:
+		return new GTx3Device;
+	case TYPE_NORMANDYL:
+		return new GTx8Device;
+	case TYPE_BERLINB:
+		return new GTx9Device;
+	case TYPE_YELLOWSTONE:
+		return new GT7868QDevice;
+	case TYPE_BERLINA:
+		return new BrlADevice;
+	}
+	return NULL;
+}
+
+FirmwareImage *family_new_image(int chipType)
+{
+	switch (chipType) {
+	case TYPE_MOUSEPAD:
+		return new GTX2FirmwareImage;
+	case TYPE_NANJING:
+		return new GTX5FirmwareImage;
+	case TYPE_PHOENIX:
+		return new GTX3FirmwareImage;
+	case TYPE_NORMANDYL:
+		return new GTX8FirmwareImage;
+	case TYPE_BERLINB:
+		return new GTX9FirmwareImage;
+	case TYPE_YELLOWSTONE:
+		return new GT7868QFirmwareImage;
+	case TYPE_BERLINA:
+		return new BrlAFirmwareImage;
+	}
+	return NULL;
+}
+
+GTupdate *family_new_update(int chipType)
+{
+	switch (chipType) {
+	case TYPE_MOUSEPAD:
+		return new GTx2Update;
+	case TYPE_NANJING:
+		return new GTx5Update;
+	case TYPE_PHOENIX:
+		return new GTx3Update;
+	case TYPE_NORMANDYL:
+		return new GTx8Update;
+	case TYPE_BERLINB:
+		return new GTx9Update;
+	case TYPE_YELLOWSTONE:
+		return new GT7868QUpdate;
+	case TYPE_BERLINA:
+		return new BrlAUpdate;
+	}
+	return NULL;
+}
+
+unsigned int family_firmware_flag(int chipType)
+{
+	switch (chipType) {
+	case TYPE_MOUSEPAD:
+		return 0x1400C; // update type:0x02,0x03,0x0e,0x10
+	case TYPE_NANJING:
+		return 0x1400C; // update type:0x02,0x03,0x03,0x10;
+	case TYPE_PHOENIX:
+		return 0x844; // update type:0x02,0x03,0x03,0x10;
+	case TYPE_NORMANDYL:
+		return 0x0C; // update type:0x02,0x03;
+	case TYPE_BERLINB:
+		return 0x0B; // don't update type:0x0B;
+	case TYPE_YELLOWSTONE:
+		return 0x0C; // update type:0x02,0x03;
+	}
+	return 0xFFFFFFFF;
+}
+
+/*
+ * the update of the family is a coroutine flow that gives the thread
+ * back at each wait. The others block for the whole update, even when
+ * stepped.
+ */
+bool family_stepped(int chipType)
+{
+	return chipType == TYPE_BERLINA || chipType == TYPE_BERLINB ||
+		   chipType == TYPE_PHOENIX;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FAMILY_H_
+#define _FAMILY_H_
+
+#include "firmware_image.h"
+#include "gdixupdate.h"
+#include "gt_update.h"
+#include "gtmodel.h"
+
+enum IC_TYPE {
+	TYPE_PHOENIX = GDIX_FAMILY_PHOENIX,
+	TYPE_NANJING = GDIX_FAMILY_NANJING,
+	TYPE_MOUSEPAD = GDIX_FAMILY_MOUSEPAD,
+	TYPE_NORMANDYL = GDIX_FAMILY_NORMANDYL,
+	TYPE_YELLOWSTONE = GDIX_FAMILY_YELLOWSTONE,
+	TYPE_BERLINA = GDIX_FAMILY_BERLINA,
+	TYPE_BERLINB = GDIX_FAMILY_BERLINB,
+};
+
+/* objects of a family, NULL if it is unknown */
+GTmodel *family_new_device(int chipType);
+FirmwareImage *family_new_image(int chipType);
+GTupdate *family_new_update(int chipType);
+/* firmwareFlag of the update parameters */
+unsigned int family_firmware_flag(int chipType);
+/* true when gdix_update_step() returns between waits */
+bool family_stepped(int chipType);
+
+#endif
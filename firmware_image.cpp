@@ -20,8 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <typeinfo>
 #include <unistd.h>
 
+#include "checksum.h"
 #include "firmware_image.h"
 #include "gtp_util.h"
 
@@ -36,6 +38,17 @@ FirmwareImage::FirmwareImage()
 	m_firmwareVersionMajor = 0;
 	m_firmwareVersionMinor = 0;
 	m_firmwareData = NULL;
+	m_file = NULL;
+	m_source = NULL;
+	m_streaming = false;
+	m_subsys = NULL;
+	m_subsysNum = 0;
+	m_subsysMax = 0;
+	m_configs = NULL;
+	m_cfgNum = 0;
+	m_cfgMax = 0;
+	m_indexFile[0] = '\0';
+	m_indexLoaded = false;
 }
 
 int FirmwareImage::Initialize(const char *filename)
@@ -58,6 +71,13 @@ int FirmwareImage::Initialize(const char *filename)
 		m_initialized = false;
 		goto err_out;
 	}
+	if (!m_indexLoaded) {
+		if (BuildModel() < 0) {
+			gdix_err("Invalid image layout\n");
+			goto err_out;
+		}
+		SaveIndex(NULL, 0);
+	}
 	m_initialized = true;
 	gdix_dbg("%s exit\n", __func__);
 	return 0;
@@ -139,38 +159,32 @@ int FirmwareImage::GetDataFromFile(const char *filename)
 {
 	gdix_dbg("FirmwareImage %s run\n", __func__);
 
-	int ret, i;
-	int fw_fd;
+	int ret;
+	unsigned char header[6];
 	unsigned short check_sum = 0;
 
-	fw_fd = open(filename, O_RDONLY);
-
-	if (fw_fd < 0) {
-		perror("Cannot open file\n");
-		gdix_err("file:%s, ret:%d\n", filename, fw_fd);
-		return fw_fd;
-	}
-
-	m_totalSize = lseek(fw_fd, 0, SEEK_END);
-	lseek(fw_fd, 0, SEEK_SET);
+	Close();
+	m_file = OpenFile(filename);
+	if (!m_file)
+		return -1;
+	m_firmwareData = m_file->GetData();
+	m_totalSize = m_file->GetSize();
 
-	if (NULL != m_firmwareData) {
-		delete[] m_firmwareData;
-		m_firmwareData = NULL;
+	// firmware
+	if (m_totalSize < 6 || ReadData(0, header, sizeof(header)) < 0) {
+		gdix_err("Invalid firmware file size %d\n", m_totalSize);
+		ret = -1;
+		goto err_out;
 	}
-	m_firmwareData = new unsigned char[m_totalSize]();
-
-	ret = read(fw_fd, m_firmwareData, m_totalSize);
-	if (ret != m_totalSize) {
-		gdix_dbg("Failed read file: %s, ret=%d\n", filename, ret);
+	m_firmwareSize =
+		header[0] << 24 | header[1] << 16 | header[2] << 8 | header[3];
+	if (m_firmwareSize < 0 || m_firmwareSize + 6 > m_totalSize) {
+		gdix_err("Invalid firmware size %d, file size %d\n", m_firmwareSize,
+				 m_totalSize);
 		ret = -1;
 		goto err_out;
 	}
 
-	// firmware
-	m_firmwareSize = m_firmwareData[0] << 24 | m_firmwareData[1] << 16 |
-					 m_firmwareData[2] << 8 | m_firmwareData[3];
-
 	if (m_firmwareSize + 6 != m_totalSize) {
 		gdix_dbg("Check file len unequal %d != %d\n", m_firmwareSize + 6,
 				 m_totalSize);
@@ -178,20 +192,30 @@ int FirmwareImage::GetDataFromFile(const char *filename)
 		hasConfig = true;
 	}
 
-	for (i = 6, check_sum = 0; i < m_firmwareSize + 6; i++)
-		check_sum += m_firmwareData[i];
+	/* the image was validated when the index was built */
+	if (LoadIndex(NULL, 0))
+		return 0;
 
-	if (check_sum != (m_firmwareData[4] << 8 | m_firmwareData[5])) {
+	if (SumData(6, m_firmwareSize, &check_sum) < 0) {
+		ret = -1;
+		goto err_out;
+	}
+	if (check_sum != (header[4] << 8 | header[5])) {
 		gdix_dbg("Check_sum err  0x%x != 0x%x\n", check_sum,
-				 (m_firmwareData[4] << 8 | m_firmwareData[5]));
+				 (header[4] << 8 | header[5]));
 		ret = -2;
 		goto err_out;
 	}
 
 	// config
 	if (hasConfig) {
-		int cfgpackLen = (m_firmwareData[m_firmwareSize + 6] << 8) +
-						 m_firmwareData[m_firmwareSize + 7];
+		if (m_totalSize - m_firmwareSize - 6 < 6 ||
+			ReadData(m_firmwareSize + 6, header, sizeof(header)) < 0) {
+			gdix_err("config pack header truncated\n");
+			ret = -3;
+			goto err_out;
+		}
+		int cfgpackLen = (header[0] << 8) + header[1];
 		if (m_totalSize - m_firmwareSize - 6 != cfgpackLen + 6) {
 			gdix_err("config pack len error,%d != %d",
 					 m_totalSize - m_firmwareSize - 6, cfgpackLen + 6);
@@ -199,30 +223,45 @@ int FirmwareImage::GetDataFromFile(const char *filename)
 			goto err_out;
 		}
 
-		for (i = m_firmwareSize + 6 + 6, check_sum = 0; i < m_totalSize; i++)
-			check_sum += m_firmwareData[i];
-		if (check_sum != (m_firmwareData[m_firmwareSize + 6 + 4] << 8) +
-							 m_firmwareData[m_firmwareSize + 6 + 5]) {
+		if (SumData(m_firmwareSize + 12, m_totalSize - m_firmwareSize - 12,
+					&check_sum) < 0) {
+			ret = -4;
+			goto err_out;
+		}
+		if (check_sum != (header[4] << 8) + header[5]) {
 			gdix_err("config pack checksum error,%d != %d", check_sum,
-					 (m_firmwareData[m_firmwareSize + 6 + 4] << 8) +
-						 m_firmwareData[m_firmwareSize + 6 + 5]);
+					 (header[4] << 8) + header[5]);
 			ret = -4;
 			goto err_out;
 		}
 	}
 
-	close(fw_fd);
 	gdix_dbg("FirmwareImage %s exit,exit code:%d\n", __func__, 0);
 	return 0;
 
 err_out:
-	m_initialized = false;
-	delete[] m_firmwareData;
-	close(fw_fd);
+	Close();
 	gdix_dbg("FirmwareImage %s exit,exit code:%d\n", __func__, ret);
 	return ret;
 }
 
+/* byte sum of an image range, read a window at a time */
+int FirmwareImage::SumData(unsigned int offset, unsigned int len,
+						   unsigned short *sum)
+{
+	unsigned char window[FW_STREAM_WINDOW];
+	unsigned int n;
+
+	*sum = 0;
+	for (; len; offset += n, len -= n) {
+		n = len > FW_STREAM_WINDOW ? FW_STREAM_WINDOW : len;
+		if (ReadData(offset, window, n) < 0)
+			return -1;
+		*sum += gdix_sum_u8(window, n);
+	}
+	return 0;
+}
+
 int FirmwareImage::InitPid()
 {
 	gdix_dbg("FirmwareImage %s run\n", __func__);
@@ -241,8 +280,10 @@ int FirmwareImage::InitVid()
 
 int FirmwareImage::GetConfigSubCfgNum()
 {
-	if (hasConfig) {
-		return m_firmwareData[m_firmwareSize + 6 + 3];
+	unsigned char num;
+
+	if (hasConfig && ReadData(m_firmwareSize + 6 + 3, &num, 1) >= 0) {
+		return num;
 	}
 	return -1;
 }
@@ -265,20 +306,414 @@ int FirmwareImage::GetConfigSubCfgDataOffset()
 
 updateFlag FirmwareImage::GetUpdateFlag()
 {
-	if (hasConfig) {
-		return (updateFlag)(m_firmwareData[m_firmwareSize + 6 + 2]);
+	unsigned char flag;
+
+	if (hasConfig && ReadData(m_firmwareSize + 6 + 2, &flag, 1) >= 0) {
+		return (updateFlag)flag;
 	}
 	return NO_NEED_UPDATE;
 }
 
-void FirmwareImage::Close()
+/* FNV-1a hash of the whole image, identifies the image in the journal */
+unsigned int FirmwareImage::GetImageHash()
+{
+	unsigned char window[FW_STREAM_WINDOW];
+	unsigned int hash = 0x811C9DC5;
+	int offset, len, i;
+
+	if (!m_file)
+		return 0;
+	for (offset = 0; offset < m_totalSize; offset += len) {
+		len = m_totalSize - offset;
+		if (len > FW_STREAM_WINDOW)
+			len = FW_STREAM_WINDOW;
+		if (ReadData(offset, window, len) < 0)
+			return 0;
+		for (i = 0; i < len; i++) {
+			hash ^= window[i];
+			hash *= 0x01000193;
+		}
+	}
+	return hash;
+}
+
+ImageFile *FirmwareImage::OpenFile(const char *filename)
+{
+	if (m_source) {
+		m_source->Get();
+		return m_source;
+	}
+	return ImageFile::Open(filename, m_streaming);
+}
+
+/* copy image data out, works whether the image is resident or not */
+int FirmwareImage::ReadData(unsigned int offset, unsigned char *buf,
+							unsigned int len)
+{
+	if (!m_file)
+		return -1;
+	return m_file->Read(offset, buf, len);
+}
+
+/*
+ * Sub firmware follow each other from the data offset, every info entry
+ * is 8 bytes. Config pack entries are 3 bytes, sensor ID and 16 bit
+ * length, the configs follow each other from the config data offset.
+ */
+int FirmwareImage::BuildModel()
+{
+	struct image_subsys subsys;
+	unsigned char entry[3];
+	unsigned int infoPos = GetFirmwareSubFwInfoOffset();
+	unsigned int offset = GetFirmwareSubFwDataOffset();
+	int num = GetFirmwareSubFwNum();
+	unsigned int len;
+	int i;
+
+	for (i = 0; i < num; i++, infoPos += 8) {
+		memset(&subsys, 0, sizeof(subsys));
+		if (GetSubFwInfo(infoPos, &subsys) < 0)
+			return -1;
+		subsys.offset = offset;
+		subsys.sum_type = CHUNK_SUM_U16_BE;
+		if (AddSubsys(&subsys) < 0)
+			return -1;
+		offset += subsys.len;
+	}
+
+	num = GetConfigSubCfgNum();
+	infoPos = GetConfigSubCfgInfoOffset();
+	offset = GetConfigSubCfgDataOffset();
+	for (i = 0; i < num; i++, infoPos += 3) {
+		if (infoPos + 3 > (unsigned int)m_totalSize)
+			return -1;
+		if (ReadData(infoPos, entry, sizeof(entry)) < 0)
+			return -1;
+		len = (entry[1] << 8) | entry[2];
+		if (AddConfig(entry[0], offset, len) < 0)
+			return -1;
+		offset += len;
+	}
+	return 0;
+}
+
+/*
+ * Append a subsystem. The table takes over sums when given, otherwise
+ * the checksum of each flash chunk is worked out here.
+ */
+int FirmwareImage::AddSubsys(const struct image_subsys *subsys)
+{
+	struct image_subsys *table, *entry;
+	unsigned char window[FW_CHUNK_SIZE];
+	const unsigned char *data;
+	unsigned int pos, size, i;
+
+	if (subsys->offset > (unsigned int)m_totalSize ||
+		subsys->len > m_totalSize - subsys->offset) {
+		gdix_err("Subsystem %d exceeds image, offset 0x%x len 0x%x\n",
+				 m_subsysNum, subsys->offset, subsys->len);
+		return -1;
+	}
+
+	if (m_subsysNum == m_subsysMax) {
+		m_subsysMax = m_subsysMax ? m_subsysMax * 2 : 8;
+		table = new struct image_subsys[m_subsysMax];
+		if (m_subsysNum)
+			memcpy(table, m_subsys, m_subsysNum * sizeof(*table));
+		delete[] m_subsys;
+		m_subsys = table;
+	}
+
+	entry = &m_subsys[m_subsysNum];
+	*entry = *subsys;
+	entry->data = m_firmwareData ? m_firmwareData + subsys->offset : NULL;
+	if (subsys->sums) {
+		m_subsysNum++;
+		return 0;
+	}
+	entry->sums = new uint32_t[(subsys->len + FW_CHUNK_SIZE - 1) /
+							   FW_CHUNK_SIZE];
+	for (pos = 0, i = 0; pos < subsys->len; pos += size, i++) {
+		size = subsys->len - pos > FW_CHUNK_SIZE ? FW_CHUNK_SIZE
+												 : subsys->len - pos;
+		if (entry->data) {
+			data = &entry->data[pos];
+		} else {
+			if (ReadData(subsys->offset + pos, window, size) < 0) {
+				delete[] entry->sums;
+				return -1;
+			}
+			data = window;
+		}
+		if (subsys->sum_type == CHUNK_SUM_U16_BE)
+			entry->sums[i] = gdix_sum_u16_be(data, size);
+		else
+			entry->sums[i] = gdix_sum_u16_le(data, size);
+	}
+	m_subsysNum++;
+	return 0;
+}
+
+int FirmwareImage::AddConfig(uint32_t sensorID, uint32_t offset, uint32_t len)
+{
+	struct image_config *table, *entry;
+	unsigned char *copy;
+
+	if (offset > (unsigned int)m_totalSize || len > m_totalSize - offset) {
+		gdix_err("Config %d exceeds image, offset 0x%x len 0x%x\n",
+				 m_cfgNum, offset, len);
+		return -1;
+	}
+
+	if (m_cfgNum == m_cfgMax) {
+		m_cfgMax = m_cfgMax ? m_cfgMax * 2 : 8;
+		table = new struct image_config[m_cfgMax];
+		if (m_cfgNum)
+			memcpy(table, m_configs, m_cfgNum * sizeof(*table));
+		delete[] m_configs;
+		m_configs = table;
+	}
+
+	/* configs are small, keep a copy when the image is not resident */
+	entry = &m_configs[m_cfgNum];
+	entry->sensor_id = sensorID;
+	entry->offset = offset;
+	entry->len = len;
+	if (m_firmwareData) {
+		entry->data = m_firmwareData + offset;
+	} else {
+		copy = new unsigned char[len];
+		if (ReadData(offset, copy, len) < 0) {
+			delete[] copy;
+			return -1;
+		}
+		entry->data = copy;
+	}
+	m_cfgNum++;
+	return 0;
+}
+
+void FirmwareImage::ClearModel()
+{
+	int i;
+
+	for (i = 0; i < m_subsysNum; i++)
+		delete[] m_subsys[i].sums;
+	delete[] m_subsys;
+	m_subsys = NULL;
+	m_subsysNum = 0;
+	m_subsysMax = 0;
+	for (i = 0; i < m_cfgNum && !m_firmwareData; i++)
+		delete[] m_configs[i].data;
+	delete[] m_configs;
+	m_configs = NULL;
+	m_cfgNum = 0;
+	m_cfgMax = 0;
+}
+
+const struct image_subsys *FirmwareImage::GetSubsys(int index)
+{
+	if (index < 0 || index >= m_subsysNum)
+		return NULL;
+	return &m_subsys[index];
+}
+
+const struct image_config *FirmwareImage::GetConfig(int index)
+{
+	if (index < 0 || index >= m_cfgNum)
+		return NULL;
+	return &m_configs[index];
+}
+
+const struct image_config *FirmwareImage::FindConfig(unsigned char sensorID)
+{
+	int i;
+
+	for (i = 0; i < m_cfgNum; i++) {
+		if (m_configs[i].sensor_id == sensorID ||
+			m_configs[i].sensor_id == IMAGE_CFG_ANY_SENSOR)
+			return &m_configs[i];
+	}
+	return NULL;
+}
+
+/* look up the checksum of the flash chunk at an image offset */
+bool FirmwareImage::GetChunkSum(unsigned int offset, unsigned int len,
+								int type, uint32_t *sum)
+{
+	struct image_subsys *subsys;
+	unsigned int pos;
+	int i;
+
+	for (i = 0; i < m_subsysNum; i++) {
+		subsys = &m_subsys[i];
+		if (offset < subsys->offset || offset - subsys->offset >= subsys->len)
+			continue;
+		pos = offset - subsys->offset;
+		if (subsys->sum_type != (uint32_t)type || pos % FW_CHUNK_SIZE ||
+			len != (subsys->len - pos > FW_CHUNK_SIZE ? FW_CHUNK_SIZE
+													  : subsys->len - pos))
+			return false;
+		*sum = subsys->sums[pos / FW_CHUNK_SIZE];
+		return true;
+	}
+	return false;
+}
+
+void FirmwareImage::SetIndex(const char *filename)
 {
-	if (!m_initialized)
+	snprintf(m_indexFile, sizeof(m_indexFile), "%s", filename);
+}
+
+/*
+ * The key must change whenever the image may have: size, inode and
+ * mtime, plus a hash of its head and tail so a copy with a preserved
+ * mtime is caught too. The parser tag keeps one family from loading
+ * the index of another.
+ */
+int FirmwareImage::GetIndexKey(struct image_index_key *key)
+{
+	unsigned char window[FW_STREAM_WINDOW];
+	const char *parser = typeid(*this).name();
+	uint32_t hash = 0x811C9DC5;
+	unsigned int offset, len, i, part;
+
+	memset(key, 0, sizeof(*key));
+	key->size = m_totalSize;
+	key->ino = m_file->GetIno();
+	key->mtime_sec = m_file->GetMTime()->tv_sec;
+	key->mtime_nsec = m_file->GetMTime()->tv_nsec;
+
+	len = m_totalSize < FW_STREAM_WINDOW ? m_totalSize : FW_STREAM_WINDOW;
+	for (part = 0; part < 2; part++) {
+		offset = part ? m_totalSize - len : 0;
+		if (ReadData(offset, window, len) < 0)
+			return -1;
+		for (i = 0; i < len; i++) {
+			hash ^= window[i];
+			hash *= 0x01000193;
+		}
+	}
+	key->sample_hash = hash;
+
+	for (hash = 0x811C9DC5; *parser; parser++) {
+		hash ^= (unsigned char)*parser;
+		hash *= 0x01000193;
+	}
+	key->parser = hash;
+	return 0;
+}
+
+/*
+ * Index body: family summary, then the subsystems each followed by its
+ * chunk sums, then the configs. Every block is led by its length or
+ * count.
+ */
+bool FirmwareImage::LoadIndex(void *summary, unsigned int len)
+{
+	struct image_index_key key;
+	struct image_subsys subsys;
+	ImageIndex index;
+	uint32_t val, num, count;
+	uint32_t cfg[3];
+	unsigned int i;
+
+	m_indexLoaded = false;
+	if (!m_indexFile[0] || !m_file || GetIndexKey(&key) < 0 ||
+		index.Load(m_indexFile, &key) < 0)
+		return false;
+
+	if (index.GetU32(&val) < 0 || val != len ||
+		(len && index.Get(summary, len) < 0))
+		goto err;
+
+	if (index.GetU32(&num) < 0 || num > 256)
+		goto err;
+	for (i = 0; i < num; i++) {
+		memset(&subsys, 0, sizeof(subsys));
+		if (index.GetU32(&subsys.type) < 0 ||
+			index.GetU32(&subsys.flash_addr) < 0 ||
+			index.GetU32(&subsys.offset) < 0 ||
+			index.GetU32(&subsys.len) < 0 ||
+			index.GetU32(&subsys.sum_type) < 0 ||
+			subsys.offset > (unsigned int)m_totalSize ||
+			subsys.len > m_totalSize - subsys.offset)
+			goto err;
+		count = (subsys.len + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+		subsys.sums = new uint32_t[count];
+		if (index.Get(subsys.sums, count * sizeof(uint32_t)) < 0 ||
+			AddSubsys(&subsys) < 0) {
+			delete[] subsys.sums;
+			goto err;
+		}
+	}
+
+	if (index.GetU32(&num) < 0 || num > 256)
+		goto err;
+	for (i = 0; i < num; i++) {
+		if (index.Get(cfg, sizeof(cfg)) < 0 ||
+			AddConfig(cfg[0], cfg[1], cfg[2]) < 0)
+			goto err;
+	}
+
+	gdix_info("Use image index %s\n", m_indexFile);
+	m_indexLoaded = true;
+	return true;
+
+err:
+	gdix_info("Image index %s is broken, ignore it\n", m_indexFile);
+	ClearModel();
+	return false;
+}
+
+void FirmwareImage::SaveIndex(const void *summary, unsigned int len)
+{
+	struct image_index_key key;
+	struct image_subsys *subsys;
+	ImageIndex index;
+	int i;
+
+	if (!m_indexFile[0] || !m_file || GetIndexKey(&key) < 0)
 		return;
 
+	index.PutU32(len);
+	if (len)
+		index.Put(summary, len);
+
+	index.PutU32(m_subsysNum);
+	for (i = 0; i < m_subsysNum; i++) {
+		subsys = &m_subsys[i];
+		index.PutU32(subsys->type);
+		index.PutU32(subsys->flash_addr);
+		index.PutU32(subsys->offset);
+		index.PutU32(subsys->len);
+		index.PutU32(subsys->sum_type);
+		index.Put(subsys->sums, (subsys->len + FW_CHUNK_SIZE - 1) /
+									FW_CHUNK_SIZE * sizeof(uint32_t));
+	}
+
+	index.PutU32(m_cfgNum);
+	for (i = 0; i < m_cfgNum; i++) {
+		index.PutU32(m_configs[i].sensor_id);
+		index.PutU32(m_configs[i].offset);
+		index.PutU32(m_configs[i].len);
+	}
+
+	if (index.Save(m_indexFile, &key) < 0)
+		gdix_info("Failed save image index %s\n", m_indexFile);
+	else
+		gdix_dbg("Saved image index %s\n", m_indexFile);
+}
+
+void FirmwareImage::Close()
+{
 	m_initialized = false;
-	if (NULL != m_firmwareData) {
-		delete[] m_firmwareData;
-		m_firmwareData = NULL;
+	m_indexLoaded = false;
+	/* config copies are told apart by m_firmwareData, clear them first */
+	ClearModel();
+	m_firmwareData = NULL;
+	if (m_file) {
+		m_file->Release();
+		m_file = NULL;
 	}
 }
@@ -27,6 +27,48 @@
 #define FW_IMAGE_SUB_FWNUM_OFFSET 24 //x8=26
 */
 #include <cstddef>
+#include <limits.h>
+#include <stdint.h>
+
+#include "image_file.h"
+#include "image_index.h"
+
+/* chunk size used to walk an image that is not resident */
+#define FW_STREAM_WINDOW 4096
+/* flash chunk size, the same for all families */
+#define FW_CHUNK_SIZE 4096
+
+// flash chunk checksum format
+enum chunkSumType {
+	CHUNK_SUM_U16_BE = 0, /* gtx2/gtx3/gtx5/gtx8/gt7868q sub firmware */
+	CHUNK_SUM_U16_LE = 1, /* berlin subsystem */
+};
+
+/* config that applies whatever the sensor ID is */
+#define IMAGE_CFG_ANY_SENSOR 0xFFFFFFFF
+
+/*
+ * One flashable subsystem of the parsed image. Parsers fill in the
+ * layout, the checksum of every flash chunk is worked out once when the
+ * entry is added.
+ */
+struct image_subsys {
+	uint32_t type;
+	uint32_t flash_addr;
+	uint32_t offset; /* image offset of the subsystem */
+	uint32_t len;
+	uint32_t sum_type;
+	uint32_t *sums; /* one per FW_CHUNK_SIZE chunk */
+	const unsigned char *data; /* NULL when the image is not resident */
+};
+
+/* config of one sensor ID */
+struct image_config {
+	uint32_t sensor_id;
+	uint32_t offset; /* image offset of the config */
+	uint32_t len;
+	const unsigned char *data; /* a copy when the image is not resident */
+};
 
 // update type
 enum updateFlag {
@@ -43,6 +85,18 @@ public:
 	FirmwareImage();
 
 	virtual int Initialize(const char *filename);
+	/* stream image data from file instead of keeping it resident */
+	void SetStreaming(bool streaming) { m_streaming = streaming; }
+	/* sidecar index to load the parse result from and save it to */
+	void SetIndex(const char *filename);
+	/* take the image data from file, e.g. a bundle entry, instead of
+	 * opening the file passed to Initialize
+	 */
+	void SetSource(ImageFile *file) { m_source = file; }
+	int ReadData(unsigned int offset, unsigned char *buf, unsigned int len);
+	/* the file was rewritten since it was parsed */
+	bool Changed() { return m_file && m_file->Changed(); }
+	int SumData(unsigned int offset, unsigned int len, unsigned short *sum);
 
 	virtual unsigned int GetFirmwareSize() { return m_firmwareSize; }
 	virtual unsigned char *GetProductID() { return m_pid; }
@@ -50,7 +104,7 @@ public:
 	virtual unsigned int GetConfigID() { return 0; }
 	virtual int GetFirmwareVersionMajor() { return m_firmwareVersionMajor; }
 	virtual int GetFirmwareVersionMinor() { return m_firmwareVersionMinor; }
-	virtual unsigned char *GetFirmwareData()
+	virtual const unsigned char *GetFirmwareData()
 	{
 		if (m_initialized)
 			return m_firmwareData;
@@ -70,11 +124,36 @@ public:
 	virtual bool HasConfig() { return hasConfig; }
 	virtual int GetConfigSize() { return m_configSize; }
 	virtual updateFlag GetUpdateFlag();
+	virtual unsigned int GetImageHash();
+	/* parsed layout, read only once Initialize has returned */
+	int GetSubsysNum() { return m_subsysNum; }
+	const struct image_subsys *GetSubsys(int index);
+	int GetConfigNum() { return m_cfgNum; }
+	const struct image_config *GetConfig(int index);
+	const struct image_config *FindConfig(unsigned char sensorID);
+	/* checksum of the flash chunk at offset, false when the chunk is
+	 * not one of a subsystem
+	 */
+	bool GetChunkSum(unsigned int offset, unsigned int len, int type,
+					 uint32_t *sum);
 
 protected:
 	virtual int GetDataFromFile(const char *filename);
+	ImageFile *OpenFile(const char *filename);
 	virtual int InitPid();
 	virtual int InitVid();
+	virtual int BuildModel();
+	/* fill type, flash address and length from a sub firmware info entry */
+	virtual int GetSubFwInfo(unsigned int infoPos, struct image_subsys *subsys)
+	{
+		return -1;
+	}
+	int AddSubsys(const struct image_subsys *subsys);
+	int AddConfig(uint32_t sensorID, uint32_t offset, uint32_t len);
+	void ClearModel();
+	/* family summary is stored along with the tables, may be NULL */
+	bool LoadIndex(void *summary, unsigned int len);
+	void SaveIndex(const void *summary, unsigned int len);
 
 protected:
 	bool m_initialized;
@@ -85,7 +164,21 @@ protected:
 	unsigned char m_pid[8];
 	int m_firmwareVersionMajor;
 	int m_firmwareVersionMinor;
-	unsigned char *m_firmwareData;
+	const unsigned char *m_firmwareData;
+	ImageFile *m_file;
+	ImageFile *m_source;
+	bool m_streaming;
+	struct image_subsys *m_subsys;
+	int m_subsysNum;
+	int m_subsysMax;
+	struct image_config *m_configs;
+	int m_cfgNum;
+	int m_cfgMax;
+	char m_indexFile[PATH_MAX];
+	bool m_indexLoaded;
+
+private:
+	int GetIndexKey(struct image_index_key *key);
 };
 
 #endif
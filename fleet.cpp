@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/hidraw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fleet.h"
+#include "gtp_util.h"
+
+struct fleet_worker {
+	UpdateFleet *fleet;
+	struct fleet_bus *bus;
+};
+
+static long now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* a USB device directory is named bus-port[.port...], like 1-2.4 */
+static bool is_usb_port(const char *name, int len)
+{
+	int i;
+
+	if (len < 3 || name[0] < '0' || name[0] > '9')
+		return false;
+	for (i = 0; i < len; i++) {
+		if ((name[i] < '0' || name[i] > '9') && name[i] != '-' &&
+			name[i] != '.')
+			return false;
+	}
+	return memchr(name, '-', len) != NULL;
+}
+
+/*
+ * Bus of a hidraw node from its sysfs device path: the hub above the USB
+ * device, or the I2C adapter of an I2C HID device.
+ */
+static bool sysfs_bus(const char *node, char *bus, int len)
+{
+	char path[PATH_MAX], real[PATH_MAX];
+	char *comp, *end, *hub = NULL;
+
+	snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device", node);
+	if (!realpath(path, real))
+		return false;
+
+	for (comp = real + 1; *comp; comp = *end ? end + 1 : end) {
+		end = strchr(comp, '/');
+		if (!end)
+			end = comp + strlen(comp);
+		if (!strncmp(comp, "i2c-", 4) && comp[4] >= '0' && comp[4] <= '9') {
+			snprintf(bus, len, "%.*s", (int)(end - comp), comp);
+			return true;
+		}
+		/* the last USB device wins, its parent is the hub */
+		if (is_usb_port(comp, end - comp))
+			hub = comp - 1;
+	}
+	if (!hub)
+		return false;
+	snprintf(bus, len, "%.*s", (int)(hub - real), real);
+	return true;
+}
+
+/* usb-0000:00:14.0-2.4/input0 is on the hub usb-0000:00:14.0-2 */
+static bool phys_bus(const char *devName, char *bus, int len)
+{
+	char phys[FLEET_BUS_LEN] = {0};
+	char *pos;
+	int fd, ret;
+
+	fd = open(devName, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		return false;
+	ret = ioctl(fd, HIDIOCGRAWPHYS(sizeof(phys) - 1), phys);
+	close(fd);
+	if (ret <= 0 || !phys[0])
+		return false;
+
+	pos = strchr(phys, '/');
+	if (pos)
+		*pos = '\0';
+	pos = strrchr(phys, '.');
+	if (!pos)
+		pos = strrchr(phys, '-');
+	if (pos && pos != phys)
+		*pos = '\0';
+	snprintf(bus, len, "%s", phys);
+	return true;
+}
+
+/* devices nothing is known about are a bus on their own */
+void UpdateFleet::GetBus(const char *devName, char *bus, int len)
+{
+	const char *node = strrchr(devName, '/');
+
+	node = node ? node + 1 : devName;
+	if (!strncmp(node, "i2c-", 4)) {
+		snprintf(bus, len, "%s", node);
+		return;
+	}
+	if (!strncmp(node, "hidraw", 6) &&
+		(sysfs_bus(node, bus, len) || phys_bus(devName, bus, len)))
+		return;
+	snprintf(bus, len, "%s", devName);
+}
+
+UpdateFleet::UpdateFleet()
+{
+	memset(m_devices, 0, sizeof(m_devices));
+	m_deviceNum = 0;
+	m_busNum = 0;
+	m_maxPerBus = FLEET_DEFAULT_PER_BUS;
+	m_func = NULL;
+	m_ctx = NULL;
+	m_begin = NULL;
+	m_step = NULL;
+	m_end = NULL;
+	m_engine = NULL;
+	m_tasks = NULL;
+	pthread_mutex_init(&m_lock, NULL);
+	m_elapsedMs = 0;
+}
+
+UpdateFleet::~UpdateFleet() { pthread_mutex_destroy(&m_lock); }
+
+int UpdateFleet::AddDevice(const char *devName)
+{
+	int i;
+
+	if (m_deviceNum >= FLEET_MAX_DEVICES) {
+		gdix_err("Too many devices, max %d\n", FLEET_MAX_DEVICES);
+		return -1;
+	}
+	for (i = 0; i < m_deviceNum; i++) {
+		if (!strcmp(m_devices[i].name, devName)) {
+			gdix_err("Device %s given twice\n", devName);
+			return -1;
+		}
+	}
+	m_devices[m_deviceNum++].name = devName;
+	return 0;
+}
+
+/* group the devices by bus, each bus sorted longest update first */
+void UpdateFleet::Schedule(fleet_estimate_func estimate, void *ctx)
+{
+	struct fleet_device *dev;
+	struct fleet_bus *bus;
+	int i, j, k;
+
+	m_busNum = 0;
+	for (i = 0; i < m_deviceNum; i++) {
+		dev = &m_devices[i];
+		GetBus(dev->name, dev->bus, sizeof(dev->bus));
+		dev->estimate = estimate ? estimate(dev->name, ctx) : 0;
+		gdix_dbg("%s on bus %s, estimate %ld\n", dev->name, dev->bus,
+				 dev->estimate);
+
+		for (j = 0; j < m_busNum; j++) {
+			if (!strcmp(m_buses[j].name, dev->bus))
+				break;
+		}
+		bus = &m_buses[j];
+		if (j == m_busNum) {
+			bus->name = dev->bus;
+			bus->num = 0;
+			bus->next = 0;
+			m_busNum++;
+		}
+
+		/* insertion keeps the given order among equal estimates */
+		for (k = bus->num; k > 0; k--) {
+			if (m_devices[bus->devices[k - 1]].estimate >= dev->estimate)
+				break;
+			bus->devices[k] = bus->devices[k - 1];
+		}
+		bus->devices[k] = i;
+		bus->num++;
+	}
+}
+
+struct fleet_device *UpdateFleet::Next(struct fleet_bus *bus)
+{
+	struct fleet_device *dev = NULL;
+
+	pthread_mutex_lock(&m_lock);
+	if (bus->next < bus->num)
+		dev = &m_devices[bus->devices[bus->next++]];
+	pthread_mutex_unlock(&m_lock);
+	return dev;
+}
+
+/* one of the slots of a bus, updates its devices one after another */
+void *UpdateFleet::Worker(void *arg)
+{
+	struct fleet_worker *worker = (struct fleet_worker *)arg;
+	UpdateFleet *fleet = worker->fleet;
+	struct fleet_device *dev;
+	long start;
+
+	while ((dev = fleet->Next(worker->bus)) != NULL) {
+		start = now_ms();
+		dev->result = fleet->m_func(dev->name, fleet->m_ctx);
+		dev->elapsed_ms = now_ms() - start;
+	}
+	return NULL;
+}
+
+int UpdateFleet::Run(fleet_update_func func, fleet_estimate_func estimate,
+					 void *ctx)
+{
+	struct fleet_worker *workers;
+	pthread_t *threads;
+	long start = now_ms();
+	int i, j, slots, threadNum = 0, ret, failed = 0;
+
+	m_func = func;
+	m_ctx = ctx;
+	for (i = 0; i < m_deviceNum; i++)
+		m_devices[i].result = -1;
+	Schedule(estimate, ctx);
+
+	threads = new pthread_t[m_deviceNum];
+	workers = new struct fleet_worker[m_deviceNum];
+	for (i = 0; i < m_busNum; i++) {
+		slots = m_buses[i].num;
+		if (m_maxPerBus > 0 && slots > m_maxPerBus)
+			slots = m_maxPerBus;
+		gdix_info("bus %s: %d devices, %d at once\n", m_buses[i].name,
+				  m_buses[i].num, slots);
+		for (j = 0; j < slots; j++) {
+			workers[threadNum].fleet = this;
+			workers[threadNum].bus = &m_buses[i];
+			ret = pthread_create(&threads[threadNum], NULL, Worker,
+								 &workers[threadNum]);
+			if (ret) {
+				gdix_err("Failed start worker of bus %s, %s\n",
+						 m_buses[i].name, strerror(ret));
+				continue;
+			}
+			threadNum++;
+		}
+	}
+
+	for (i = 0; i < threadNum; i++)
+		pthread_join(threads[i], NULL);
+	delete[] workers;
+	delete[] threads;
+
+	for (i = 0; i < m_deviceNum; i++) {
+		if (m_devices[i].result)
+			failed++;
+	}
+	m_elapsedMs = now_ms() - start;
+	return failed;
+}
+
+/* start the next device of a bus, skipping the ones that can't start */
+void UpdateFleet::StartNext(struct fleet_bus *bus)
+{
+	struct fleet_device *dev;
+	struct fleet_task *task;
+
+	while ((dev = Next(bus)) != NULL) {
+		task = &m_tasks[dev - m_devices];
+		task->fleet = this;
+		task->bus = bus;
+		task->dev = dev;
+		task->start = now_ms();
+		task->handle = m_begin(dev->name, m_ctx, &dev->result);
+		if (!task->handle) {
+			dev->elapsed_ms = now_ms() - task->start;
+			continue;
+		}
+		if (m_engine->Add(TaskStep, TaskDone, task) < 0) {
+			dev->result = m_end(task->handle, -1);
+			dev->elapsed_ms = now_ms() - task->start;
+			continue;
+		}
+		return;
+	}
+}
+
+int UpdateFleet::TaskStep(void *arg, unsigned int *delayUs)
+{
+	struct fleet_task *task = (struct fleet_task *)arg;
+
+	return task->fleet->m_step(task->handle, delayUs);
+}
+
+/* a slot of the bus is free again */
+void UpdateFleet::TaskDone(void *arg, int ret)
+{
+	struct fleet_task *task = (struct fleet_task *)arg;
+	UpdateFleet *fleet = task->fleet;
+
+	task->dev->result = fleet->m_end(task->handle, ret);
+	task->dev->elapsed_ms = now_ms() - task->start;
+	fleet->StartNext(task->bus);
+}
+
+int UpdateFleet::RunStepped(fleet_begin_func begin, fleet_step_func step,
+							fleet_end_func end, fleet_estimate_func estimate,
+							void *ctx)
+{
+	UpdateEngine engine;
+	long start = now_ms();
+	int i, j, slots, failed = 0;
+
+	m_begin = begin;
+	m_step = step;
+	m_end = end;
+	m_ctx = ctx;
+	for (i = 0; i < m_deviceNum; i++)
+		m_devices[i].result = -1;
+	if (engine.Open())
+		return m_deviceNum;
+	Schedule(estimate, ctx);
+
+	m_engine = &engine;
+	m_tasks = new struct fleet_task[m_deviceNum];
+	for (i = 0; i < m_busNum; i++) {
+		slots = m_buses[i].num;
+		if (m_maxPerBus > 0 && slots > m_maxPerBus)
+			slots = m_maxPerBus;
+		gdix_info("bus %s: %d devices, %d at once\n", m_buses[i].name,
+				  m_buses[i].num, slots);
+		for (j = 0; j < slots; j++)
+			StartNext(&m_buses[i]);
+	}
+	engine.Run();
+	delete[] m_tasks;
+	m_tasks = NULL;
+	m_engine = NULL;
+
+	for (i = 0; i < m_deviceNum; i++) {
+		if (m_devices[i].result)
+			failed++;
+	}
+	m_elapsedMs = now_ms() - start;
+	return failed;
+}
+
+void UpdateFleet::Report()
+{
+	struct fleet_device *dev;
+	int i, failed = 0;
+
+	for (i = 0; i < m_deviceNum; i++) {
+		dev = &m_devices[i];
+		if (dev->result)
+			failed++;
+		printf("%s: %s, ret=%d, %ld ms, bus %s\n", dev->name,
+			   dev->result ? "FAILED" : "OK", dev->result, dev->elapsed_ms,
+			   dev->bus);
+	}
+	printf("%d devices updated, %d failed, %ld ms\n", m_deviceNum - failed,
+		   failed, m_elapsedMs);
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <pthread.h>
+
+#include "update_engine.h"
+
+class UpdateFleet;
+
+#define FLEET_MAX_DEVICES 256
+#define FLEET_BUS_LEN 256
+/* updates at once on one hub or adapter unless told otherwise */
+#define FLEET_DEFAULT_PER_BUS 4
+
+/* update one device, 0 on success */
+typedef int (*fleet_update_func)(const char *devName, void *ctx);
+/* rough cost of updating a device, e.g. bytes to flash, 0 if unknown */
+typedef long (*fleet_estimate_func)(const char *devName, void *ctx);
+/*
+ * set up the update of a device and start it, NULL with *result set if
+ * it can't be, the handle goes to the step and end functions
+ */
+typedef void *(*fleet_begin_func)(const char *devName, void *ctx,
+								  int *result);
+/* one step of a started update, as an engine_step_func */
+typedef int (*fleet_step_func)(void *handle, unsigned int *delayUs);
+/* clean up a stepped update, returns the result of the device */
+typedef int (*fleet_end_func)(void *handle, int ret);
+
+struct fleet_device {
+	const char *name;
+	char bus[FLEET_BUS_LEN]; /* devices with the same bus share bandwidth */
+	long estimate;
+	int result;
+	long elapsed_ms;
+};
+
+struct fleet_task {
+	UpdateFleet *fleet;
+	struct fleet_bus *bus;
+	struct fleet_device *dev;
+	void *handle;
+	long start;
+};
+
+struct fleet_bus {
+	const char *name;
+	int devices[FLEET_MAX_DEVICES]; /* longest update first */
+	int num;
+	int next; /* next device to start */
+};
+
+/*
+ * Updates many devices at once. Devices behind one USB hub or on one I2C
+ * adapter form a bus, at most a few of them are updated together and
+ * the longest update of a bus starts first. An update mostly waits for
+ * the IC, so buses are worked on in parallel.
+ */
+class UpdateFleet
+{
+public:
+	UpdateFleet();
+	~UpdateFleet();
+
+	static void GetBus(const char *devName, char *bus, int len);
+
+	int AddDevice(const char *devName);
+	int GetDeviceNum() { return m_deviceNum; }
+	/* 0 for no limit */
+	void SetMaxPerBus(int num) { m_maxPerBus = num; }
+	/*
+	 * number of devices that failed, all are done when it returns,
+	 * estimate may be NULL
+	 */
+	int Run(fleet_update_func func, fleet_estimate_func estimate, void *ctx);
+	/* like Run, with all updates stepped from this thread */
+	int RunStepped(fleet_begin_func begin, fleet_step_func step,
+				   fleet_end_func end, fleet_estimate_func estimate, void *ctx);
+	/* one line per device and a total */
+	void Report();
+
+private:
+	static void *Worker(void *arg);
+	static int TaskStep(void *arg, unsigned int *delayUs);
+	static void TaskDone(void *arg, int ret);
+	void StartNext(struct fleet_bus *bus);
+	void Schedule(fleet_estimate_func estimate, void *ctx);
+	struct fleet_device *Next(struct fleet_bus *bus);
+
+	struct fleet_device m_devices[FLEET_MAX_DEVICES];
+	int m_deviceNum;
+	struct fleet_bus m_buses[FLEET_MAX_DEVICES];
+	int m_busNum;
+	int m_maxPerBus;
+	fleet_update_func m_func;
+	void *m_ctx;
+	fleet_begin_func m_begin;
+	fleet_step_func m_step;
+	fleet_end_func m_end;
+	UpdateEngine *m_engine;
+	struct fleet_task *m_tasks;
+	pthread_mutex_t m_lock; /* guards next of the buses */
+	long m_elapsedMs;
+};
+
+#endif
@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/hidraw.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bundle.h"
+#include "family.h"
+#include "gdixupdate.h"
+#include "gtp_util.h"
+#include "lease.h"
+#include "update_journal.h"
+
+bool pdebug = false;
+
+struct gdix_image {
+	int family;
+	char name[PATH_MAX];
+	FirmwareImage *image; /* NULL for a bundle */
+	FirmwareBundle *bundle;
+	ImageFile *memFile;
+	bool stream;
+	/* bundle images parsed once and shared, by entry index */
+	pthread_mutex_t lock;
+	FirmwareImage **cache;
+	int cacheNum;
+};
+
+struct gdix_update {
+	char device[PATH_MAX];
+	struct gdix_image *source;
+	GTmodel *model;
+	GTupdate *update;
+	FirmwareImage *image;
+	UpdateJournal *journal;
+	ImageFile *bundleFile;
+	DeviceLease *lease;
+	GTUpdatePara para;
+	gdix_progress_func progress;
+	gdix_metrics_func metrics;
+	void *user;
+	long start;
+};
+
+static long now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+const char *gdix_lib_version(void) { return GDIX_LIB_VERSION; }
+
+void gdix_set_debug(int on) { pdebug = on; }
+
+void gdix_set_lease(const char *dir, int wait_ms)
+{
+	DeviceLease::Setup(dir, wait_ms);
+}
+
+static struct gdix_image *new_gdix_image(int family, const char *name)
+{
+	struct gdix_image *image = new struct gdix_image;
+
+	memset(image, 0, sizeof(*image));
+	image->family = family;
+	snprintf(image->name, sizeof(image->name), "%s", name);
+	pthread_mutex_init(&image->lock, NULL);
+	return image;
+}
+
+int gdix_image_open(int family, const char *path, unsigned int flags,
+					struct gdix_image **image)
+{
+	struct gdix_image *img;
+	bool stream = flags & GDIX_IMAGE_STREAM;
+
+	*image = NULL;
+	if (!FirmwareBundle::IsBundle(path) && family < 0) {
+		gdix_err("No family given for %s\n", path);
+		return GDIX_ERR_FAMILY;
+	}
+	/* only BerlinB can flash from a streamed image */
+	if (stream && family >= 0 && family != TYPE_BERLINB) {
+		gdix_info("streaming not supported, load the whole image\n");
+		stream = false;
+	}
+
+	img = new_gdix_image(family, path);
+	img->stream = stream;
+	if (FirmwareBundle::IsBundle(path)) {
+		/* devices may differ, each picks its image from the bundle */
+		img->bundle = new FirmwareBundle;
+		if (img->bundle->Open(path, stream))
+			goto err;
+		img->cacheNum = img->bundle->GetEntryNum();
+		img->cache = new FirmwareImage *[img->cacheNum]();
+	} else {
+		img->image = family_new_image(family);
+		if (!img->image) {
+			gdix_image_close(img);
+			return GDIX_ERR_FAMILY;
+		}
+		img->image->SetStreaming(stream);
+		if (flags & GDIX_IMAGE_INDEX)
+			img->image->SetIndex(
+				(std::string(path) + IMAGE_INDEX_SUFFIX).c_str());
+		if (img->image->Initialize(path)) {
+			gdix_err("Failed read firmware file:%s\n", path);
+			goto err;
+		}
+	}
+	*image = img;
+	return GDIX_OK;
+
+err:
+	gdix_image_close(img);
+	return GDIX_ERR_IMAGE;
+}
+
+int gdix_image_open_mem(int family, const void *data, unsigned int len,
+						struct gdix_image **image)
+{
+	struct gdix_image *img;
+
+	*image = NULL;
+	img = new_gdix_image(family, "<memory>");
+	img->image = family_new_image(family);
+	if (!img->image) {
+		gdix_image_close(img);
+		return GDIX_ERR_FAMILY;
+	}
+	img->memFile = ImageFile::OpenMemory(data, len);
+	if (!img->memFile)
+		goto err;
+	img->image->SetSource(img->memFile);
+	if (img->image->Initialize(img->name)) {
+		gdix_err("Failed parse firmware image\n");
+		goto err;
+	}
+	*image = img;
+	return GDIX_OK;
+
+err:
+	gdix_image_close(img);
+	return GDIX_ERR_IMAGE;
+}
+
+static void version_vid(const unsigned char *vid, struct gdix_version *version)
+{
+	if (vid)
+		snprintf(version->vid, sizeof(version->vid), "%02x%02x%02x%02x",
+				 vid[0], vid[1], vid[2], vid[3]);
+}
+
+static void image_version(FirmwareImage *image, struct gdix_version *version)
+{
+	memset(version, 0, sizeof(*version));
+	snprintf(version->pid, sizeof(version->pid), "%.8s",
+			 (const char *)image->GetProductID());
+	version->major = image->GetFirmwareVersionMajor();
+	version->minor = image->GetFirmwareVersionMinor();
+	version->sensor_id = -1;
+	version_vid(image->GetVendorID(), version);
+	version->config_id = image->GetConfigID();
+}
+
+int gdix_image_version(struct gdix_image *image, struct gdix_version *version)
+{
+	if (!image->image)
+		return GDIX_ERR_IMAGE;
+	image_version(image->image, version);
+	return GDIX_OK;
+}
+
+void gdix_image_close(struct gdix_image *image)
+{
+	int i;
+
+	if (!image)
+		return;
+	for (i = 0; i < image->cacheNum; i++)
+		delete image->cache[i];
+	delete[] image->cache;
+	delete image->image;
+	delete image->bundle;
+	if (image->memFile)
+		image->memFile->Release();
+	pthread_mutex_destroy(&image->lock);
+	delete image;
+}
+
+static void device_version(GTmodel *model, struct gdix_version *version)
+{
+	memset(version, 0, sizeof(*version));
+	snprintf(version->pid, sizeof(version->pid), "%.8s",
+			 (const char *)model->GetProductID());
+	version->major = model->GetFirmwareVersionMajor();
+	version->minor = model->GetFirmwareVersionMinor();
+	version->sensor_id = model->GetSensorID();
+	version_vid(model->GetVendorID(), version);
+	version->config_id = model->GetConfigID();
+}
+
+int gdix_device_query(int family, const char *device,
+					  struct gdix_version *version)
+{
+	GTmodel *model = family_new_device(family);
+	DeviceLease lease;
+	int ret = GDIX_OK;
+
+	if (!model)
+		return GDIX_ERR_FAMILY;
+	if (lease.Acquire(device)) {
+		ret = GDIX_ERR_BUSY;
+	} else if (model->Open(device)) {
+		gdix_err("failed open device:%s\n", device);
+		ret = GDIX_ERR_DEVICE;
+	} else {
+		device_version(model, version);
+	}
+	model->Close();
+	delete model;
+	return ret;
+}
+
+/* family of the device by its PID, for a bundle of several families */
+static int device_family(const char *device)
+{
+	struct hidraw_devinfo info;
+	char pid[8];
+	int fd, ret;
+
+	fd = open(device, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		gdix_err("failed open device:%s, %s\n", device, strerror(errno));
+		return GDIX_ERR_DEVICE;
+	}
+	ret = ioctl(fd, HIDIOCGRAWINFO, &info);
+	close(fd);
+	if (ret < 0) {
+		gdix_err("%s is not a hidraw device\n", device);
+		return GDIX_ERR_DEVICE;
+	}
+	snprintf(pid, sizeof(pid), "%04x", (uint16_t)info.product);
+	ret = gdix_family_from_pid(pid);
+	if (ret < 0)
+		gdix_err("%s has unknown pid %s\n", device, pid);
+	return ret;
+}
+
+/*
+ * The size of the image, or of the only bundle image of the family. The
+ * device is asked for its PID and sensor ID only when the bundle holds
+ * several images of its family.
+ */
+unsigned int gdix_image_bytes(struct gdix_image *image, const char *device)
+{
+	const struct bundle_entry *entry, *found = NULL;
+	DeviceLease lease;
+	GTmodel *model;
+	int family = image->family;
+	int i, num = 0;
+
+	if (image->image)
+		return image->image->GetFirmwareSize();
+	if (family < 0) {
+		family = device_family(device);
+		if (family < 0)
+			return 0;
+	}
+	for (i = 0; i < image->bundle->GetEntryNum(); i++) {
+		entry = image->bundle->GetEntry(i);
+		if (entry->family != (uint32_t)family)
+			continue;
+		found = entry;
+		num++;
+	}
+	if (num <= 1)
+		return found ? found->len : 0;
+
+	model = family_new_device(family);
+	found = NULL;
+	if (!lease.Acquire(device) && !model->Open(device))
+		found = image->bundle->Find(family, model->GetProductID(),
+									model->GetSensorID());
+	model->Close();
+	delete model;
+	return found ? found->len : 0;
+}
+
+/* the bundle image for the device, parsed once when cached */
+static int pick_image(struct gdix_update *u, int family)
+{
+	struct gdix_image *source = u->source;
+	const struct bundle_entry *entry;
+	FirmwareImage *image;
+	int index;
+
+	entry = source->bundle->Find(family, u->model->GetProductID(),
+								 u->model->GetSensorID());
+	if (!entry) {
+		gdix_err("No image for device:%s in bundle %s\n", u->device,
+				 source->name);
+		return GDIX_ERR_IMAGE;
+	}
+	gdix_info("Bundle image PID %.8s sensor 0x%x version 0x%x 0x%x\n",
+			  entry->pid, entry->sensor_id, entry->ver_major,
+			  entry->ver_minor);
+	index = entry - source->bundle->GetEntry(0);
+
+	pthread_mutex_lock(&source->lock);
+	u->image = source->cache[index];
+	pthread_mutex_unlock(&source->lock);
+	if (u->image)
+		return GDIX_OK;
+
+	image = family_new_image(family);
+	image->SetStreaming(source->stream && family == TYPE_BERLINB);
+	u->bundleFile = source->bundle->OpenEntry(entry);
+	if (!u->bundleFile) {
+		delete image;
+		return GDIX_ERR_IMAGE;
+	}
+	image->SetSource(u->bundleFile);
+	if (image->Initialize(source->name)) {
+		gdix_err("Failed read firmware file:%s\n", source->name);
+		delete image;
+		return GDIX_ERR_IMAGE;
+	}
+
+	/* another update may have been faster */
+	pthread_mutex_lock(&source->lock);
+	if (source->cache[index]) {
+		delete image;
+	} else {
+		source->cache[index] = image;
+	}
+	u->image = source->cache[index];
+	pthread_mutex_unlock(&source->lock);
+	return GDIX_OK;
+}
+
+static void update_progress(void *arg, unsigned int flashed)
+{
+	struct gdix_update *u = (struct gdix_update *)arg;
+	struct gdix_progress progress;
+
+	progress.device = u->device;
+	progress.done = flashed;
+	progress.total = u->image->GetFirmwareSize();
+	progress.elapsed_ms = now_ms() - u->start;
+	u->progress(&progress, u->user);
+}
+
+/*
+ * Each update has its own model and update objects, so updates of
+ * several devices may be set up and run at once.
+ */
+int gdix_update_open(const char *device, struct gdix_image *image,
+					 const struct gdix_update_opts *opts,
+					 struct gdix_update **update)
+{
+	struct gdix_update *u;
+	char key[LEASE_KEY_LEN];
+	int family = image->family;
+	int ret;
+
+	*update = NULL;
+	/* rewritten in place, the parsed image no longer matches the file */
+	if ((image->bundle && image->bundle->Changed()) ||
+		(image->image && image->image->Changed())) {
+		gdix_err("%s changed since it was loaded, reload it\n",
+				 image->name);
+		return GDIX_ERR_IMAGE;
+	}
+	if (family < 0) {
+		family = device_family(device);
+		if (family < 0)
+			return family;
+	}
+
+	u = new struct gdix_update;
+	memset(u, 0, sizeof(*u));
+	snprintf(u->device, sizeof(u->device), "%s", device);
+	u->source = image;
+	u->image = image->image;
+	u->model = family_new_device(family);
+	u->update = family_new_update(family);
+	if (!u->model || !u->update) {
+		ret = GDIX_ERR_FAMILY;
+		goto err;
+	}
+	u->lease = new DeviceLease;
+	if (u->lease->Acquire(device)) {
+		ret = GDIX_ERR_BUSY;
+		goto err;
+	}
+	u->para.firmwareFlag = family_firmware_flag(family);
+	if (opts) {
+		u->para.force = opts->force;
+		u->progress = opts->progress;
+		u->metrics = opts->metrics;
+		u->user = opts->user;
+		if (opts->firmware_flag)
+			u->para.firmwareFlag = opts->firmware_flag;
+	}
+
+	/* a resume must find the same IC, whatever node it comes back as */
+	if (opts && opts->journal) {
+		DeviceLease::GetKey(device, key, sizeof(key));
+		u->journal = new UpdateJournal;
+		if (u->journal->Open(opts->journal, key)) {
+			gdix_err("failed open journal:%s\n", opts->journal);
+			ret = GDIX_ERR_DEVICE;
+			goto err;
+		}
+	}
+
+	ret = u->model->Open(device);
+	/* an IC left in bootloader can't report its properties */
+	if (ret && u->journal && u->journal->Pending() &&
+		u->model->IsOpened()) {
+		gdix_info("device:%s has unfinished update, try to resume\n",
+				  device);
+		ret = 0;
+	}
+	if (ret) {
+		gdix_err("failed open device:%s\n", device);
+		ret = GDIX_ERR_DEVICE;
+		goto err;
+	}
+
+	if (!u->image) {
+		ret = pick_image(u, family);
+		if (ret)
+			goto err;
+	}
+
+	if (u->update->Initialize(u->model, u->image)) {
+		ret = GDIX_ERR_IMAGE;
+		goto err;
+	}
+	u->update->SetJournal(u->journal);
+	if (u->progress)
+		u->update->SetProgress(update_progress, u);
+	*update = u;
+	return GDIX_OK;
+
+err:
+	gdix_update_close(u);
+	return ret;
+}
+
+int gdix_update_plan(struct gdix_update *update, struct gdix_plan *plan)
+{
+	int ret;
+
+	device_version(update->model, &plan->device);
+	image_version(update->image, &plan->image);
+	plan->bytes = update->image->GetFirmwareSize();
+	ret = update->update->Plan();
+	if (ret > 0)
+		plan->action = GDIX_ACTION_UPDATE;
+	else if (ret == 0)
+		plan->action = GDIX_ACTION_SKIP;
+	else
+		plan->action = GDIX_ACTION_REFUSE;
+	return GDIX_OK;
+}
+
+int gdix_update_start(struct gdix_update *update)
+{
+	update->start = now_ms();
+	update->update->Start(&update->para);
+	return GDIX_OK;
+}
+
+/* ret is what the update returned */
+static int update_done(struct gdix_update *update, int ret)
+{
+	struct gdix_metrics metrics;
+
+	if (ret == -ECANCELED) {
+		ret = GDIX_ERR_CANCELED;
+	} else if (ret) {
+		gdix_err("Firmware update err:ret=%d\n", ret);
+		ret = GDIX_ERR_UPDATE;
+	}
+
+	if (update->metrics) {
+		metrics.device = update->device;
+		metrics.result = ret;
+		metrics.elapsed_ms = now_ms() - update->start;
+		metrics.flashed = update->update->GetFlashed();
+		update->metrics(&metrics, update->user);
+	}
+	return ret;
+}
+
+int gdix_update_step(struct gdix_update *update, unsigned int *delay_us)
+{
+	int ret;
+
+	*delay_us = 0;
+	ret = update->update->Step(delay_us);
+	if (ret == UPDATE_STEP_WAIT)
+		return GDIX_STEP_WAIT;
+	return update_done(update, ret);
+}
+
+int gdix_update_run(struct gdix_update *update)
+{
+	unsigned int delayUs;
+	int ret;
+
+	gdix_update_start(update);
+	while ((ret = gdix_update_step(update, &delayUs)) == GDIX_STEP_WAIT)
+		usleep(delayUs);
+	return ret;
+}
+
+void gdix_update_cancel(struct gdix_update *update)
+{
+	update->update->Cancel();
+}
+
+void gdix_update_close(struct gdix_update *update)
+{
+	if (!update)
+		return;
+	delete update->update;
+	if (update->model)
+		update->model->Close();
+	delete update->model;
+	delete update->journal;
+	if (update->bundleFile)
+		update->bundleFile->Release();
+	/* the device is closed, another process may have it */
+	delete update->lease;
+	delete update;
+}
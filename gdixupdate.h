@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GDIXUPDATE_H_
+#define _GDIXUPDATE_H_
+
+/*
+ * C interface of libgdixupdate, what gdixupdate itself is built on.
+ *
+ * An image is loaded once and may be used by the updates of any number
+ * of devices, from any number of threads. An update opens one device,
+ * tells whether it needs the image and flashes it, either blocking in
+ * gdix_update_run() or stepped from the caller's own event loop.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GDIX_LIB_VERSION "1.7.9"
+
+/* the library is built with hidden symbols, only these are exported */
+#define GDIX_API __attribute__((visibility("default")))
+
+/* chip families */
+enum gdix_family {
+	GDIX_FAMILY_PHOENIX,	 /* 7388 */
+	GDIX_FAMILY_NANJING,	 /* 8589 */
+	GDIX_FAMILY_MOUSEPAD,	 /* 7288 */
+	GDIX_FAMILY_NORMANDYL,	 /* 7863 */
+	GDIX_FAMILY_YELLOWSTONE, /* 7868 */
+	GDIX_FAMILY_BERLINA,	 /* 7726 */
+	GDIX_FAMILY_BERLINB,	 /* 9916 */
+};
+/* a bundle holding images of several families */
+#define GDIX_FAMILY_ANY -1
+
+/* results, the exit codes of gdixupdate */
+enum gdix_status {
+	GDIX_OK = 0,
+	GDIX_ERR_DEVICE = -1,	/* can't open or talk to the device */
+	GDIX_ERR_IMAGE = -2,	/* bad image, or none for the device */
+	GDIX_ERR_UPDATE = -4,	/* the update itself failed */
+	GDIX_ERR_CANCELED = -5, /* gdix_update_cancel() was called */
+	GDIX_ERR_FAMILY = -6,	/* unknown family */
+	GDIX_ERR_BUSY = -7,		/* another process has the device */
+};
+
+/* returned by gdix_update_step() while the update goes on */
+#define GDIX_STEP_WAIT 1
+
+/* gdix_image_open() flags */
+#define GDIX_IMAGE_STREAM 0x1 /* read data from file while flashing */
+#define GDIX_IMAGE_INDEX 0x2  /* keep the parse result next to the file */
+
+/* where gdix_set_lease() puts its locks unless told otherwise */
+#define GDIX_LEASE_DIR "/run/lock/gdixupdate"
+
+/* what gdix_update_plan() says about a device */
+enum gdix_action {
+	GDIX_ACTION_REFUSE = -1, /* the image doesn't fit the device */
+	GDIX_ACTION_SKIP = 0,	 /* the device already runs the image */
+	GDIX_ACTION_UPDATE = 1,
+};
+
+struct gdix_image;
+struct gdix_update;
+
+struct gdix_version {
+	char pid[9];
+	int major;
+	int minor;
+	int sensor_id; /* -1 for an image */
+	char vid[9];   /* hex, empty for the families that have none */
+	unsigned int config_id;
+};
+
+struct gdix_plan {
+	struct gdix_version device;
+	struct gdix_version image;
+	int action;
+	unsigned int bytes; /* to flash, about */
+};
+
+struct gdix_progress {
+	const char *device;
+	unsigned int done; /* bytes acked by the IC */
+	unsigned int total; /* about, done may end a little off it */
+	long elapsed_ms;
+};
+
+struct gdix_metrics {
+	const char *device;
+	int result;
+	long elapsed_ms;
+	unsigned int flashed; /* bytes acked by the IC */
+};
+
+/* called from the thread running the update */
+typedef void (*gdix_progress_func)(const struct gdix_progress *progress,
+								   void *user);
+typedef void (*gdix_metrics_func)(const struct gdix_metrics *metrics,
+								  void *user);
+
+struct gdix_update_opts {
+	int force; /* flash even if the device runs the image */
+	const char *journal; /* resume an interrupted update from it, or NULL */
+	gdix_progress_func progress; /* each chunk the IC acks, or NULL */
+	gdix_metrics_func metrics;	 /* once the update is over, or NULL */
+	void *user;
+	unsigned int firmware_flag; /* 0 for the family default */
+};
+
+GDIX_API const char *gdix_lib_version(void);
+/* log to stdout and stderr, off by default */
+GDIX_API void gdix_set_debug(int on);
+/*
+ * Leases keep processes from talking to the same device at once, by
+ * locks in dir, GDIX_LEASE_DIR by default. NULL takes no leases. A
+ * device leased by another process fails with GDIX_ERR_BUSY, at once
+ * or after waiting wait_ms for it, -1 to wait as long as it takes. The
+ * wait blocks gdix_update_open(), an event loop sets 0 and retries.
+ */
+GDIX_API void gdix_set_lease(const char *dir, int wait_ms);
+
+/* GDIX_ERR_FAMILY if nothing matches */
+GDIX_API int gdix_family_from_pid(const char *pid);
+GDIX_API int gdix_family_from_series(const char *series);
+GDIX_API const char *gdix_family_name(int family);
+
+/*
+ * Load an image of family, or a bundle. The family of a bundle may be
+ * GDIX_FAMILY_ANY, each device then gets the image of its own family.
+ */
+GDIX_API int gdix_image_open(int family, const char *path, unsigned int flags,
+							 struct gdix_image **image);
+/* the data is copied, a bundle can't be loaded from memory */
+GDIX_API int gdix_image_open_mem(int family, const void *data,
+								 unsigned int len, struct gdix_image **image);
+/* GDIX_ERR_IMAGE for a bundle */
+GDIX_API int gdix_image_version(struct gdix_image *image,
+								struct gdix_version *version);
+/*
+ * Bytes the image flashes on device, about. Only the image of a bundle
+ * that holds several of the device's family takes asking the device.
+ */
+GDIX_API unsigned int gdix_image_bytes(struct gdix_image *image,
+									   const char *device);
+/* once no update uses the image any more */
+GDIX_API void gdix_image_close(struct gdix_image *image);
+
+/* read the version of a device without setting up an update */
+GDIX_API int gdix_device_query(int family, const char *device,
+							   struct gdix_version *version);
+
+/* open device and pick its image, opts may be NULL */
+GDIX_API int gdix_update_open(const char *device, struct gdix_image *image,
+							  const struct gdix_update_opts *opts,
+							  struct gdix_update **update);
+/* force in the options flashes whatever the plan says */
+GDIX_API int gdix_update_plan(struct gdix_update *update,
+							  struct gdix_plan *plan);
+/* blocks until the update is over */
+GDIX_API int gdix_update_run(struct gdix_update *update);
+/*
+ * Stepped run. After gdix_update_start(), call gdix_update_step() until
+ * it returns something else than GDIX_STEP_WAIT, waiting *delay_us
+ * between the calls.
+ *
+ * Only the BerlinA, BerlinB and GTx3 flows return between waits. GTx2,
+ * GTx5, GTx8 and GT7868Q have no stepped flow, their first step runs
+ * the whole update and blocks as long as gdix_update_run(), so give
+ * them a thread of their own.
+ */
+GDIX_API int gdix_update_start(struct gdix_update *update);
+GDIX_API int gdix_update_step(struct gdix_update *update,
+							  unsigned int *delay_us);
+/*
+ * Stop the update at its next wait, safe from any thread. A journal
+ * keeps what was flashed so far for the next run.
+ */
+GDIX_API void gdix_update_cancel(struct gdix_update *update);
+GDIX_API void gdix_update_close(struct gdix_update *update);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
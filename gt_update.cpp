@@ -1,6 +1,20 @@
 #include "gt_update.h"
+#include "checksum.h"
+#include <errno.h>
+#include <unistd.h>
 
-GTupdate::GTupdate() {}
+GTupdate::GTupdate()
+{
+	m_ackedLen = 0;
+	m_curSubsys = 0;
+	m_curBase = 0;
+	m_chunkData = NULL;
+	m_chunkOffset = 0;
+	m_chunkLen = 0;
+	m_resuming = false;
+	m_cfgUnchanged = false;
+	m_cfgBooted = false;
+}
 
 GTupdate::~GTupdate() {}
 
@@ -16,6 +30,103 @@ int GTupdate::Initialize(GTmodel *dev, FirmwareImage *image)
 	return -1;
 }
 
+UpdateTask GTupdate::restart_ic()
+{
+	unsigned char buf_restart[] = {0x0E, 0x13, 0x00, 0x00, 0x01, 0x01};
+	int retry = 3;
+
+	gdix_dbg("reset ic\n");
+	do {
+		if (dev->Write(buf_restart, sizeof(buf_restart)) < 0)
+			gdix_dbg("Failed write restart command\n");
+		co_await update_sleep(20000);
+	} while (--retry);
+	co_await update_sleep(300000);
+	co_return 0;
+}
+
+/*
+ * return 1 when the config the IC committed to flash is cfg. The
+ * config RAM can still hold a config a failed run wrote without the IC
+ * taking it, so unless the IC booted since, it is restarted to load the
+ * committed one first. A caller told false writes the config RAM next.
+ */
+UpdateTask GTupdate::cfg_matches(unsigned int addr, const unsigned char *cfg,
+								 unsigned int len)
+{
+	unsigned char *buf;
+	bool match = false;
+
+	if (!m_cfgBooted) {
+		co_await restart_ic();
+		m_cfgBooted = true;
+	}
+	buf = new unsigned char[len];
+	if (dev->Read(addr, buf, len) >= 0)
+		match = !memcmp(buf, cfg, len);
+	delete[] buf;
+	if (!match)
+		m_cfgBooted = false;
+	co_return match;
+}
+
+void GTupdate::Start(void *para)
+{
+	m_para = para;
+	m_flashed = 0;
+	m_task = Flow(para);
+}
+
+int GTupdate::Step(unsigned int *delayUs)
+{
+	int ret;
+
+	if (m_cancel) {
+		gdix_info("Update canceled\n");
+		m_task = UpdateTask();
+		return -ECANCELED;
+	}
+	if (!m_task.IsValid())
+		return Run(m_para);
+	if (!m_task.Resume(delayUs))
+		return UPDATE_STEP_WAIT;
+	ret = m_task.GetResult();
+	m_task = UpdateTask();
+	return ret;
+}
+
+int GTupdate::RunSteps(void *para)
+{
+	unsigned int delayUs = 0;
+	int ret;
+
+	Start(para);
+	while ((ret = Step(&delayUs)) == UPDATE_STEP_WAIT)
+		usleep(delayUs);
+	return ret;
+}
+
+int GTupdate::run_task(UpdateTask task)
+{
+	unsigned int delayUs = 0;
+
+	while (!task.Resume(&delayUs))
+		usleep(delayUs);
+	return task.GetResult();
+}
+
+int GTupdate::Plan()
+{
+	int ret = check_update();
+
+	/* the old check says 0 to update, -2 when the versions match */
+	if (ret == 0)
+		return 1;
+	if (ret == -2 && dev->IsOpened() && image->IsOpened())
+		return 0;
+	return -1;
+}
+
 /* NOTE: deprecated interface */
 int GTupdate::check_update()
 {
@@ -47,4 +158,197 @@ int GTupdate::check_update()
 	} else {
 		return -2;
 	}
-}
\ No newline at end of file
+}
+
+/*
+ * load the image range at offset, fw_data is its data when resident.
+ * Otherwise the range is read and loaded one chunk at a time, so the
+ * image needn't be in memory. m_ackedLen counts the bytes acked over
+ * all the chunks.
+ */
+UpdateTask GTupdate::load_image_range(unsigned int flash_addr,
+									  unsigned int offset,
+									  const unsigned char *fw_data,
+									  unsigned int len)
+{
+	unsigned char window[FW_CHUNK_SIZE];
+	unsigned int done, n;
+	int ret = 0;
+
+	m_ackedLen = 0;
+	for (done = 0; done < len && ret >= 0; done += n) {
+		n = len - done;
+		if (fw_data) {
+			m_chunkData = &fw_data[done];
+		} else {
+			if (n > FW_CHUNK_SIZE)
+				n = FW_CHUNK_SIZE;
+			if (image->ReadData(offset + done, window, n) < 0) {
+				ret = -1;
+				break;
+			}
+			m_chunkData = window;
+		}
+		m_chunkOffset = offset + done;
+		m_chunkLen = n;
+		ret = co_await load_sub_firmware(flash_addr + done, m_chunkData, n);
+	}
+	m_chunkData = NULL;
+	co_return ret;
+}
+
+/*
+ * load sub firmware, when the transfer breaks off continue from the
+ * last chunk acknowledged by the IC as long as it stays in bootloader,
+ * instead of failing the whole update. An update resumed from the
+ * journal starts at the last offset recorded for this subsys.
+ */
+UpdateTask GTupdate::load_sub_firmware_resume(int subsys,
+											  unsigned int flash_addr,
+											  unsigned int offset,
+											  const unsigned char *fw_data,
+											  unsigned int len)
+{
+	unsigned int done = 0;
+	int resume = GDIX_RESUME_TIMES;
+	int ret = 0;
+
+	if (m_resuming) {
+		done = journal->GetOffset(subsys);
+		if (done > len)
+			done = 0;
+		if (done)
+			gdix_info("Resume subsys %d from 0x%x\n", subsys, done);
+	}
+
+	m_curSubsys = subsys;
+	while (done < len) {
+		m_curBase = done;
+		ret = co_await load_image_range(flash_addr + done, offset + done,
+										fw_data ? &fw_data[done] : NULL,
+										len - done);
+		done += m_ackedLen;
+		if (ret >= 0)
+			break;
+
+		gdix_info("Load break off at 0x%x, %u/%u bytes acked\n",
+				  flash_addr + done, done, len);
+		if (co_await check_bootloader() < 0) {
+			gdix_err("Bootloader lost, can't resume\n");
+			co_return ret;
+		}
+		if (!resume--)
+			co_return ret;
+	}
+
+	/* a subsys that failed its last ack or verify isn't done */
+	if (journal && ret >= 0)
+		journal->Done(subsys);
+	co_return ret;
+}
+
+/* called by load_sub_firmware each time the IC acks a chunk */
+void GTupdate::chunk_acked(unsigned int len)
+{
+	m_ackedLen += len;
+	m_flashed += len;
+	if (m_progress)
+		m_progress(m_progressArg, m_flashed);
+	if (journal)
+		journal->Acked(m_curSubsys, m_curBase + m_ackedLen);
+}
+
+/* sums are precomputed by the image parser, data outside its table
+ * (config packs) is summed here
+ */
+uint32_t GTupdate::chunk_checksum(const unsigned char *data, unsigned int len,
+								  int type)
+{
+	uint32_t sum;
+
+	if (image && m_chunkData && data >= m_chunkData &&
+		data < m_chunkData + m_chunkLen &&
+		image->GetChunkSum(m_chunkOffset + (data - m_chunkData), len, type,
+						   &sum))
+		return sum;
+	if (type == CHUNK_SUM_U16_BE)
+		return gdix_sum_u16_be(data, len);
+	return gdix_sum_u16_le(data, len);
+}
+
+/* return true when the journal holds an unfinished update of this image */
+bool GTupdate::journal_resume()
+{
+	m_resuming = false;
+	if (!journal || !journal->Pending())
+		return false;
+
+	if (!journal->Matches(image->GetImageHash())) {
+		gdix_info("Journal is for another image, ignore it\n");
+		return false;
+	}
+
+	gdix_info("Found unfinished update in journal, phase %d\n",
+			  journal->GetPhase());
+	m_resuming = true;
+	return true;
+}
+
+int GTupdate::journal_begin()
+{
+	if (!journal || m_resuming)
+		return 0;
+	return journal->Begin(image->GetImageHash(), sensor_id());
+}
+
+void GTupdate::journal_phase(int phase)
+{
+	if (journal)
+		journal->SetPhase(phase);
+}
+
+void GTupdate::journal_end(int ret)
+{
+	if (journal && ret == 0) {
+		journal->Finish();
+		/* properties may have been read while the IC was in bootloader */
+		dev->SetBasicProperties();
+	}
+	m_resuming = false;
+}
+
+/*
+ * return 1 when the interrupted update can go on without entering
+ * bootloader and erasing again, otherwise 0 and it starts over.
+ */
+UpdateTask GTupdate::resume_in_bootloader()
+{
+	if (!m_resuming)
+		co_return 0;
+
+	if (journal->GetPhase() >= JOURNAL_PHASE_FLASH &&
+		co_await check_bootloader() == 0) {
+		gdix_info("IC is still in bootloader, resume update\n");
+		co_return 1;
+	}
+
+	gdix_info("Can't resume, restart update\n");
+	m_resuming = false;
+	co_return 0;
+}
+
+bool GTupdate::journal_done(int subsys)
+{
+	return m_resuming && journal->IsDone(subsys);
+}
+
+/*
+ * the IC can't report sensor ID in bootloader, use the one of the update
+ * being resumed. A journal of another image says nothing of this one.
+ */
+unsigned char GTupdate::sensor_id()
+{
+	if (m_resuming)
+		return journal->GetSensorID();
+	return dev->GetSensorID();
+}
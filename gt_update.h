@@ -4,9 +4,18 @@
 #include "firmware_image.h"
 #include "gtmodel.h"
 #include "gtp_util.h"
+#include "update_journal.h"
+#include "update_task.h"
+#include <atomic>
 #include <memory.h>
 
 #define FLASH_BUFFER_ADDR 0xc000 // X8=0XDE24
+#define GDIX_RESUME_TIMES 3
+/* returned by Step while the update goes on */
+#define UPDATE_STEP_WAIT 1
+
+/* bytes acked by the IC so far in this update */
+typedef void (*update_progress_func)(void *arg, unsigned int flashed);
 
 class GTupdate
 {
@@ -16,19 +25,97 @@ public:
 
 	virtual int Initialize(GTmodel *dev, FirmwareImage *image);
 	virtual int Run(void *para) { return -1; }
+	void SetJournal(UpdateJournal *journal) { this->journal = journal; }
+	void SetProgress(update_progress_func func, void *arg)
+	{
+		m_progress = func;
+		m_progressArg = arg;
+	}
+	unsigned int GetFlashed() { return m_flashed; }
+	/*
+	 * 1 when the image should be flashed, 0 when the IC already runs
+	 * it, < 0 when it is not meant for the IC
+	 */
+	virtual int Plan();
+	/* a stepped update stops at its next wait, from any thread */
+	void Cancel() { m_cancel = true; }
+
+	/*
+	 * Stepped update, for driving many devices from one thread. Start
+	 * takes the Run parameters, then each Step returns UPDATE_STEP_WAIT
+	 * with the time to wait before the next one, or the result of Run.
+	 * Only BerlinA, BerlinB and GTx3 have a Flow, the other families run
+	 * Run whole in the first step, see family_stepped().
+	 */
+	void Start(void *para);
+	int Step(unsigned int *delayUs);
 
 protected:
+	void *m_para = NULL;
+	UpdateTask m_task;
+	std::atomic<bool> m_cancel{false};
+	update_progress_func m_progress = NULL;
+	void *m_progressArg = NULL;
+	unsigned int m_flashed = 0;
+	/* the update as a coroutine, an empty task if the family has none */
+	virtual UpdateTask Flow(void *para) { return UpdateTask(); }
+	/* Run of a family with a Flow, sleeps between the steps */
+	int RunSteps(void *para);
+	/* a task run to its end by blocking code, sleeps between the steps */
+	int run_task(UpdateTask task);
 	GTmodel *dev = NULL;
 	FirmwareImage *image = NULL;
+	UpdateJournal *journal = NULL;
 	bool m_Initialized;
 	virtual int check_update();
-	virtual int load_sub_firmware(unsigned int flash_addr,
-								  unsigned char *fw_data, unsigned int len)
+	virtual UpdateTask load_sub_firmware(unsigned int flash_addr,
+										 const unsigned char *fw_data,
+										 unsigned int len)
 	{
-		return -1;
+		co_return -1;
 	};
+	/* return 0 when the IC is still in bootloader and can take data */
+	virtual UpdateTask check_bootloader() { co_return -1; }
+	/* load an image range, a chunk at a time when it is not resident */
+	UpdateTask load_image_range(unsigned int flash_addr, unsigned int offset,
+								const unsigned char *fw_data,
+								unsigned int len);
+	UpdateTask load_sub_firmware_resume(int subsys, unsigned int flash_addr,
+										unsigned int offset,
+										const unsigned char *fw_data,
+										unsigned int len);
+	void chunk_acked(unsigned int len);
+	/* checksum of a flash chunk, from the image table when present */
+	uint32_t chunk_checksum(const unsigned char *data, unsigned int len,
+							int type);
+	/* bytes acknowledged by the IC in the last load_sub_firmware call */
+	unsigned int m_ackedLen;
+	int m_curSubsys;
+	unsigned int m_curBase;
+	/* data handed to load_sub_firmware and its image offset */
+	const unsigned char *m_chunkData;
+	unsigned int m_chunkOffset;
+	unsigned int m_chunkLen;
+
+	/* journal helpers, all of them are no-op without a journal */
+	bool m_resuming;
+	bool journal_resume();
+	int journal_begin();
+	void journal_phase(int phase);
+	void journal_end(int ret);
+	UpdateTask resume_in_bootloader();
+	bool journal_done(int subsys);
+	unsigned char sensor_id();
 	virtual int fw_update(unsigned int firmware_flag) { return -1; };
 	virtual int cfg_update() { return -1; }
+	/* 1 when the IC runs cfg, 0 otherwise */
+	UpdateTask cfg_matches(unsigned int addr, const unsigned char *cfg,
+						   unsigned int len);
+	UpdateTask restart_ic();
+	/* set by cfg_update when the IC already runs the image config */
+	bool m_cfgUnchanged;
+	/* the config RAM holds the config the IC booted with */
+	bool m_cfgBooted;
 };
 
 typedef struct {
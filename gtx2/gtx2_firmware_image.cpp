@@ -14,10 +14,11 @@ GTX2FirmwareImage::~GTX2FirmwareImage() {}
 
 int GTX2FirmwareImage::GetFirmwareSubFwNum()
 {
-	if (!m_firmwareData)
-		return 0;
+	unsigned char num;
 
-	return m_firmwareData[GTX2_FW_IMAGE_SUB_FWNUM_OFFSET];
+	if (ReadData(GTX2_FW_IMAGE_SUB_FWNUM_OFFSET, &num, 1) < 0)
+		return 0;
+	return num;
 }
 int GTX2FirmwareImage::GetFirmwareSubFwInfoOffset()
 {
@@ -28,20 +29,36 @@ int GTX2FirmwareImage::GetFirmwareSubFwDataOffset()
 	return GTX2_SUB_FW_DATA_OFFSET;
 }
 
+/* 16 bit length follows the sub firmware type, then the flash page */
+int GTX2FirmwareImage::GetSubFwInfo(unsigned int infoPos,
+									struct image_subsys *subsys)
+{
+	unsigned char info[8];
+
+	if (infoPos + 8 > (unsigned int)m_totalSize ||
+		ReadData(infoPos, info, sizeof(info)) < 0)
+		return -1;
+
+	subsys->type = info[0];
+	subsys->len = (info[1] << 8) | info[2];
+	subsys->flash_addr = ((info[3] << 8) | info[4]) << 8;
+	return 0;
+}
+
 int GTX2FirmwareImage::InitPid()
 {
 	gdix_dbg("GTX2FirmwareImage %s run\n", __func__);
 	int ret = -1;
 	int i = 0;
 	int j = 0;
+	unsigned char pid[GTX2_FW_IMAGE_PID_LEN];
 
-	if (!m_firmwareData) {
+	if (ReadData(GTX2_FW_IMAGE_PID_OFFSET, pid, sizeof(pid)) < 0)
 		goto exit;
-	}
 
 	for (i = 0, j = 0; i < GTX2_FW_IMAGE_PID_LEN; i++)
-		if (m_firmwareData[GTX2_FW_IMAGE_PID_OFFSET + i] != 0)
-			m_pid[j++] = m_firmwareData[GTX2_FW_IMAGE_PID_OFFSET + i];
+		if (pid[i] != 0)
+			m_pid[j++] = pid[i];
 	m_pid[j] = '\0';
 	ret = 0;
 exit:
@@ -53,19 +70,14 @@ int GTX2FirmwareImage::InitVid()
 {
 	gdix_dbg("GTX2FirmwareImage %s run\n", __func__);
 	int ret = -1;
+	unsigned char vid[3];
 
-	if (!m_firmwareData)
+	if (ReadData(GTX2_FW_IMAGE_VID_OFFSET, vid, sizeof(vid)) < 0)
 		goto exit;
 
 	m_firmwareVersionMajor = 0;
-	m_firmwareVersionMinor =
-		((m_firmwareData[GTX2_FW_IMAGE_VID_OFFSET] << 16) |
-		 (m_firmwareData[GTX2_FW_IMAGE_VID_OFFSET + 1] << 8) |
-		 (m_firmwareData[GTX2_FW_IMAGE_VID_OFFSET + 2]));
-	gdix_dbg("vid 0x%02X,0x%02X,0x%02X\n",
-			 m_firmwareData[GTX2_FW_IMAGE_VID_OFFSET],
-			 m_firmwareData[GTX2_FW_IMAGE_VID_OFFSET + 1],
-			 m_firmwareData[GTX2_FW_IMAGE_VID_OFFSET + 2]);
+	m_firmwareVersionMinor = ((vid[0] << 16) | (vid[1] << 8) | (vid[2]));
+	gdix_dbg("vid 0x%02X,0x%02X,0x%02X\n", vid[0], vid[1], vid[2]);
 	ret = 0;
 exit:
 	gdix_dbg("GTX2FirmwareImage %s exit,exit code:%d\n", __func__, ret);
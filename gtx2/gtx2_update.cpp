@@ -66,7 +66,8 @@ int GTx2Update::Run(void *para)
 
 	gdix_dbg("Flag = %d\n", flag);
 
-	if (!parameter->force) {
+	journal_resume();
+	if (!parameter->force && !m_resuming) {
 		ret = check_update();
 		if (ret) {
 			gdix_err("Doesn't meet the update conditions\n");
@@ -74,7 +75,8 @@ int GTx2Update::Run(void *para)
 		}
 	}
 
-	if (flag & NEED_UPDATE_CONFIG) {
+	/* config was written before the interrupted firmware update */
+	if (flag & NEED_UPDATE_CONFIG && !m_resuming) {
 		retry = 0;
 		do {
 			ret = cfg_update();
@@ -82,7 +84,8 @@ int GTx2Update::Run(void *para)
 				gdix_dbg("Update cfg failed\n");
 				usleep(200000);
 			} else {
-				usleep(300000);
+				if (!m_cfgUnchanged)
+					usleep(300000);
 				gdix_dbg("Update cfg success\n");
 				break;
 			}
@@ -106,6 +109,7 @@ int GTx2Update::Run(void *para)
 				break;
 			}
 		} while (retry++ < 3);
+		journal_end(ret);
 		if (ret) {
 			gdix_err("Firmware update err:ret=%d\n", ret);
 			return ret;
@@ -136,12 +140,12 @@ int GTx2Update::Run(void *para)
 	return 0;
 }
 
-int GTx2Update::load_sub_firmware(unsigned int flash_addr,
-								  unsigned char *fw_data, unsigned int len)
+UpdateTask GTx2Update::load_sub_firmware(unsigned int flash_addr,
+										 const unsigned char *fw_data,
+										 unsigned int len)
 {
 	int ret = -1;
 	int retry;
-	unsigned int i;
 	unsigned int unitlen = 0;
 	unsigned char temp_buf[65] = {0};
 	unsigned int load_data_len = 0;
@@ -162,10 +166,8 @@ int GTx2Update::load_sub_firmware(unsigned int flash_addr,
 		}
 
 		/* inform IC to load 4K data to flash */
-		for (check_sum = 0, i = 0; i < unitlen; i += 2) {
-			check_sum += (fw_data[load_data_len + i] << 8) +
-						 fw_data[load_data_len + i + 1];
-		}
+		check_sum = chunk_checksum(&fw_data[load_data_len], unitlen,
+								   CHUNK_SUM_U16_BE);
 		buf_load_flash[5] = (unitlen >> 8) & 0xFF;
 		buf_load_flash[6] = unitlen & 0xFF;
 		buf_load_flash[7] = (flash_addr >> 16) & 0xFF;
@@ -179,7 +181,7 @@ int GTx2Update::load_sub_firmware(unsigned int flash_addr,
 			goto load_fail;
 		}
 
-		usleep(80000);
+		co_await update_sleep(80000);
 		retry = 100;
 		do {
 			memset(temp_buf, 0, sizeof(temp_buf));
@@ -189,7 +191,7 @@ int GTx2Update::load_sub_firmware(unsigned int flash_addr,
 			if (temp_buf[0] == 0xAA)
 				break;
 
-			usleep(2000);
+			co_await update_sleep(2000);
 		} while (--retry);
 
 		if (!retry) {
@@ -201,6 +203,7 @@ int GTx2Update::load_sub_firmware(unsigned int flash_addr,
 			ret = -1;
 		} else {
 			load_data_len += unitlen;
+			chunk_acked(unitlen);
 			flash_addr += unitlen;
 			retry_load = 0;
 			dev->Write(0x5096, &dummy, 1);
@@ -209,7 +212,22 @@ int GTx2Update::load_sub_firmware(unsigned int flash_addr,
 	}
 
 load_fail:
-	return ret;
+	co_return ret;
+}
+
+UpdateTask GTx2Update::check_bootloader()
+{
+	unsigned char state = 0;
+	int retry = GDIX_RETRY_TIMES;
+
+	do {
+		if (dev->Read(BL_STATE_ADDR, &state, 1) >= 0 && state == 0xDD)
+			co_return 0;
+		co_await update_sleep(30000);
+	} while (--retry);
+
+	gdix_err("Reg 0x%x(0x%x) != 0xDD\n", BL_STATE_ADDR, state);
+	co_return -1;
 }
 
 int GTx2Update::fw_update(unsigned int firmware_flag)
@@ -217,19 +235,19 @@ int GTx2Update::fw_update(unsigned int firmware_flag)
 	int retry;
 	int ret, i;
 	unsigned char temp_buf[65];
-	unsigned char *fw_data = NULL;
 	unsigned char buf_switch_to_patch[] = {0x00, 0x10, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_start_update[] = {0x00, 0x11, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_restart[] = {0x0E, 0x13, 0x00, 0x00, 0x01, 0x01};
 
 	int sub_fw_num = 0;
-	unsigned char sub_fw_type;
-	unsigned int sub_fw_len;
-	unsigned int sub_fw_flash_addr;
-	unsigned int sub_fw_info_pos =
-		image->GetFirmwareSubFwInfoOffset(); // SUB_FW_INFO_OFFSET;
-	unsigned int fw_image_offset =
-		image->GetFirmwareSubFwDataOffset(); // SUB_FW_DATA_OFFSET;
+	const struct image_subsys *subsys;
+
+	if (run_task(resume_in_bootloader()))
+		goto load_firmware;
+
+	ret = journal_begin();
+	if (ret < 0)
+		return ret;
 
 	ret = dev->Write(buf_switch_to_patch, sizeof(buf_switch_to_patch));
 	if (ret < 0) {
@@ -267,47 +285,37 @@ int GTx2Update::fw_update(unsigned int firmware_flag)
 	}
 	usleep(100000);
 
+	journal_phase(JOURNAL_PHASE_FLASH);
+
+load_firmware:
 	/* Start load firmware */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
 	}
 
-	sub_fw_num =
-		image->GetFirmwareSubFwNum(); // fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
-	// sub_fw_info_pos = image->GetFirmwareSubFwInfoOffset();//
-	// SUB_FW_INFO_OFFSET; fw_image_offset = image->GetFirmwareSubFwDataOffset()
-	// ; //SUB_FW_DATA_OFFSET;
+	sub_fw_num = image->GetSubsysNum();
 	gdix_dbg("load sub firmware, sub_fw_num=%d\n", sub_fw_num);
 	for (i = 0; i < sub_fw_num; i++) {
-		sub_fw_type = fw_data[sub_fw_info_pos];
-		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", sub_fw_type);
-		/*sub_fw_len = (fw_data[sub_fw_info_pos + 1] << 24) |
-					 (fw_data[sub_fw_info_pos + 2] << 16) |
-					 (fw_data[sub_fw_info_pos + 3] << 8) |
-					 fw_data[sub_fw_info_pos + 4];*/
-		sub_fw_len =
-			(fw_data[sub_fw_info_pos + 1] << 8) | fw_data[sub_fw_info_pos + 2];
-
-		sub_fw_flash_addr =
-			(fw_data[sub_fw_info_pos + 3] << 8) | fw_data[sub_fw_info_pos + 4];
-		sub_fw_flash_addr = sub_fw_flash_addr << 8;
-		if (!(firmware_flag & (0x01 << sub_fw_type))) {
-			gdix_info("Sub firmware type does not math:type=%d\n", sub_fw_type);
-			fw_image_offset += sub_fw_len;
-			sub_fw_info_pos += 8;
+		subsys = image->GetSubsys(i);
+		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", subsys->type);
+		if (!(firmware_flag & (0x01 << subsys->type))) {
+			gdix_info("Sub firmware type does not math:type=%d\n",
+					  subsys->type);
+			continue;
+		}
+		if (journal_done(i)) {
+			gdix_info("Sub firmware %d already flashed\n", i);
 			continue;
 		}
-		ret = load_sub_firmware(sub_fw_flash_addr, &fw_data[fw_image_offset],
-								sub_fw_len);
+		ret = run_task(load_sub_firmware_resume(i, subsys->flash_addr,
+												subsys->offset, subsys->data,
+												subsys->len));
 		if (ret < 0) {
 			gdix_dbg("Failed load sub firmware, ret=%d\n", ret);
 			goto update_err;
 		}
-		fw_image_offset += sub_fw_len;
-		sub_fw_info_pos += 8;
 	}
 	if (sub_fw_num == 0)
 		return -5;
@@ -338,21 +346,17 @@ update_err:
 int GTx2Update::cfg_update()
 {
 	int retry;
-	int ret, i;
+	int ret;
 	unsigned char temp_buf[65];
-	unsigned char *fw_data = NULL;
 	unsigned char cfg_ver_after;
 	unsigned char cfg_ver_before;
 	unsigned char cfg_ver_infile = 0;
 	bool findMatchCfg = false;
-	unsigned char *cfg0x8050 = NULL; // 2 frame of config in memory
-	unsigned char *cfg0xBF7B = NULL;
+	const unsigned char *cfg0x8050 = NULL; // 2 frame of config in memory
+	const unsigned char *cfg0xBF7B = NULL;
 
 	int sub_cfg_num = image->GetConfigSubCfgNum();
-	unsigned char sub_cfg_id;
-	unsigned int sub_cfg_len;
-	unsigned int sub_cfg_info_pos = image->GetConfigSubCfgInfoOffset();
-	unsigned int cfg_offset = image->GetConfigSubCfgDataOffset();
+	const struct image_config *cfg_entry;
 
 	// before update config,read curr config version
 	dev->Read(0x8050, temp_buf, 1);
@@ -360,8 +364,7 @@ int GTx2Update::cfg_update()
 	gdix_dbg("Before update,cfg version is %d\n", cfg_ver_before);
 
 	/* Start load config */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
@@ -369,27 +372,25 @@ int GTx2Update::cfg_update()
 
 	// fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
 	gdix_dbg("load sub config, sub_cfg_num=%d\n", sub_cfg_num);
-	for (i = 0; i < sub_cfg_num; i++) {
-		sub_cfg_id = fw_data[sub_cfg_info_pos];
-		gdix_dbg("load sub config, sub_cfg_id=0x%x\n", sub_cfg_id);
-
-		sub_cfg_len = (fw_data[sub_cfg_info_pos + 1] << 8) |
-					  fw_data[sub_cfg_info_pos + 2];
-
-		if (dev->GetSensorID() == sub_cfg_id) {
-			findMatchCfg = true;
-			cfg0x8050 = &fw_data[cfg_offset];
-			cfg0xBF7B = &cfg0x8050[0x813f - 0x8050];
-			cfg_ver_infile = cfg0x8050[0];
-			gdix_info("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
-					  dev->GetSensorID(), cfg_ver_infile);
-			break;
-		}
-		cfg_offset += sub_cfg_len;
-		sub_cfg_info_pos += 3;
+	cfg_entry = image->FindConfig(sensor_id());
+	if (cfg_entry) {
+		findMatchCfg = true;
+		cfg0x8050 = cfg_entry->data;
+		cfg0xBF7B = &cfg0x8050[0x813f - 0x8050];
+		cfg_ver_infile = cfg0x8050[0];
+		gdix_info("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
+				  sensor_id(), cfg_ver_infile);
 	}
 	if (sub_cfg_num == 0)
 		return -5;
+	m_cfgUnchanged =
+		findMatchCfg &&
+		run_task(cfg_matches(0x8050, cfg0x8050, 0x813F - 0x8050 + 1)) &&
+		run_task(cfg_matches(0xBF7B, cfg0xBF7B, 0xBFFA - 0xBF7B + 1));
+	if (m_cfgUnchanged) {
+		gdix_info("Config in IC is up to date, skip\n");
+		return 0;
+	}
 	if (findMatchCfg) {
 		retry = 3;
 		do {
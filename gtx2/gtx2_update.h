@@ -33,8 +33,10 @@ public:
 	virtual ~GTx2Update();
 
 protected:
-	virtual int load_sub_firmware(unsigned int flash_addr,
-								  unsigned char *fw_data, unsigned int len);
+	virtual UpdateTask load_sub_firmware(unsigned int flash_addr,
+										 const unsigned char *fw_data,
+										 unsigned int len);
+	virtual UpdateTask check_bootloader();
 	virtual int fw_update(unsigned int firmware_flag);
 	virtual int cfg_update();
 };
@@ -21,10 +21,27 @@ int GTX3FirmwareImage::GetFirmwareSubFwDataOffset()
 
 int GTX3FirmwareImage::GetFirmwareSubFwNum()
 {
-	if (!m_firmwareData)
+	unsigned char num;
+
+	if (ReadData(GTX3_FW_IMAGE_SUB_FWNUM_OFFSET, &num, 1) < 0)
 		return 0;
+	return num;
+}
+
+/* gtx3 and later carry a 32 bit length */
+int GTX3FirmwareImage::GetSubFwInfo(unsigned int infoPos,
+									struct image_subsys *subsys)
+{
+	unsigned char info[8];
+
+	if (infoPos + 8 > (unsigned int)m_totalSize ||
+		ReadData(infoPos, info, sizeof(info)) < 0)
+		return -1;
 
-	return m_firmwareData[GTX3_FW_IMAGE_SUB_FWNUM_OFFSET];
+	subsys->type = info[0];
+	subsys->len = (info[1] << 24) | (info[2] << 16) | (info[3] << 8) | info[4];
+	subsys->flash_addr = ((info[5] << 8) | info[6]) << 8;
+	return 0;
 }
 
 int GTX3FirmwareImage::InitPid()
@@ -33,13 +50,13 @@ int GTX3FirmwareImage::InitPid()
 	int ret = -1;
 	int i = 0;
 	int j = 0;
+	unsigned char pid[GTX3_FW_IMAGE_PID_LEN];
 
-	if (!m_firmwareData) {
+	if (ReadData(GTX3_FW_IMAGE_PID_OFFSET, pid, sizeof(pid)) < 0)
 		goto exit;
-	}
 	for (i = 0, j = 0; i < GTX3_FW_IMAGE_PID_LEN; i++)
-		if (m_firmwareData[GTX3_FW_IMAGE_PID_OFFSET + i] != 0)
-			m_pid[j++] = m_firmwareData[GTX3_FW_IMAGE_PID_OFFSET + i];
+		if (pid[i] != 0)
+			m_pid[j++] = pid[i];
 	m_pid[j] = '\0';
 	ret = 0;
 
@@ -52,22 +69,18 @@ int GTX3FirmwareImage::InitVid()
 {
 	gdix_dbg("GTX3FirmwareImage InitVid run\n");
 	int ret = -1;
+	unsigned char vid[4];
 
-	if (!m_firmwareData)
+	if (ReadData(GTX3_FW_IMAGE_CID_OFFSET, vid, sizeof(vid)) < 0)
 		goto exit;
 
-	m_firmwareVersionMajor = m_firmwareData[GTX3_FW_IMAGE_VID_OFFSET];
+	m_firmwareVersionMajor = vid[1];
 	/* |--vid2--|--vid3--|--cfg_id--|
 	 * reserve the last byte for config ID.
 	 */
-	m_firmwareVersionMinor =
-		(m_firmwareData[GTX3_FW_IMAGE_VID_OFFSET + 1] << 16) |
-		(m_firmwareData[GTX3_FW_IMAGE_VID_OFFSET + 2] << 8);
-	gdix_dbg("cid:0x%02x,vid 0x%02X,0x%02X,0x%02X\n",
-			 m_firmwareData[GTX3_FW_IMAGE_CID_OFFSET],
-			 m_firmwareData[GTX3_FW_IMAGE_VID_OFFSET],
-			 m_firmwareData[GTX3_FW_IMAGE_VID_OFFSET + 1],
-			 m_firmwareData[GTX3_FW_IMAGE_VID_OFFSET + 2]);
+	m_firmwareVersionMinor = (vid[2] << 16) | (vid[3] << 8);
+	gdix_dbg("cid:0x%02x,vid 0x%02X,0x%02X,0x%02X\n", vid[0], vid[1], vid[2],
+			 vid[3]);
 	ret = 0;
 exit:
 	gdix_dbg("GTX3FirmwareImage InitVid exit,exit code:%d\n", ret);
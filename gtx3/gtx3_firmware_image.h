@@ -30,6 +30,7 @@ public:
 protected:
 	virtual int InitPid();
 	virtual int InitVid();
+	virtual int GetSubFwInfo(unsigned int infoPos, struct image_subsys *subsys);
 };
 
 #endif
\ No newline at end of file
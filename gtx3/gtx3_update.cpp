@@ -43,7 +43,9 @@ GTx3Update::GTx3Update() { is_cfg_flashed_with_isp = false; }
 
 GTx3Update::~GTx3Update() {}
 
-int GTx3Update::Run(void *para)
+int GTx3Update::Run(void *para) { return RunSteps(para); }
+
+UpdateTask GTx3Update::Flow(void *para)
 {
 	int ret = 0;
 	int retry = 0;
@@ -51,7 +53,7 @@ int GTx3Update::Run(void *para)
 
 	if (!m_Initialized) {
 		gdix_err("Can't Process Update Before Initialized.\n");
-		return -1;
+		co_return -1;
 	}
 	// get all parameter
 	pGTUpdatePara parameter = (pGTUpdatePara)para;
@@ -66,30 +68,33 @@ int GTx3Update::Run(void *para)
 
 	gdix_dbg("fw update flag is 0x%x\n", flag);
 
-	if (!parameter->force) {
+	journal_resume();
+	if (!parameter->force && !m_resuming) {
 		ret = check_update();
 		if (ret) {
 			gdix_err("Doesn't meet the update conditions\n");
-			return -3;
+			co_return -3;
 		}
 	}
 
 	if (flag & NEED_UPDATE_FW) {
 		retry = 0;
 		do {
-			ret = fw_update(parameter->firmwareFlag);
+			ret = co_await fw_update_task(parameter->firmwareFlag);
 			if (ret) {
 				gdix_dbg("Update failed\n");
-				usleep(200000);
+				co_await update_sleep(200000);
 			} else {
-				usleep(300000);
+				co_await update_sleep(300000);
+				m_cfgBooted = true;
 				gdix_dbg("Update success\n");
 				break;
 			}
 		} while (retry++ < 3);
+		journal_end(ret);
 		if (ret) {
 			gdix_err("Firmware update err:ret=%d\n", ret);
-			return ret;
+			co_return ret;
 		}
 	}
 
@@ -100,22 +105,23 @@ int GTx3Update::Run(void *para)
 		gdix_dbg("Update config interactively");
 		retry = 0;
 		do {
-			ret = cfg_update();
+			ret = co_await cfg_update_task();
 			if (ret) {
 				gdix_dbg("Update cfg failed\n");
-				usleep(200000);
+				co_await update_sleep(200000);
 			} else {
-				usleep(300000);
+				if (!m_cfgUnchanged)
+					co_await update_sleep(300000);
 				gdix_dbg("Update cfg success\n");
 				break;
 			}
 		} while (retry++ < 3);
 		if (ret) {
 			gdix_err("config update err:ret=%d\n", ret);
-			return ret;
+			co_return ret;
 		}
 	}
-	return 0;
+	co_return 0;
 }
 
 #define HID_SUBSYSTEM_TYPE_ID (5)
@@ -151,24 +157,24 @@ bool need_upgrade_hid_subsystem(GTmodel *dev, FirmwareImage *fw_img)
 	return false;
 }
 
-int GTx3Update::fw_update(unsigned int firmware_flag)
+UpdateTask GTx3Update::fw_update_task(unsigned int firmware_flag)
 {
 	int retry;
 	int ret, i;
 	unsigned char temp_buf[65];
-	unsigned char *fw_data = NULL;
 	unsigned char buf_switch_to_patch[] = {0x00, 0x10, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_start_update[] = {0x00, 0x11, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_restart[] = {0x0E, 0x13, 0x00, 0x00, 0x01, 0x01};
 
 	int sub_fw_num = 0;
-	unsigned char sub_fw_type;
-	unsigned int sub_fw_len;
-	unsigned int sub_fw_flash_addr;
-	unsigned int sub_fw_info_pos =
-		image->GetFirmwareSubFwInfoOffset(); // SUB_FW_INFO_OFFSET;
-	unsigned int fw_image_offset =
-		image->GetFirmwareSubFwDataOffset(); // SUB_FW_DATA_OFFSET;
+	const struct image_subsys *subsys;
+
+	if (co_await resume_in_bootloader())
+		goto load_firmware;
+
+	ret = journal_begin();
+	if (ret < 0)
+		co_return ret;
 
 	ret = dev->Write(buf_switch_to_patch, sizeof(buf_switch_to_patch));
 	if (ret < 0) {
@@ -176,7 +182,7 @@ int GTx3Update::fw_update(unsigned int firmware_flag)
 		goto update_err;
 	}
 
-	usleep(250000);
+	co_await update_sleep(250000);
 	retry = GDIX_RETRY_TIMES;
 	do {
 		ret = dev->Read(BL_STATE_ADDR, temp_buf, 1);
@@ -189,7 +195,7 @@ int GTx3Update::fw_update(unsigned int firmware_flag)
 			break;
 		gdix_info("0x%x value is 0x%x != 0xDD, retry\n", BL_STATE_ADDR,
 				  temp_buf[0]);
-		usleep(30000);
+		co_await update_sleep(30000);
 	} while (--retry);
 
 	if (!retry) {
@@ -204,24 +210,22 @@ int GTx3Update::fw_update(unsigned int firmware_flag)
 		gdix_err("Failed start update, ret=%d\n", ret);
 		goto update_err;
 	}
-	usleep(100000);
+	co_await update_sleep(100000);
+
+	journal_phase(JOURNAL_PHASE_FLASH);
 
+load_firmware:
 	/* Start load firmware */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
 	}
 
-	sub_fw_num =
-		image->GetFirmwareSubFwNum(); // fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
-	// sub_fw_info_pos = image->GetFirmwareSubFwInfoOffset();//
-	// SUB_FW_INFO_OFFSET; fw_image_offset = image->GetFirmwareSubFwDataOffset()
-	// ; //SUB_FW_DATA_OFFSET;
+	sub_fw_num = image->GetSubsysNum();
 	gdix_dbg("load sub firmware, sub_fw_num=%d\n", sub_fw_num);
 	if (sub_fw_num == 0)
-		return -5;
+		co_return -5;
 
 	/* flash HID subsystem */
 	if (need_upgrade_hid_subsystem(dev, image)) {
@@ -231,45 +235,40 @@ int GTx3Update::fw_update(unsigned int firmware_flag)
 
 	/* load normal firmware package */
 	for (i = 0; i < sub_fw_num; i++) {
-		sub_fw_type = fw_data[sub_fw_info_pos];
-		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", sub_fw_type);
-		sub_fw_len = (fw_data[sub_fw_info_pos + 1] << 24) |
-					 (fw_data[sub_fw_info_pos + 2] << 16) |
-					 (fw_data[sub_fw_info_pos + 3] << 8) |
-					 fw_data[sub_fw_info_pos + 4];
-
-		sub_fw_flash_addr =
-			(fw_data[sub_fw_info_pos + 5] << 8) | fw_data[sub_fw_info_pos + 6];
-		sub_fw_flash_addr = sub_fw_flash_addr << 8;
-		if (!(firmware_flag & (0x01 << sub_fw_type))) {
-			gdix_info("Sub firmware type does not math:type=%d\n", sub_fw_type);
-			fw_image_offset += sub_fw_len;
-			sub_fw_info_pos += 8;
+		subsys = image->GetSubsys(i);
+		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", subsys->type);
+		if (!(firmware_flag & (0x01 << subsys->type))) {
+			gdix_info("Sub firmware type does not math:type=%d\n",
+					  subsys->type);
+			continue;
+		}
+		if (journal_done(i)) {
+			gdix_info("Sub firmware %d already flashed\n", i);
 			continue;
 		}
 
 		/* if sub fw type is HID subsystem we need compare version before update
 		 */
 		// TODO update hid subsystem
-		gdix_dbg("load sub firmware addr:0x%x,len:0x%x\n", sub_fw_flash_addr,
-				 sub_fw_len);
-		ret = load_sub_firmware(sub_fw_flash_addr, &fw_data[fw_image_offset],
-								sub_fw_len);
+		gdix_dbg("load sub firmware addr:0x%x,len:0x%x\n", subsys->flash_addr,
+				 subsys->len);
+		ret = co_await load_sub_firmware_resume(i, subsys->flash_addr,
+												subsys->offset, subsys->data,
+												subsys->len);
 		if (ret < 0) {
 			gdix_dbg("Failed load sub firmware, ret=%d\n", ret);
 			goto update_err;
 		}
-		fw_image_offset += sub_fw_len;
-		sub_fw_info_pos += 8;
 	}
 
 	/* flash config with isp if NEED_UPDATE_CONFIG_WITH_ISP flag is setted or
-	 * hid subsystem updated.
+	 * hid subsystem updated, this saves the separate config session after
+	 * reset. Only the image tells config may go through isp.
 	 */
 	if (image->GetUpdateFlag() & NEED_UPDATE_CONFIG_WITH_ISP ||
 		firmware_flag & (0x1 << HID_SUBSYSTEM_TYPE_ID)) {
 		this->is_cfg_flashed_with_isp = true;
-		ret = flash_cfg_with_isp();
+		ret = co_await flash_cfg_task();
 		if (ret < 0) {
 			gdix_err("failed flash config with isp, ret %d\n", ret);
 			goto update_err;
@@ -283,10 +282,10 @@ int GTx3Update::fw_update(unsigned int firmware_flag)
 		ret = dev->Write(buf_restart, sizeof(buf_restart));
 		if (ret < 0)
 			gdix_dbg("Failed write restart command, ret=%d\n", ret);
-		usleep(20000);
+		co_await update_sleep(20000);
 	} while (--retry);
-	usleep(300000);
-	return 0;
+	co_await update_sleep(300000);
+	co_return 0;
 
 update_err:
 	/* reset IC */
@@ -295,101 +294,90 @@ update_err:
 	do {
 		if (dev->Write(buf_restart, sizeof(buf_restart)) < 0)
 			gdix_dbg("Failed write restart command\n");
-		usleep(20000);
+		co_await update_sleep(20000);
 	} while (--retry);
 
-	usleep(300000);
-	return ret;
+	co_await update_sleep(300000);
+	co_return ret;
 }
 
-int GTx3Update::flash_cfg_with_isp()
+UpdateTask GTx3Update::flash_cfg_task()
 {
-	int ret = -1, i = 0;
+	int ret = -1;
 	updateFlag flag = NO_NEED_UPDATE;
-	unsigned char *fw_data = NULL;
-	unsigned char *cfg = NULL;
-	unsigned char sub_cfg_id;
+	const unsigned char *cfg = NULL;
 	unsigned int sub_cfg_len;
 	unsigned char cfg_ver_infile;
 	int sub_cfg_num = image->GetConfigSubCfgNum();
-	unsigned int sub_cfg_info_pos = image->GetConfigSubCfgInfoOffset();
-	unsigned int cfg_offset = image->GetConfigSubCfgDataOffset();
+	const struct image_config *cfg_entry;
 
 	if (image->HasConfig() == false || sub_cfg_num <= 0) {
 		/* no config found in the bin file */
-		return 0;
+		co_return 0;
 	}
 
 	flag = image->GetUpdateFlag();
 	if (!(flag & NEED_UPDATE_CONFIG)) {
 		/* config update flag not set */
 		gdix_dbg("flag UPDATE_CONFIG unset\n");
-		return 0;
+		co_return 0;
 	}
 
 	/* Start load config */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
-		return -4;
+		co_return -4;
 	}
 
 	// fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
 	gdix_dbg("load sub config, sub_cfg_num=%d\n", sub_cfg_num);
-	for (i = 0; i < sub_cfg_num; i++) {
-		sub_cfg_id = fw_data[sub_cfg_info_pos];
-		gdix_dbg("load sub config, sub_cfg_id=0x%x\n", sub_cfg_id);
-
-		sub_cfg_len = (fw_data[sub_cfg_info_pos + 1] << 8) |
-					  fw_data[sub_cfg_info_pos + 2];
-
-		if (dev->GetSensorID() == sub_cfg_id) {
-			cfg = &fw_data[cfg_offset];
-			cfg_ver_infile = cfg[0];
-			gdix_dbg("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
-					 dev->GetSensorID(), cfg_ver_infile);
-			break;
-		}
-		cfg_offset += sub_cfg_len;
-		sub_cfg_info_pos += 3;
+	cfg_entry = image->FindConfig(sensor_id());
+	if (cfg_entry) {
+		sub_cfg_len = cfg_entry->len;
+		cfg = cfg_entry->data;
+		cfg_ver_infile = cfg[0];
+		gdix_dbg("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
+				 sensor_id(), cfg_ver_infile);
 	}
 
 	if (!cfg) {
 		/* failed found config for sensorID */
 		gdix_dbg("Failed found config for sensorID %d, sub_cfg_num %d\n",
-				 dev->GetSensorID(), sub_cfg_num);
-		return -5;
+				 sensor_id(), sub_cfg_num);
+		co_return -5;
 	}
 
+	if (journal_done(JOURNAL_SUBSYS_CFG))
+		co_return 0;
+
 	gdix_dbg("load cfg addr:0x%x,len:0x%x\n", CFG_FLASH_ADDR, sub_cfg_len);
-	ret = load_sub_firmware(CFG_FLASH_ADDR, cfg, sub_cfg_len);
+	ret = co_await load_sub_firmware_resume(JOURNAL_SUBSYS_CFG,
+											CFG_FLASH_ADDR, cfg_entry->offset,
+											cfg, sub_cfg_len);
 	if (ret < 0) {
 		gdix_err("Failed flash cofig with ISP, ret=%d\n", ret);
-		return ret;
+		co_return ret;
 	}
-	return 0;
+	co_return 0;
 }
 
-int GTx3Update::cfg_update()
+UpdateTask GTx3Update::cfg_update_task()
 {
 	int retry;
-	int ret = -1, i;
+	int ret = -1;
 	unsigned char temp_buf[65];
-	unsigned char *fw_data = NULL;
 	unsigned char cfg_ver_after[3];
 	unsigned char cfg_ver_before[3];
 	unsigned char cfg_ver_infile;
 	bool findMatchCfg = false;
-	unsigned char *cfg = NULL;
+	const unsigned char *cfg = NULL;
 
 	int sub_cfg_num = image->GetConfigSubCfgNum();
-	unsigned char sub_cfg_id;
 	unsigned int sub_cfg_len;
-	unsigned int sub_cfg_info_pos = image->GetConfigSubCfgInfoOffset();
-	unsigned int cfg_offset = image->GetConfigSubCfgDataOffset();
+	const struct image_config *cfg_entry;
 
 	if (sub_cfg_num == 0)
-		return -5;
+		co_return -5;
 
 	// before update config,read curr config version
 	dev->Read(0x8050, cfg_ver_before, 3);
@@ -401,8 +389,7 @@ int GTx3Update::cfg_update()
 		gdix_err("Warning : cfg before cks err!\n");
 
 	/* Start load config */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
@@ -410,23 +397,21 @@ int GTx3Update::cfg_update()
 
 	// fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
 	gdix_dbg("load sub config, sub_cfg_num=%d\n", sub_cfg_num);
-	for (i = 0; i < sub_cfg_num; i++) {
-		sub_cfg_id = fw_data[sub_cfg_info_pos];
-		gdix_dbg("load sub config, sub_cfg_id=0x%x\n", sub_cfg_id);
-
-		sub_cfg_len = (fw_data[sub_cfg_info_pos + 1] << 8) |
-					  fw_data[sub_cfg_info_pos + 2];
-
-		if (dev->GetSensorID() == sub_cfg_id) {
-			findMatchCfg = true;
-			cfg = &fw_data[cfg_offset];
-			cfg_ver_infile = cfg[0];
-			gdix_info("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
-					  dev->GetSensorID(), cfg_ver_infile);
-			break;
-		}
-		cfg_offset += sub_cfg_len;
-		sub_cfg_info_pos += 3;
+	cfg_entry = image->FindConfig(sensor_id());
+	if (cfg_entry) {
+		sub_cfg_len = cfg_entry->len;
+		findMatchCfg = true;
+		cfg = cfg_entry->data;
+		cfg_ver_infile = cfg[0];
+		gdix_info("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
+				  sensor_id(), cfg_ver_infile);
+	}
+
+	m_cfgUnchanged =
+		findMatchCfg && co_await cfg_matches(0x8050, cfg, sub_cfg_len);
+	if (m_cfgUnchanged) {
+		gdix_info("Config in IC is up to date, skip\n");
+		co_return 0;
 	}
 
 	if (findMatchCfg) {
@@ -437,11 +422,11 @@ int GTx3Update::cfg_update()
 		ret = dev->Write(0x8040, temp_buf, 3);
 		if (ret < 0) {
 			gdix_err("Failed write send cfg cmd\n");
-			return ret;
+			co_return ret;
 		}
 
 		// wait ic to comfirm
-		usleep(250000);
+		co_await update_sleep(250000);
 		retry = GDIX_RETRY_TIMES;
 		do {
 			ret = dev->Read(0x8040, temp_buf, 1);
@@ -453,7 +438,7 @@ int GTx3Update::cfg_update()
 				break;
 			gdix_info("0x%x value is 0x%x != 0x82, retry\n", 0x8040,
 					  temp_buf[0]);
-			usleep(30000);
+			co_await update_sleep(30000);
 		} while (--retry);
 
 		if (!retry) {
@@ -464,23 +449,23 @@ int GTx3Update::cfg_update()
 		gdix_dbg("Wait 0x8040 == 0x82 success.\n");
 
 		/* Start load config */
-		ret = dev->Write(0x8050, &fw_data[cfg_offset], sub_cfg_len);
+		ret = dev->Write(0x8050, cfg_entry->data, sub_cfg_len);
 		if (ret < 0) {
 			gdix_err("Failed write cfg to xdata, ret=%d\n", ret);
 			goto update_err;
 		}
-		usleep(100000);
+		co_await update_sleep(100000);
 
 		// tell ic cfg is ready in xdata
 		temp_buf[0] = 0x83;
 		ret = dev->Write(0x8040, temp_buf, 1);
 		if (ret < 0) {
 			gdix_err("Failed write send cfg finish cmd\n");
-			return ret;
+			co_return ret;
 		}
 
 		// check if ic is ok with the cfg
-		usleep(80000);
+		co_await update_sleep(80000);
 		retry = GDIX_RETRY_TIMES;
 		do {
 			ret = dev->Read(0x8040, temp_buf, 1);
@@ -492,7 +477,7 @@ int GTx3Update::cfg_update()
 				break;
 			gdix_info("0x%x value is 0x%x != 0xFF, retry\n", 0x8040,
 					  temp_buf[0]);
-			usleep(30000);
+			co_await update_sleep(30000);
 		} while (--retry);
 
 		if (!retry) {
@@ -510,11 +495,11 @@ int GTx3Update::cfg_update()
 			cfg_ver_after[0] + cfg_ver_after[1] + cfg_ver_after[2];
 		if (cks != 0) {
 			gdix_err("Error : cfg after cks err!\n");
-			return -6;
+			co_return -6;
 		}
 
-		return 0;
+		co_return 0;
 	}
 update_err:
-	return ret;
+	co_return ret;
 }
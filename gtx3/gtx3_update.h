@@ -29,12 +29,13 @@ public:
 	virtual int Run(void *para);
 
 protected:
-	virtual int fw_update(unsigned int firmware_flag);
-	virtual int cfg_update();
-	virtual int flash_cfg_with_isp();
+	UpdateTask Flow(void *para);
 
 private:
 	bool is_cfg_flashed_with_isp;
+	UpdateTask fw_update_task(unsigned int firmware_flag);
+	UpdateTask cfg_update_task();
+	UpdateTask flash_cfg_task();
 };
 
 #endif
\ No newline at end of file
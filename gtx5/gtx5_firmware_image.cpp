@@ -16,10 +16,11 @@ GTX5FirmwareImage::~GTX5FirmwareImage() {}
 
 int GTX5FirmwareImage::GetFirmwareSubFwNum()
 {
-	if (!m_firmwareData)
-		return 0;
+	unsigned char num;
 
-	return m_firmwareData[GTX5_FW_IMAGE_SUB_FWNUM_OFFSET];
+	if (ReadData(GTX5_FW_IMAGE_SUB_FWNUM_OFFSET, &num, 1) < 0)
+		return 0;
+	return num;
 }
 
 int GTX5FirmwareImage::GetFirmwareSubFwInfoOffset()
@@ -32,19 +33,34 @@ int GTX5FirmwareImage::GetFirmwareSubFwDataOffset()
 	return GTX5_SUB_FW_DATA_OFFSET;
 }
 
+int GTX5FirmwareImage::GetSubFwInfo(unsigned int infoPos,
+									struct image_subsys *subsys)
+{
+	unsigned char info[8];
+
+	if (infoPos + 8 > (unsigned int)m_totalSize ||
+		ReadData(infoPos, info, sizeof(info)) < 0)
+		return -1;
+
+	subsys->type = info[0];
+	subsys->len = (info[1] << 8) | info[2];
+	subsys->flash_addr = ((info[3] << 8) | info[4]) << 8;
+	return 0;
+}
+
 int GTX5FirmwareImage::InitPid()
 {
 	gdix_dbg("GTX5FirmwareImage::InitPid run\n");
 	int ret = -1;
 	int i = 0;
 	int j = 0;
+	unsigned char pid[GTX5_FW_IMAGE_PID_LEN];
 
-	if (!m_firmwareData) {
+	if (ReadData(GTX5_FW_IMAGE_PID_OFFSET, pid, sizeof(pid)) < 0)
 		goto exit;
-	}
 	for (i = 0, j = 0; i < GTX5_FW_IMAGE_PID_LEN; i++)
-		if (m_firmwareData[GTX5_FW_IMAGE_PID_OFFSET + i] != 0)
-			m_pid[j++] = m_firmwareData[GTX5_FW_IMAGE_PID_OFFSET + i];
+		if (pid[i] != 0)
+			m_pid[j++] = pid[i];
 	m_pid[j] = '\0';
 	ret = 0;
 
@@ -57,20 +73,15 @@ int GTX5FirmwareImage::InitVid()
 {
 	gdix_dbg("GTX5FirmwareImage InitVid run\n");
 	int ret = -1;
+	unsigned char vid[4];
 
-	if (!m_firmwareData)
+	if (ReadData(GTX5_FW_IMAGE_CID_OFFSET, vid, sizeof(vid)) < 0)
 		goto exit;
 
-	m_firmwareVersionMajor = m_firmwareData[GTX5_FW_IMAGE_CID_OFFSET];
-	m_firmwareVersionMinor =
-		((m_firmwareData[GTX5_FW_IMAGE_VID_OFFSET] << 16) |
-		 (m_firmwareData[GTX5_FW_IMAGE_VID_OFFSET + 1] << 8) |
-		 (m_firmwareData[GTX5_FW_IMAGE_VID_OFFSET + 2]));
-	gdix_dbg("cid:0x%02x,vid 0x%02X,0x%02X,0x%02X\n",
-			 m_firmwareData[GTX5_FW_IMAGE_CID_OFFSET],
-			 m_firmwareData[GTX5_FW_IMAGE_VID_OFFSET],
-			 m_firmwareData[GTX5_FW_IMAGE_VID_OFFSET + 1],
-			 m_firmwareData[GTX5_FW_IMAGE_VID_OFFSET + 2]);
+	m_firmwareVersionMajor = vid[0];
+	m_firmwareVersionMinor = ((vid[1] << 16) | (vid[2] << 8) | (vid[3]));
+	gdix_dbg("cid:0x%02x,vid 0x%02X,0x%02X,0x%02X\n", vid[0], vid[1], vid[2],
+			 vid[3]);
 	ret = 0;
 exit:
 	gdix_dbg("GTX5FirmwareImage InitVid exit,exit code:%d\n", ret);
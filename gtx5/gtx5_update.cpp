@@ -72,12 +72,12 @@ int GTx5Update::Run(void *para)
 	return -4;
 }
 
-int GTx5Update::load_sub_firmware(unsigned int flash_addr,
-								  unsigned char *fw_data, unsigned int len)
+UpdateTask GTx5Update::load_sub_firmware(unsigned int flash_addr,
+										 const unsigned char *fw_data,
+										 unsigned int len)
 {
 	int ret = -1;
 	int retry;
-	unsigned int i;
 	unsigned int unitlen = 0;
 	unsigned char temp_buf[65] = {0};
 	unsigned int load_data_len = 0;
@@ -97,10 +97,8 @@ int GTx5Update::load_sub_firmware(unsigned int flash_addr,
 		}
 
 		/* inform IC to load 4K data to flash */
-		for (check_sum = 0, i = 0; i < unitlen; i += 2) {
-			check_sum += (fw_data[load_data_len + i] << 8) +
-						 fw_data[load_data_len + i + 1];
-		}
+		check_sum = chunk_checksum(&fw_data[load_data_len], unitlen,
+								   CHUNK_SUM_U16_BE);
 		buf_load_flash[5] = (unitlen >> 8) & 0xFF;
 		buf_load_flash[6] = unitlen & 0xFF;
 		buf_load_flash[7] = (flash_addr >> 16) & 0xFF;
@@ -114,7 +112,7 @@ int GTx5Update::load_sub_firmware(unsigned int flash_addr,
 			goto load_fail;
 		}
 
-		usleep(80000);
+		co_await update_sleep(80000);
 		retry = 100;
 		do {
 			memset(temp_buf, 0, sizeof(temp_buf));
@@ -124,7 +122,7 @@ int GTx5Update::load_sub_firmware(unsigned int flash_addr,
 			if (temp_buf[0] == 0xAA)
 				break;
 
-			usleep(2000);
+			co_await update_sleep(2000);
 		} while (--retry);
 
 		if (!retry) {
@@ -136,6 +134,7 @@ int GTx5Update::load_sub_firmware(unsigned int flash_addr,
 			ret = -1;
 		} else {
 			load_data_len += unitlen;
+			chunk_acked(unitlen);
 			flash_addr += unitlen;
 			retry_load = 0;
 			ret = 0;
@@ -143,7 +142,7 @@ int GTx5Update::load_sub_firmware(unsigned int flash_addr,
 	}
 
 load_fail:
-	return ret;
+	co_return ret;
 }
 
 int GTx5Update::fw_update(unsigned int firmware_flag)
@@ -152,19 +151,12 @@ int GTx5Update::fw_update(unsigned int firmware_flag)
 	int ret, i;
 	unsigned char temp_buf[65];
 	bool check_ok = false;
-	unsigned char *fw_data = NULL;
 	unsigned char buf_switch_to_patch[] = {0x00, 0x10, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_start_update[] = {0x00, 0x11, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_restart[] = {0x0E, 0x13, 0x00, 0x00, 0x01, 0x01};
 
 	int sub_fw_num = 0;
-	unsigned char sub_fw_type;
-	unsigned int sub_fw_len;
-	unsigned int sub_fw_flash_addr;
-	unsigned int sub_fw_info_pos =
-		image->GetFirmwareSubFwInfoOffset(); // SUB_FW_INFO_OFFSET;
-	unsigned int fw_image_offset =
-		image->GetFirmwareSubFwDataOffset(); // SUB_FW_DATA_OFFSET;
+	const struct image_subsys *subsys;
 
 	ret = dev->Write(buf_switch_to_patch, sizeof(buf_switch_to_patch));
 	if (ret < 0) {
@@ -235,47 +227,28 @@ int GTx5Update::fw_update(unsigned int firmware_flag)
 	}
 
 	/* Start load firmware */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
 	}
 
-	// sub_fw_num =
-	// image->GetFirmwareSubFwNum();//fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
-	// sub_fw_info_pos = image->GetFirmwareSubFwInfoOffset();//
-	// SUB_FW_INFO_OFFSET; fw_image_offset = image->GetFirmwareSubFwDataOffset()
-	// ; //SUB_FW_DATA_OFFSET;
+	// sub_fw_num = image->GetSubsysNum();
 	gdix_dbg("load sub firmware, sub_fw_num=%d\n", sub_fw_num);
 	for (i = 0; i < sub_fw_num; i++) {
-		sub_fw_type = fw_data[sub_fw_info_pos];
-		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", sub_fw_type);
-		/*sub_fw_len = (fw_data[sub_fw_info_pos + 1] << 24) |
-					 (fw_data[sub_fw_info_pos + 2] << 16) |
-					 (fw_data[sub_fw_info_pos + 3] << 8) |
-					 fw_data[sub_fw_info_pos + 4];*/
-		sub_fw_len =
-			(fw_data[sub_fw_info_pos + 1] << 8) | fw_data[sub_fw_info_pos + 2];
-
-		sub_fw_flash_addr =
-			(fw_data[sub_fw_info_pos + 3] << 8) | fw_data[sub_fw_info_pos + 4];
-		sub_fw_flash_addr = sub_fw_flash_addr << 8;
-		if (!(firmware_flag & (0x01 << sub_fw_type))) {
-			gdix_info("Sub firmware type does not math:type=%d\n", sub_fw_type);
-			fw_image_offset += sub_fw_len;
-			sub_fw_info_pos += 8;
+		subsys = image->GetSubsys(i);
+		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", subsys->type);
+		if (!(firmware_flag & (0x01 << subsys->type))) {
+			gdix_info("Sub firmware type does not math:type=%d\n",
+					  subsys->type);
 			continue;
 		}
-
-		ret = load_sub_firmware(sub_fw_flash_addr, &fw_data[fw_image_offset],
-								sub_fw_len);
+		ret = run_task(load_image_range(subsys->flash_addr, subsys->offset,
+										subsys->data, subsys->len));
 		if (ret < 0) {
 			gdix_dbg("Failed load sub firmware, ret=%d\n", ret);
 			goto update_err;
 		}
-		fw_image_offset += sub_fw_len;
-		sub_fw_info_pos += 8;
 	}
 	if (sub_fw_num == 0)
 		return -5;
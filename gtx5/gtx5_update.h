@@ -32,8 +32,9 @@ public:
 	virtual int Run(void *para);
 
 protected:
-	virtual int load_sub_firmware(unsigned int flash_addr,
-								  unsigned char *fw_data, unsigned int len);
+	virtual UpdateTask load_sub_firmware(unsigned int flash_addr,
+										 const unsigned char *fw_data,
+										 unsigned int len);
 	virtual int fw_update(unsigned int firmware_flag);
 };
 
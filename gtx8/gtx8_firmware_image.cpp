@@ -21,10 +21,11 @@ int GTX8FirmwareImage::GetFirmwareSubFwDataOffset()
 
 int GTX8FirmwareImage::GetFirmwareSubFwNum()
 {
-	if (!m_firmwareData)
-		return 0;
+	unsigned char num;
 
-	return m_firmwareData[GTX8_FW_IMAGE_SUB_FWNUM_OFFSET];
+	if (ReadData(GTX8_FW_IMAGE_SUB_FWNUM_OFFSET, &num, 1) < 0)
+		return 0;
+	return num;
 }
 
 int GTX8FirmwareImage::InitPid()
@@ -33,13 +34,13 @@ int GTX8FirmwareImage::InitPid()
 	int ret = -1;
 	int i = 0;
 	int j = 0;
+	unsigned char pid[GTX8_FW_IMAGE_PID_LEN];
 
-	if (!m_firmwareData) {
+	if (ReadData(GTX8_FW_IMAGE_PID_OFFSET, pid, sizeof(pid)) < 0)
 		goto exit;
-	}
 	for (i = 0, j = 0; i < GTX8_FW_IMAGE_PID_LEN; i++)
-		if (m_firmwareData[GTX8_FW_IMAGE_PID_OFFSET + i] != 0)
-			m_pid[j++] = m_firmwareData[GTX8_FW_IMAGE_PID_OFFSET + i];
+		if (pid[i] != 0)
+			m_pid[j++] = pid[i];
 	m_pid[j] = '\0';
 	ret = 0;
 
@@ -52,22 +53,18 @@ int GTX8FirmwareImage::InitVid()
 {
 	gdix_dbg("GTX8FirmwareImage InitVid run\n");
 	int ret = -1;
+	unsigned char vid[4];
 
-	if (!m_firmwareData)
+	if (ReadData(GTX8_FW_IMAGE_CID_OFFSET, vid, sizeof(vid)) < 0)
 		goto exit;
 
-	m_firmwareVersionMajor = m_firmwareData[GTX8_FW_IMAGE_VID_OFFSET];
+	m_firmwareVersionMajor = vid[1];
 	/* |--vid2--|--vid3--|--cfg_id--|
 	 * reserve the last byte for config ID.
 	 */
-	m_firmwareVersionMinor =
-		(m_firmwareData[GTX8_FW_IMAGE_VID_OFFSET + 1] << 16) |
-		(m_firmwareData[GTX8_FW_IMAGE_VID_OFFSET + 2] << 8);
-	gdix_dbg("cid:0x%02x,vid 0x%02X,0x%02X,0x%02X\n",
-			 m_firmwareData[GTX8_FW_IMAGE_CID_OFFSET],
-			 m_firmwareData[GTX8_FW_IMAGE_VID_OFFSET],
-			 m_firmwareData[GTX8_FW_IMAGE_VID_OFFSET + 1],
-			 m_firmwareData[GTX8_FW_IMAGE_VID_OFFSET + 2]);
+	m_firmwareVersionMinor = (vid[2] << 16) | (vid[3] << 8);
+	gdix_dbg("cid:0x%02x,vid 0x%02X,0x%02X,0x%02X\n", vid[0], vid[1], vid[2],
+			 vid[3]);
 	ret = 0;
 exit:
 	gdix_dbg("GTX8FirmwareImage InitVid exit,exit code:%d\n", ret);
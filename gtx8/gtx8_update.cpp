@@ -68,7 +68,8 @@ int GTx8Update::Run(void *para)
 
 	gdix_dbg("fw update flag is 0x%x\n", flag);
 
-	if (!parameter->force) {
+	journal_resume();
+	if (!parameter->force && !m_resuming) {
 		ret = check_update();
 		if (ret) {
 			gdix_err("Doesn't meet the update conditions\n");
@@ -85,10 +86,12 @@ int GTx8Update::Run(void *para)
 				usleep(200000);
 			} else {
 				usleep(300000);
+				m_cfgBooted = true;
 				gdix_dbg("Update success\n");
 				break;
 			}
 		} while (retry++ < 3);
+		journal_end(ret);
 		if (ret) {
 			gdix_err("Firmware update err:ret=%d\n", ret);
 			return ret;
@@ -107,7 +110,8 @@ int GTx8Update::Run(void *para)
 				gdix_dbg("Update cfg failed\n");
 				usleep(200000);
 			} else {
-				usleep(300000);
+				if (!m_cfgUnchanged)
+					usleep(300000);
 				gdix_dbg("Update cfg success\n");
 				break;
 			}
@@ -162,20 +166,20 @@ int GTx8Update::fw_update(unsigned int firmware_flag)
 	int retry;
 	int ret, i;
 	unsigned char temp_buf[65];
-	unsigned char *fw_data = NULL;
 	unsigned char buf_switch_to_patch[] = {0x00, 0x10, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_start_update[] = {0x00, 0x11, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_restart[] = {0x0E, 0x13, 0x00, 0x00, 0x01, 0x01};
 	unsigned char buf_switch_ptp_mode[] = {0x03, 0x03, 0x00, 0x00, 0x01, 0x01};
 
 	int sub_fw_num = 0;
-	unsigned char sub_fw_type;
-	unsigned int sub_fw_len;
-	unsigned int sub_fw_flash_addr;
-	unsigned int sub_fw_info_pos =
-		image->GetFirmwareSubFwInfoOffset(); // SUB_FW_INFO_OFFSET;
-	unsigned int fw_image_offset =
-		image->GetFirmwareSubFwDataOffset(); // SUB_FW_DATA_OFFSET;
+	const struct image_subsys *subsys;
+
+	if (run_task(resume_in_bootloader()))
+		goto load_firmware;
+
+	ret = journal_begin();
+	if (ret < 0)
+		return ret;
 
 	/* close report */
 	ret = this->DisableReport();
@@ -222,60 +226,52 @@ int GTx8Update::fw_update(unsigned int firmware_flag)
 	}
 	usleep(100000);
 
+	journal_phase(JOURNAL_PHASE_FLASH);
+
+load_firmware:
 	/* Start load firmware */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
 	}
 
-	sub_fw_num =
-		image->GetFirmwareSubFwNum(); // fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
-	sub_fw_info_pos =
-		image->GetFirmwareSubFwInfoOffset(); // SUB_FW_INFO_OFFSET;
-	fw_image_offset =
-		image->GetFirmwareSubFwDataOffset(); // SUB_FW_DATA_OFFSET;
+	sub_fw_num = image->GetSubsysNum();
 	gdix_dbg("load sub firmware, sub_fw_num=%d\n", sub_fw_num);
 	if (sub_fw_num == 0)
 		return -5;
 
 	/* load normal firmware package */
 	for (i = 0; i < sub_fw_num; i++) {
-		sub_fw_type = fw_data[sub_fw_info_pos];
-		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", sub_fw_type);
-		sub_fw_len = (fw_data[sub_fw_info_pos + 1] << 24) |
-					 (fw_data[sub_fw_info_pos + 2] << 16) |
-					 (fw_data[sub_fw_info_pos + 3] << 8) |
-					 fw_data[sub_fw_info_pos + 4];
-
-		sub_fw_flash_addr =
-			(fw_data[sub_fw_info_pos + 5] << 8) | fw_data[sub_fw_info_pos + 6];
-		sub_fw_flash_addr = sub_fw_flash_addr << 8;
-		if (!(firmware_flag & (0x01 << sub_fw_type))) {
-			gdix_info("Sub firmware type does not math:type=%d\n", sub_fw_type);
-			fw_image_offset += sub_fw_len;
-			sub_fw_info_pos += 8;
+		subsys = image->GetSubsys(i);
+		gdix_dbg("load sub firmware, sub_fw_type=0x%x\n", subsys->type);
+		if (!(firmware_flag & (0x01 << subsys->type))) {
+			gdix_info("Sub firmware type does not math:type=%d\n",
+					  subsys->type);
+			continue;
+		}
+		if (journal_done(i)) {
+			gdix_info("Sub firmware %d already flashed\n", i);
 			continue;
 		}
 
 		/* if sub fw type is HID subsystem we need compare version before update
 		 */
 		// TODO update hid subsystem
-		gdix_dbg("load sub firmware addr:0x%x,len:0x%x\n", sub_fw_flash_addr,
-				 sub_fw_len);
-		ret = load_sub_firmware(sub_fw_flash_addr, &fw_data[fw_image_offset],
-								sub_fw_len);
+		gdix_dbg("load sub firmware addr:0x%x,len:0x%x\n", subsys->flash_addr,
+				 subsys->len);
+		ret = run_task(load_sub_firmware_resume(i, subsys->flash_addr,
+												subsys->offset, subsys->data,
+												subsys->len));
 		if (ret < 0) {
 			gdix_dbg("Failed load sub firmware, ret=%d\n", ret);
 			goto update_err;
 		}
-		fw_image_offset += sub_fw_len;
-		sub_fw_info_pos += 8;
 	}
 
-	/* flash config with isp if NEED_UPDATE_CONFIG_WITH_ISP flag is setted or
-	 * hid subsystem updated.
+	/* flash config with isp if NEED_UPDATE_CONFIG_WITH_ISP flag is setted,
+	 * this saves the separate config session after reset. Only the image
+	 * tells config may go through isp.
 	 */
 	if (image->GetUpdateFlag() & NEED_UPDATE_CONFIG_WITH_ISP) {
 		this->is_cfg_flashed_with_isp = true;
@@ -330,16 +326,13 @@ update_err:
 
 int GTx8Update::flash_cfg_with_isp()
 {
-	int ret = -1, i = 0;
+	int ret = -1;
 	updateFlag flag = NO_NEED_UPDATE;
-	unsigned char *fw_data = NULL;
-	unsigned char *cfg = NULL;
-	unsigned char sub_cfg_id;
+	const unsigned char *cfg = NULL;
 	unsigned int sub_cfg_len;
 	unsigned char cfg_ver_infile;
 	int sub_cfg_num = image->GetConfigSubCfgNum();
-	unsigned int sub_cfg_info_pos = image->GetConfigSubCfgInfoOffset();
-	unsigned int cfg_offset = image->GetConfigSubCfgDataOffset();
+	const struct image_config *cfg_entry;
 
 	if (image->HasConfig() == false || sub_cfg_num <= 0) {
 		/* no config found in the bin file */
@@ -354,41 +347,36 @@ int GTx8Update::flash_cfg_with_isp()
 	}
 
 	/* Start load config */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		return -4;
 	}
 
 	// fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
 	gdix_dbg("load sub config, sub_cfg_num=%d\n", sub_cfg_num);
-	for (i = 0; i < sub_cfg_num; i++) {
-		sub_cfg_id = fw_data[sub_cfg_info_pos];
-		gdix_dbg("load sub config, sub_cfg_id=0x%x\n", sub_cfg_id);
-
-		sub_cfg_len = (fw_data[sub_cfg_info_pos + 1] << 8) |
-					  fw_data[sub_cfg_info_pos + 2];
-
-		if (dev->GetSensorID() == sub_cfg_id) {
-			cfg = &fw_data[cfg_offset];
-			cfg_ver_infile = cfg[0];
-			gdix_dbg("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
-					 dev->GetSensorID(), cfg_ver_infile);
-			break;
-		}
-		cfg_offset += sub_cfg_len;
-		sub_cfg_info_pos += 3;
+	cfg_entry = image->FindConfig(sensor_id());
+	if (cfg_entry) {
+		sub_cfg_len = cfg_entry->len;
+		cfg = cfg_entry->data;
+		cfg_ver_infile = cfg[0];
+		gdix_dbg("Find a cfg match sensorID:ID=%d,cfg version=%d\n",
+				 sensor_id(), cfg_ver_infile);
 	}
 
 	if (!cfg) {
 		/* failed found config for sensorID */
 		gdix_dbg("Failed found config for sensorID %d, sub_cfg_num %d\n",
-				 dev->GetSensorID(), sub_cfg_num);
+				 sensor_id(), sub_cfg_num);
 		return -5;
 	}
 
+	if (journal_done(JOURNAL_SUBSYS_CFG))
+		return 0;
+
 	gdix_dbg("load cfg addr:0x%x,len:0x%x\n", CFG_FLASH_ADDR, sub_cfg_len);
-	ret = load_sub_firmware(CFG_FLASH_ADDR, cfg, sub_cfg_len);
+	ret = run_task(load_sub_firmware_resume(JOURNAL_SUBSYS_CFG, CFG_FLASH_ADDR,
+											cfg_entry->offset, cfg,
+											sub_cfg_len));
 	if (ret < 0) {
 		gdix_err("Failed flash cofig with ISP, ret=%d\n", ret);
 		return ret;
@@ -399,20 +387,17 @@ int GTx8Update::flash_cfg_with_isp()
 int GTx8Update::cfg_update()
 {
 	int retry;
-	int ret = -1, i;
+	int ret = -1;
 	unsigned char temp_buf[65];
-	unsigned char *fw_data = NULL;
 	unsigned char cfg_ver_after[3];
 	unsigned char cfg_ver_before[3];
 	unsigned char cfg_ver_infile;
 	bool findMatchCfg = false;
-	unsigned char *cfg = NULL;
+	const unsigned char *cfg = NULL;
 
 	int sub_cfg_num = image->GetConfigSubCfgNum();
-	unsigned char sub_cfg_id;
 	unsigned int sub_cfg_len;
-	unsigned int sub_cfg_info_pos = image->GetConfigSubCfgInfoOffset();
-	unsigned int cfg_offset = image->GetConfigSubCfgDataOffset();
+	const struct image_config *cfg_entry;
 
 	if (sub_cfg_num == 0)
 		return -5;
@@ -423,8 +408,7 @@ int GTx8Update::cfg_update()
 			 cfg_ver_before[0], cfg_ver_before[1], cfg_ver_before[2]);
 
 	/* Start load config */
-	fw_data = image->GetFirmwareData();
-	if (!fw_data) {
+	if (!image->IsOpened()) {
 		gdix_err("No valid fw data \n");
 		ret = -4;
 		goto update_err;
@@ -432,23 +416,21 @@ int GTx8Update::cfg_update()
 
 	// fw_data[FW_IMAGE_SUB_FWNUM_OFFSET];
 	gdix_dbg("load sub config, sub_cfg_num=%d\n", sub_cfg_num);
-	for (i = 0; i < sub_cfg_num; i++) {
-		sub_cfg_id = fw_data[sub_cfg_info_pos];
-		gdix_dbg("load sub config, sub_cfg_id=0x%x\n", sub_cfg_id);
-
-		sub_cfg_len = (fw_data[sub_cfg_info_pos + 1] << 8) |
-					  fw_data[sub_cfg_info_pos + 2];
-
-		if (dev->GetSensorID() == sub_cfg_id) {
-			findMatchCfg = true;
-			cfg = &fw_data[cfg_offset];
-			cfg_ver_infile = cfg[0];
-			gdix_info("Find a cfg match sensorID:ID=%d, cfg version=%d\n",
-					  dev->GetSensorID(), cfg_ver_infile);
-			break;
-		}
-		cfg_offset += sub_cfg_len;
-		sub_cfg_info_pos += 3;
+	cfg_entry = image->FindConfig(sensor_id());
+	if (cfg_entry) {
+		sub_cfg_len = cfg_entry->len;
+		findMatchCfg = true;
+		cfg = cfg_entry->data;
+		cfg_ver_infile = cfg[0];
+		gdix_info("Find a cfg match sensorID:ID=%d, cfg version=%d\n",
+				  sensor_id(), cfg_ver_infile);
+	}
+
+	m_cfgUnchanged = findMatchCfg &&
+					 run_task(cfg_matches(CFG_START_ADDR, cfg, sub_cfg_len));
+	if (m_cfgUnchanged) {
+		gdix_info("Config in IC is up to date, skip\n");
+		return 0;
 	}
 
 	if (findMatchCfg) {
@@ -506,7 +488,7 @@ int GTx8Update::cfg_update()
 		gdix_dbg("Wait CMD_ADDR == 0x82 success.\n");
 
 		/* Start load config */
-		ret = dev->Write(CFG_START_ADDR, &fw_data[cfg_offset], sub_cfg_len);
+		ret = dev->Write(CFG_START_ADDR, cfg_entry->data, sub_cfg_len);
 		if (ret < 0) {
 			gdix_err("Failed write cfg to xdata, ret=%d\n", ret);
 			goto update_err;
@@ -29,6 +29,8 @@ public:
 	virtual int Run(void *para);
 
 protected:
+	/* Run blocks, the GTx3 flow is not this one */
+	UpdateTask Flow(void *para) { return UpdateTask(); }
 	virtual int fw_update(unsigned int firmware_flag);
 	virtual int cfg_update();
 	virtual int flash_cfg_with_isp();
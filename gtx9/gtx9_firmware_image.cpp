@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "../checksum.h"
 #include "../gtp_util.h"
 #include <dirent.h>
 #include <errno.h>
@@ -65,30 +66,30 @@ int GTX9FirmwareImage::Initialize(const char *filename)
 
 int GTX9FirmwareImage::GetDataFromFile(const char *filename)
 {
-	int fw_fd;
-	int ret;
-
-	fw_fd = open(filename, O_RDONLY);
-	if (fw_fd < 0) {
-		gdix_err("file:%s, ret:%d\n", filename, fw_fd);
-		return fw_fd;
-	}
+	unsigned char size_buf[4];
 
-	m_totalSize = lseek(fw_fd, 0, SEEK_END);
-	lseek(fw_fd, 0, SEEK_SET);
-
-	m_firmwareData = new unsigned char[m_totalSize]();
+	Close();
+	m_file = OpenFile(filename);
+	if (!m_file)
+		return -EINVAL;
+	m_firmwareData = m_file->GetData();
+	m_totalSize = m_file->GetSize();
 
-	ret = read(fw_fd, m_firmwareData, m_totalSize);
-	if (ret != m_totalSize) {
-		gdix_err("Failed read file: %s, ret=%d\n", filename, ret);
-		ret = -EINVAL;
-		goto err_out;
+	if (m_totalSize < FW_HEADER_SIZE || ReadData(0, size_buf, 4) < 0) {
+		gdix_err("Invalid firmware file size:%d\n", m_totalSize);
+		Close();
+		return -EINVAL;
 	}
 
-	m_firmwareSize = ((m_firmwareData[3] << 24) | (m_firmwareData[2] << 16) |
-					  (m_firmwareData[1] << 8) | m_firmwareData[0]) +
+	m_firmwareSize = ((size_buf[3] << 24) | (size_buf[2] << 16) |
+					  (size_buf[1] << 8) | size_buf[0]) +
 					 8;
+	if (m_firmwareSize > m_totalSize) {
+		gdix_err("Firmware size:%d exceed file size:%d\n", m_firmwareSize,
+				 m_totalSize);
+		Close();
+		return -EINVAL;
+	}
 
 	if (m_firmwareSize < m_totalSize) {
 		gdix_dbg("Check firmware size:%d < file size:%d\n", m_firmwareSize,
@@ -99,26 +100,28 @@ int GTX9FirmwareImage::GetDataFromFile(const char *filename)
 		hasConfig = true;
 	}
 
-	close(fw_fd);
 	return 0;
-
-err_out:
-	delete[] m_firmwareData;
-	close(fw_fd);
-	return ret;
 }
 
-int GTX9FirmwareImage::ParseFirmware()
+/* validate the whole image and parse its subsystems */
+int GTX9FirmwareImage::CheckFirmware()
 {
 	struct firmware_summary *fw_summary = &m_firmwareSummary;
 	uint32_t checksum = 0;
+	struct image_subsys subsys;
 	uint32_t fw_offset;
 	uint32_t info_offset;
-	uint8_t cfg_ver = 0;
-	uint8_t tmp_buf[9] = {0};
+	uint8_t header[FW_HEADER_SIZE];
+	uint8_t window[FW_STREAM_WINDOW];
+	uint32_t offset, len;
 	int i;
 
-	memcpy(fw_summary, m_firmwareData, sizeof(*fw_summary));
+	/* header and checksum are checked in one pass, the image needn't
+	 * be resident
+	 */
+	if (ReadData(0, header, FW_HEADER_SIZE) < 0)
+		return -EINVAL;
+	memcpy(fw_summary, header, sizeof(*fw_summary));
 
 	/* check firmware size */
 	if (m_firmwareSize != (int)(fw_summary->size + 8)) {
@@ -127,8 +130,14 @@ int GTX9FirmwareImage::ParseFirmware()
 		return -EINVAL;
 	}
 
-	for (i = 8; i < m_firmwareSize; i += 2)
-		checksum += m_firmwareData[i] + (m_firmwareData[i + 1] << 8);
+	for (offset = 8; offset < (uint32_t)m_firmwareSize; offset += len) {
+		len = m_firmwareSize - offset;
+		if (len > FW_STREAM_WINDOW)
+			len = FW_STREAM_WINDOW;
+		if (ReadData(offset, window, len) < 0)
+			return -EINVAL;
+		checksum += gdix_sum_u16_le(window, len);
+	}
 
 	/* byte order change, and check */
 	if (checksum != fw_summary->checksum) {
@@ -146,17 +155,40 @@ int GTX9FirmwareImage::ParseFirmware()
 	fw_offset = FW_HEADER_SIZE;
 	for (i = 0; i < fw_summary->subsys_num; i++) {
 		info_offset = FW_SUBSYS_INFO_OFFSET + i * FW_SUBSYS_INFO_SIZE;
-		fw_summary->subsys[i].type = m_firmwareData[info_offset];
-		fw_summary->subsys[i].size =
-			*(uint32_t *)&m_firmwareData[info_offset + 1];
-		fw_summary->subsys[i].flash_addr =
-			*(uint32_t *)&m_firmwareData[info_offset + 5];
+		memset(&subsys, 0, sizeof(subsys));
+		subsys.type = header[info_offset];
+		subsys.len = *(uint32_t *)&header[info_offset + 1];
+		subsys.flash_addr = *(uint32_t *)&header[info_offset + 5];
+		subsys.offset = fw_offset;
+		subsys.sum_type = CHUNK_SUM_U16_LE;
 		if ((int)fw_offset > m_firmwareSize) {
 			gdix_err("Sybsys offset exceed Firmware size\n");
 			return -EINVAL;
 		}
-		fw_summary->subsys[i].data = m_firmwareData + fw_offset;
-		fw_offset += fw_summary->subsys[i].size;
+		if (AddSubsys(&subsys) < 0)
+			return -EINVAL;
+		fw_offset += subsys.len;
+	}
+
+	if (hasConfig && m_configSize > 0 &&
+		AddConfig(IMAGE_CFG_ANY_SENSOR, m_firmwareSize + 64, m_configSize) < 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+int GTX9FirmwareImage::ParseFirmware()
+{
+	struct firmware_summary *fw_summary = &m_firmwareSummary;
+	uint8_t cfg_ver = 0;
+	uint8_t tmp_buf[9] = {0};
+	int ret;
+
+	if (!LoadIndex(fw_summary, sizeof(*fw_summary))) {
+		ret = CheckFirmware();
+		if (ret < 0)
+			return ret;
+		SaveIndex(fw_summary, sizeof(*fw_summary));
 	}
 
 	memcpy(tmp_buf, fw_summary->fw_pid, 8);
@@ -173,7 +205,8 @@ int GTX9FirmwareImage::ParseFirmware()
 	memcpy(m_firmwareVID, fw_summary->fw_vid, 4);
 
 	if (hasConfig) {
-		cfg_ver = m_firmwareData[m_firmwareSize + 64 + 34];
+		if (ReadData(m_firmwareSize + 64 + 34, &cfg_ver, 1) < 0)
+			return -EINVAL;
 		gdix_info("cfg_ver:%02x\n", cfg_ver);
 	}
 
@@ -183,12 +216,12 @@ int GTX9FirmwareImage::ParseFirmware()
 		(m_firmwareVID[2] << 16) | (m_firmwareVID[3] << 8) | cfg_ver;
 
 #if 0
-	for (i = 0; i < fw_summary->subsys_num; i++) {
+	for (i = 0; i < GetSubsysNum(); i++) {
 		gdix_dbg("------------------------------------------\n");
 		gdix_dbg("Index:%d\n", i);
-		gdix_dbg("Subsystem type:%02X\n", fw_summary->subsys[i].type);
-		gdix_dbg("Subsystem size:%u\n", fw_summary->subsys[i].size);
-		gdix_dbg("Subsystem flash_addr:%08X\n", fw_summary->subsys[i].flash_addr);
+		gdix_dbg("Subsystem type:%02X\n", GetSubsys(i)->type);
+		gdix_dbg("Subsystem size:%u\n", GetSubsys(i)->len);
+		gdix_dbg("Subsystem flash_addr:%08X\n", GetSubsys(i)->flash_addr);
 	}
 #endif
 
@@ -40,13 +40,6 @@
 #define FW_SUBSYS_INFO_OFFSET 42
 #define FW_SUBSYS_MAX_NUM 47
 
-struct fw_subsys_info {
-	unsigned char type;
-	unsigned int size;
-	unsigned int flash_addr;
-	const unsigned char *data;
-};
-
 struct config_info {
 	unsigned char data[2048];
 	unsigned int size;
@@ -66,7 +59,6 @@ struct firmware_summary {
 	unsigned char bus_type;
 	unsigned char flash_protect;
 	unsigned char reserved[8];
-	struct fw_subsys_info subsys[FW_SUBSYS_MAX_NUM];
 };
 #pragma pack()
 
@@ -85,6 +77,7 @@ protected:
 	int GetDataFromFile(const char *filename);
 
 private:
+	int CheckFirmware();
 	int ParseFirmware();
 
 	unsigned char m_firmwarePID[8];
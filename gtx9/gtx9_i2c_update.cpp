@@ -1,4 +1,6 @@
+#include "../checksum.h"
 #include "../gtp_util.h"
+#include "gtx9_firmware_image.h"
 #include <errno.h>
 #include <fcntl.h>	/*O_RDONLY, O_RDWR etc...*/
 #include <libgen.h> /*for readlink()*/
@@ -16,6 +18,7 @@
 #include <unistd.h> /*system calls, read, write, close...*/
 
 #define CLIENT_ADDR 0x5D
+#define ISP_RAM_ADDR 0x57000
 #define TS_ADDR_LENGTH 4
 #define I2C_MAX_TRANSFER_SIZE 256
 #define GOODIX_BUS_RETRY_TIMES 1
@@ -28,13 +31,6 @@ enum CHECKSUM_MODE {
 uint16_t g_client_addr = CLIENT_ADDR;
 int g_fd;
 
-struct fw_subsys_info {
-	uint8_t type;
-	uint32_t size;
-	uint32_t flash_addr;
-	uint8_t *data;
-};
-
 #pragma pack(1)
 struct goodix_fw_version {
 	uint8_t rom_pid[6]; /* rom PID */
@@ -47,39 +43,8 @@ struct goodix_fw_version {
 	uint8_t reserved[2];
 	uint16_t checksum;
 };
-
-struct firmware_summary {
-	int size;
-	uint32_t checksum;
-	uint8_t hw_pid[6];
-	uint8_t hw_vid[3];
-	uint8_t fw_pid[8];
-	uint8_t fw_vid[4];
-	uint8_t subsys_num;
-	uint8_t chip_type;
-	uint8_t protocol_ver;
-	uint8_t bus_type;
-	uint8_t flash_protect;
-	// uint8_t reserved[8];
-	struct fw_subsys_info subsys[47];
-};
 #pragma pack()
 
-struct firmware {
-	int size;
-	uint8_t data[256 * 1024];
-} g_firmware;
-
-struct goodix_ic_config {
-	int len;
-	uint8_t data[4096];
-} g_config;
-
-struct firmware_data {
-	struct firmware_summary fw_summary;
-	struct firmware *firmware;
-};
-
 #pragma pack(1)
 struct goodix_flash_cmd {
 	union {
@@ -98,9 +63,9 @@ struct goodix_flash_cmd {
 };
 #pragma pack()
 
+/* subsystems and config point into the one mapping of the file */
 struct fw_update_ctrl {
-	struct firmware_data fw_data;
-	struct goodix_ic_config *ic_config;
+	GTX9FirmwareImage *image;
 };
 static struct fw_update_ctrl goodix_fw_update_ctrl;
 
@@ -108,13 +73,11 @@ int checksum_cmp(const uint8_t *data, int size, int mode)
 {
 	uint32_t cal_checksum = 0;
 	uint32_t r_checksum = 0;
-	int i;
 
 	if (mode == CHECKSUM_MODE_U8_LE) {
 		if (size < 2)
 			return 1;
-		for (i = 0; i < size - 2; i++)
-			cal_checksum += data[i];
+		cal_checksum = gdix_sum_u8(data, size - 2);
 
 		r_checksum = data[size - 2] + (data[size - 1] << 8);
 		return (cal_checksum & 0xFFFF) == r_checksum ? 0 : 1;
@@ -122,8 +85,7 @@ int checksum_cmp(const uint8_t *data, int size, int mode)
 
 	if (size < 4)
 		return 1;
-	for (i = 0; i < size - 4; i += 2)
-		cal_checksum += data[i] + (data[i + 1] << 8);
+	cal_checksum = gdix_sum_u16_le(data, size - 4);
 	r_checksum = data[size - 4] + (data[size - 3] << 8) +
 				 (data[size - 2] << 16) + (data[size - 1] << 24);
 	return cal_checksum == r_checksum ? 0 : 1;
@@ -131,17 +93,12 @@ int checksum_cmp(const uint8_t *data, int size, int mode)
 
 uint32_t gdix_append_checksum(uint8_t *data, int len, int mode)
 {
-	uint32_t checksum = 0;
-	int i;
+	uint32_t checksum;
 
-	checksum = 0;
-	if (mode == CHECKSUM_MODE_U8_LE) {
-		for (i = 0; i < len; i++)
-			checksum += data[i];
-	} else {
-		for (i = 0; i < len; i += 2)
-			checksum += (data[i] + (data[i + 1] << 8));
-	}
+	if (mode == CHECKSUM_MODE_U8_LE)
+		checksum = gdix_sum_u8(data, len);
+	else
+		checksum = gdix_sum_u16_le(data, len);
 
 	if (mode == CHECKSUM_MODE_U8_LE) {
 		data[len] = checksum & 0xff;
@@ -221,7 +178,7 @@ read_exit:
 	return r < 0 ? r : 0;
 }
 
-static int i2c_write(uint32_t reg, unsigned char *data, int len)
+static int i2c_write(uint32_t reg, const unsigned char *data, int len)
 {
 	struct i2c_rdwr_ioctl_data packets;
 	int pos = 0, transfer_length = 0;
@@ -306,144 +263,27 @@ static int switch_i2c_mode(void)
 	return -1;
 }
 
-static int gdix_read_firmware(const char *filename)
+static int gdix_read_firmware(struct fw_update_ctrl *fwu_ctrl,
+							  const char *filename)
 {
-	int ret;
-	int fw_fd;
-	int totalSize;
-	int fwSize;
-	int cfgSize;
-	uint8_t *firmwareData;
-
-	fw_fd = open(filename, O_RDONLY);
-	if (fw_fd < 0) {
-		gdix_err("file:%s, ret:%d\n", filename, fw_fd);
-		return fw_fd;
-	}
-
-	totalSize = lseek(fw_fd, 0, SEEK_END);
-	lseek(fw_fd, 0, SEEK_SET);
-
-	firmwareData = new unsigned char[totalSize]();
-	ret = read(fw_fd, firmwareData, totalSize);
-	if (ret != totalSize) {
-		gdix_err("Failed read file: %s, ret=%d\n", filename, ret);
-		ret = -1;
-		goto err_out;
-	}
+	GTX9FirmwareImage *image;
 
-	fwSize = ((firmwareData[3] << 24) | (firmwareData[2] << 16) |
-			  (firmwareData[1] << 8) | firmwareData[0]) +
-			 8;
-
-	g_firmware.size = fwSize;
-	memcpy(g_firmware.data, firmwareData, fwSize);
-	goodix_fw_update_ctrl.fw_data.firmware = &g_firmware;
+	image = new GTX9FirmwareImage;
+	if (image->Initialize(filename) < 0) {
+		delete image;
+		return -1;
+	}
 
-	if (fwSize < totalSize) {
-		gdix_dbg("Check firmware size:%d < file size:%d\n", fwSize, totalSize);
-		gdix_dbg("This bin file may contain a config bin.\n");
-		cfgSize = totalSize - fwSize - 64;
-		gdix_dbg("config size:%d\n", cfgSize);
-		g_config.len = cfgSize;
-		memcpy(g_config.data, firmwareData + fwSize + 64, cfgSize);
-		goodix_fw_update_ctrl.ic_config = &g_config;
+	/* subsystem 0 is the ISP program, it's written out in one go */
+	if (image->GetSubsysNum() < 1) {
+		gdix_err("Bad firmware, no ISP program\n");
+		delete image;
+		return -1;
 	}
 
+	fwu_ctrl->image = image;
 	gdix_dbg("read firmware success\n");
-	close(fw_fd);
 	return 0;
-err_out:
-	delete[] firmwareData;
-	close(fw_fd);
-	return ret;
-}
-
-static int gdix_parse_firmware(struct firmware_data *fw_data)
-{
-	struct firmware *firmware;
-	struct firmware_summary *fw_summary;
-	int i, fw_offset, info_offset;
-	int r = 0;
-	uint32_t checksum;
-
-	fw_summary = &fw_data->fw_summary;
-
-	/* copy firmware head info */
-	firmware = fw_data->firmware;
-	if (firmware->size < 42) {
-		gdix_err("Invalid firmware size:%d\n", firmware->size);
-		r = -EINVAL;
-		goto err_size;
-	}
-	memcpy(fw_summary, firmware->data, sizeof(*fw_summary));
-
-	/* check firmware size */
-	if (firmware->size != fw_summary->size + 8) {
-		gdix_err("Bad firmware, size not match, %d != %d\n", firmware->size,
-				 fw_summary->size + 8);
-		r = -EINVAL;
-		goto err_size;
-	}
-
-	for (i = 8, checksum = 0; i < firmware->size; i += 2)
-		checksum += firmware->data[i] + (firmware->data[i + 1] << 8);
-
-	/* byte order change, and check */
-	if (checksum != fw_summary->checksum) {
-		gdix_err("Bad firmware, cheksum error\n");
-		r = -EINVAL;
-		goto err_size;
-	}
-
-	if (fw_summary->subsys_num > 47) {
-		gdix_err("Bad firmware, invalid subsys num: %d\n",
-				 fw_summary->subsys_num);
-		r = -EINVAL;
-		goto err_size;
-	}
-
-	/* parse subsystem info */
-	fw_offset = 512;
-	for (i = 0; i < fw_summary->subsys_num; i++) {
-		info_offset = 42 + i * 10;
-		fw_summary->subsys[i].type = firmware->data[info_offset];
-		fw_summary->subsys[i].size =
-			*(uint32_t *)&firmware->data[info_offset + 1];
-		fw_summary->subsys[i].flash_addr =
-			*(uint32_t *)&firmware->data[info_offset + 5];
-		if (fw_offset > firmware->size) {
-			gdix_err("Sybsys offset exceed Firmware size\n");
-			r = -EINVAL;
-			goto err_size;
-		}
-
-		fw_summary->subsys[i].data = firmware->data + fw_offset;
-		fw_offset += fw_summary->subsys[i].size;
-	}
-
-	gdix_dbg("Firmware package protocol: V%u\n", fw_summary->protocol_ver);
-	gdix_dbg("Firmware PID:GT%s\n", fw_summary->fw_pid);
-	gdix_dbg("Firmware VID:%*ph\n", 4, fw_summary->fw_vid);
-	gdix_dbg("Firmware chip type:0x%02X\n", fw_summary->chip_type);
-	gdix_dbg("Firmware bus type:%s\n",
-			 (fw_summary->bus_type & 1) ? "SPI" : "I2C");
-	gdix_dbg("Firmware size:%u\n", fw_summary->size);
-	gdix_dbg("Firmware subsystem num:%u\n", fw_summary->subsys_num);
-
-	/*
-			for (i = 0; i < fw_summary->subsys_num; i++) {
-					gdix_dbg("------------------------------------------\n");
-					gdix_dbg("Index:%d\n", i);
-					gdix_dbg("Subsystem type:%02X\n",
-	   fw_summary->subsys[i].type); gdix_dbg("Subsystem size:%u\n",
-	   fw_summary->subsys[i].size); gdix_dbg("Subsystem flash_addr:%08X\n",
-									fw_summary->subsys[i].flash_addr);
-			}
-	*/
-
-err_size:
-	return r;
 }
 
 static int gdix_read_version(struct goodix_fw_version *version)
@@ -474,17 +314,33 @@ static int gdix_read_version(struct goodix_fw_version *version)
 	return 0;
 }
 
-static int gdix_load_isp(struct firmware_data *fw_data)
+static int gdix_load_isp(FirmwareImage *image)
 {
 	struct goodix_fw_version isp_fw_version;
-	struct fw_subsys_info *fw_isp;
+	const struct image_subsys *fw_isp;
 	uint8_t reg_val[8] = {0x00};
+	uint8_t *isp_buf = NULL;
 	int r;
 
-	fw_isp = &fw_data->fw_summary.subsys[0];
+	fw_isp = image->GetSubsys(0);
+
+	/* an image that is not resident has the ISP read in for the write */
+	if (!fw_isp->data) {
+		isp_buf = (uint8_t *)malloc(fw_isp->len);
+		if (!isp_buf) {
+			gdix_err("Failed alloc memory\n");
+			return -1;
+		}
+		if (image->ReadData(fw_isp->offset, isp_buf, fw_isp->len) < 0) {
+			free(isp_buf);
+			return -1;
+		}
+	}
 
 	gdix_dbg("Loading ISP start\n");
-	r = i2c_write(0x57000, fw_isp->data, fw_isp->size);
+	r = i2c_write(ISP_RAM_ADDR, isp_buf ? isp_buf : fw_isp->data,
+				  fw_isp->len);
+	free(isp_buf);
 	if (r < 0) {
 		gdix_err("Loading ISP error\n");
 		return r;
@@ -517,13 +373,60 @@ static int gdix_load_isp(struct firmware_data *fw_data)
 	return 0;
 }
 
-static int gdix_update_prepare(struct fw_update_ctrl *fwu_ctrl)
+/*
+ * check whether the ISP left running by a previous attempt is the
+ * one in the firmware file, the whole ISP RAM is read back and
+ * compared. That still saves the reset, the CPU hold and the reboot
+ * into ISP of a full reload.
+ * return true when the running ISP can be used directly
+ */
+static bool gdix_isp_reusable(FirmwareImage *image,
+							  struct goodix_fw_version *version)
+{
+	const struct image_subsys *fw_isp;
+	uint8_t *ram_buf = NULL;
+	uint8_t *file_buf = NULL;
+	bool same = false;
+
+	if (memcmp(&version->patch_pid[3], "ISP", 3))
+		return false;
+
+	fw_isp = image->GetSubsys(0);
+	ram_buf = (uint8_t *)malloc(fw_isp->len);
+	if (!fw_isp->data)
+		file_buf = (uint8_t *)malloc(fw_isp->len);
+	if (!ram_buf || (!fw_isp->data && !file_buf))
+		goto out;
+	if (file_buf &&
+		image->ReadData(fw_isp->offset, file_buf, fw_isp->len) < 0)
+		goto out;
+	if (i2c_read(ISP_RAM_ADDR, ram_buf, fw_isp->len) < 0)
+		goto out;
+
+	same = !memcmp(ram_buf, file_buf ? file_buf : fw_isp->data,
+				   fw_isp->len);
+	if (!same)
+		gdix_dbg("running ISP differs from file\n");
+out:
+	free(ram_buf);
+	free(file_buf);
+	return same;
+}
+
+static int gdix_update_prepare(struct fw_update_ctrl *fwu_ctrl,
+							   struct goodix_fw_version *cur_ver)
 {
 	uint8_t reg_val[4] = {0};
 	uint8_t temp_buf[64] = {0};
 	int retry = 20;
 	int r;
 
+	/* ISP still running from a previous attempt, skip reloading it */
+	if (cur_ver && gdix_isp_reusable(fwu_ctrl->image, cur_ver)) {
+		gdix_dbg("ISP already running, skip ISP loading\n");
+		return 0;
+	}
+
 	/* reset IC */
 	gdix_dbg("firmware update, reset\n");
 	gdix_soft_reset(5);
@@ -562,7 +465,7 @@ static int gdix_update_prepare(struct fw_update_ctrl *fwu_ctrl)
 	gdix_dbg("disable watch dog\n");
 
 	/* load ISP code and run form isp */
-	r = gdix_load_isp(&fwu_ctrl->fw_data);
+	r = gdix_load_isp(fwu_ctrl->image);
 	if (r < 0)
 		gdix_err("Failed load and run isp\n");
 
@@ -688,9 +591,16 @@ static int gdix_flash_package(uint8_t subsys_type, uint8_t *pkg,
 }
 
 #define ISP_MAX_BUFFERSIZE 4096
-static int gdix_flash_subsystem(struct fw_subsys_info *subsys)
+/*
+ * Flash flash_len bytes of subsys, the part past the end of its data is
+ * sent as zeros. Each package is read from the image straight into the
+ * packet buffer.
+ */
+static int gdix_flash_subsystem(FirmwareImage *image,
+								const struct image_subsys *subsys,
+								uint32_t flash_len)
 {
-	uint32_t data_size, offset;
+	uint32_t data_size, read_size, offset;
 	uint32_t total_size;
 	// TODO: confirm flash addr ,<< 8??
 	uint32_t subsys_base_addr = subsys->flash_addr;
@@ -702,7 +612,7 @@ static int gdix_flash_subsystem(struct fw_subsys_info *subsys)
 	 * hardware reset and re-prepare ISP and then retry
 	 * flashing
 	 */
-	total_size = subsys->size;
+	total_size = flash_len;
 	fw_packet = (uint8_t *)malloc(ISP_MAX_BUFFERSIZE + 4);
 	if (!fw_packet) {
 		gdix_dbg("Failed alloc memory\n");
@@ -716,7 +626,15 @@ static int gdix_flash_subsystem(struct fw_subsys_info *subsys)
 		gdix_dbg("Flash firmware to %08x,size:%u bytes\n",
 				 subsys_base_addr + offset, data_size);
 
-		memcpy(fw_packet, &subsys->data[offset], data_size);
+		read_size = offset < subsys->len ? subsys->len - offset : 0;
+		if (read_size > data_size)
+			read_size = data_size;
+		if (read_size && image->ReadData(subsys->offset + offset, fw_packet,
+										 read_size) < 0) {
+			r = -1;
+			break;
+		}
+		memset(fw_packet + read_size, 0, data_size - read_size);
 		/* set checksum for package data */
 		gdix_append_checksum(fw_packet, data_size, CHECKSUM_MODE_U16_LE);
 
@@ -738,28 +656,34 @@ static int gdix_flash_subsystem(struct fw_subsys_info *subsys)
 #define CFG_MAX_SIZE 4096
 static int gdix_flash_firmware(struct fw_update_ctrl *fw_ctrl)
 {
-	struct firmware_data *fw_data = &fw_ctrl->fw_data;
-	struct firmware_summary *fw_summary;
-	struct fw_subsys_info *fw_x;
-	struct fw_subsys_info subsys_cfg = {0};
+	FirmwareImage *image = fw_ctrl->image;
+	const struct image_config *cfg_entry;
+	const struct image_subsys *subsys;
+	struct image_subsys subsys_cfg = {0};
 	int retry = 3;
 	int i, r = 0, fw_num;
-	uint8_t temp_buf[CFG_MAX_SIZE] = {0};
 
 	/*	start from subsystem 1,
 	 *	subsystem 0 is the ISP program
 	 */
-	fw_summary = &fw_data->fw_summary;
-	fw_num = fw_summary->subsys_num;
-
-	/* flash config data first if we have */
-	if (fw_ctrl->ic_config && fw_ctrl->ic_config->len) {
-		memcpy(temp_buf, fw_ctrl->ic_config->data, fw_ctrl->ic_config->len);
-		subsys_cfg.data = temp_buf;
-		subsys_cfg.size = CFG_MAX_SIZE;
+	fw_num = image->GetSubsysNum();
+
+	/*
+	 * flash config data first if we have, padded to CFG_MAX_SIZE, the
+	 * sensor isn't known here but a BerlinB config is for any sensor
+	 */
+	cfg_entry = image->FindConfig(0);
+	if (cfg_entry && cfg_entry->len) {
+		if (cfg_entry->len > CFG_MAX_SIZE) {
+			gdix_err("Config size %u exceed %d\n", cfg_entry->len,
+					 CFG_MAX_SIZE);
+			return -EINVAL;
+		}
+		subsys_cfg.offset = cfg_entry->offset;
+		subsys_cfg.len = cfg_entry->len;
 		subsys_cfg.flash_addr = 0x40000;
 		subsys_cfg.type = 4;
-		r = gdix_flash_subsystem(&subsys_cfg);
+		r = gdix_flash_subsystem(image, &subsys_cfg, CFG_MAX_SIZE);
 		if (r) {
 			gdix_err("failed flash config with ISP, %d\n", r);
 			return r;
@@ -769,8 +693,8 @@ static int gdix_flash_firmware(struct fw_update_ctrl *fw_ctrl)
 
 	for (i = 1; i < fw_num && retry;) {
 		gdix_dbg("--- Start to flash subsystem[%d] ---\n", i);
-		fw_x = &fw_summary->subsys[i];
-		r = gdix_flash_subsystem(fw_x);
+		subsys = image->GetSubsys(i);
+		r = gdix_flash_subsystem(image, subsys, subsys->len);
 		if (r == 0) {
 			gdix_dbg("--- End flash subsystem[%d]: OK ---\n", i);
 			i++;
@@ -830,18 +754,14 @@ static int gdix_fw_update_proc(struct fw_update_ctrl *fwu_ctrl)
 {
 	int ret;
 	struct goodix_fw_version fw_ver;
+	bool ver_valid;
 
 	ret = gdix_read_version(&fw_ver);
+	ver_valid = ret == 0;
 	if (ret < 0)
 		gdix_err("read current fw_version failed\n");
 
-	ret = gdix_parse_firmware(&fwu_ctrl->fw_data);
-	if (ret < 0) {
-		gdix_err("failed to parse firmware\n");
-		return ret;
-	}
-
-	ret = gdix_update_prepare(fwu_ctrl);
+	ret = gdix_update_prepare(fwu_ctrl, ver_valid ? &fw_ver : NULL);
 	if (ret < 0) {
 		gdix_err("failed prepare ISP\n");
 		goto err_fw_prepare;
@@ -887,16 +807,18 @@ int gdix_do_fw_update(const char *devname, const char *filename,
 	if (ret < 0)
 		goto err_out;
 
-	ret = gdix_read_firmware(filename);
+	ret = gdix_read_firmware(&goodix_fw_update_ctrl, filename);
 	if (ret < 0) {
 		gdix_err("failed to read %s\n", filename);
 		goto err_out;
 	}
 
-	gdix_fw_update_proc(&goodix_fw_update_ctrl);
+	ret = gdix_fw_update_proc(&goodix_fw_update_ctrl);
+	delete goodix_fw_update_ctrl.image;
+	goodix_fw_update_ctrl.image = NULL;
 
 err_out:
 	close(g_fd);
 	g_fd = 0;
-	return 0;
+	return ret;
 }
\ No newline at end of file
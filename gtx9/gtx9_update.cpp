@@ -31,50 +31,63 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "../checksum.h"
 #include "../gtp_util.h"
 #include "gtx9.h"
 #include "gtx9_update.h"
 
-int GTx9Update::Run(void *para)
+int GTx9Update::Run(void *para) { return RunSteps(para); }
+
+UpdateTask GTx9Update::Flow(void *para)
 {
 	int ret;
 
 	if (!m_Initialized) {
 		gdix_err("Can't Process Update Before Initialized.\n");
-		return -EINVAL;
+		co_return -EINVAL;
 	}
 	// get all parameter
 	pGTUpdatePara parameter = (pGTUpdatePara)para;
 
-	if (!parameter->force) {
+	journal_resume();
+	if (!parameter->force && !m_resuming) {
 		ret = check_update();
 		if (ret < 0) {
 			gdix_info("Upgrades are not allowed\n");
-			return ret;
+			co_return ret;
 		} else if (ret == 0) {
 			gdix_info("Skip upgrade\n");
-			return 0;
+			co_return 0;
 		}
 		gdix_info("Ready to upgrade\n");
 	} else {
 		gdix_info("Force to upgrade\n");
 	}
 
-	ret = prepareUpdate();
-	if (ret < 0) {
-		gdix_err("Failed prepare update\n");
-		return ret;
+	/* flash is already erased when resuming in mini system */
+	if (!(co_await resume_in_bootloader())) {
+		ret = journal_begin();
+		if (ret < 0)
+			co_return ret;
+
+		ret = co_await prepareUpdate();
+		if (ret < 0) {
+			gdix_err("Failed prepare update\n");
+			co_return ret;
+		}
+		journal_phase(JOURNAL_PHASE_FLASH);
 	}
 
-	ret = fw_update(parameter->firmwareFlag);
+	ret = co_await flashFirmware(parameter->firmwareFlag);
+	journal_end(ret);
 	if (ret < 0) {
 		gdix_err("Failed update\n");
-		return ret;
+		co_return ret;
 	}
 
 	gdix_info("Success update\n");
 
-	return 0;
+	co_return 0;
 }
 
 int GTx9Update::check_update()
@@ -101,7 +114,22 @@ int GTx9Update::check_update()
 	return 0;
 }
 
-int GTx9Update::prepareUpdate()
+/* return 0 when the IC is still in mini system */
+UpdateTask GTx9Update::check_bootloader()
+{
+	uint8_t flag = 0;
+	int retry = 3;
+
+	while (retry--) {
+		if (dev->Read(0x10010, &flag, 1) == 1 && flag == 0xDD)
+			co_return 0;
+		co_await update_sleep(20000);
+	}
+	gdix_err("IC not in mini system, flag=0x%02x\n", flag);
+	co_return -1;
+}
+
+UpdateTask GTx9Update::prepareUpdate()
 {
 	uint8_t tempBuf[5] = {0};
 	uint8_t recvBuf[5] = {0};
@@ -115,10 +143,10 @@ int GTx9Update::prepareUpdate()
 	ret = dev->SendCmd(0x10, tempBuf, 1);
 	if (ret < 0) {
 		gdix_err("Failed send minisystem cmd\n");
-		return ret;
+		co_return ret;
 	}
 	while (retry--) {
-		usleep(200000);
+		co_await update_sleep(200000);
 		ret = dev->Read(0x10010, tempBuf, 1);
 		if (ret == 1 && tempBuf[0] == 0xDD)
 			break;
@@ -126,7 +154,7 @@ int GTx9Update::prepareUpdate()
 	if (retry < 0) {
 		gdix_err("Failed switch minisystem ret=%d flag=0x%02x\n", ret,
 				 tempBuf[0]);
-		return -EINVAL;
+		co_return -EINVAL;
 	}
 	gdix_info("Switch mini system successfully\n");
 
@@ -135,17 +163,17 @@ int GTx9Update::prepareUpdate()
 	ret = dev->SendCmd(0x11, tempBuf, 1);
 	if (ret < 0) {
 		gdix_err("Failed send erase flash cmd\n");
-		return ret;
+		co_return ret;
 	}
 
 	retry = 10;
 	memset(tempBuf, 0x55, 5);
 	while (retry--) {
-		usleep(10000);
+		co_await update_sleep(10000);
 		ret = dev->Write(0x14000, tempBuf, 5);
 		if (ret < 0) {
 			gdix_err("Failed write sram, ret=%d\n", ret);
-			return ret;
+			co_return ret;
 		}
 		ret = dev->Read(0x14000, recvBuf, 5);
 		if (!memcmp(tempBuf, recvBuf, 5))
@@ -154,42 +182,86 @@ int GTx9Update::prepareUpdate()
 	if (retry < 0) {
 		gdix_err("Read back failed, ret=%d buf:%02x %02x %02x %02x %02x\n", ret,
 				 recvBuf[0], recvBuf[1], recvBuf[2], recvBuf[3], recvBuf[4]);
-		return -EINVAL;
+		co_return -EINVAL;
 	}
 
 	gdix_info("Updata prepare OK\n");
+	co_return 0;
+}
+
+/* data of a chunk, read from a streaming image into window */
+int GTx9Update::fetchChunk(const struct image_subsys *subsys, uint32_t offset,
+						   uint32_t len, uint8_t *window, const uint8_t **data,
+						   uint32_t *checksum)
+{
+	int ret;
+
+	if (subsys->data) {
+		*data = &subsys->data[offset];
+	} else {
+		ret = image->ReadData(subsys->offset + offset, window, len);
+		if (ret < 0)
+			return ret;
+		*data = window;
+	}
+	if (subsys->sums)
+		*checksum = subsys->sums[offset / FW_CHUNK_SIZE];
+	else
+		*checksum = gdix_sum_u16_le(*data, len);
 	return 0;
 }
 
-int GTx9Update::flashSubSystem(struct fw_subsys_info *subsys)
+UpdateTask GTx9Update::flashSubSystem(const struct image_subsys *subsys,
+									  int index)
 {
 	uint32_t data_size = 0;
+	uint32_t next_size;
 	uint32_t offset = 0;
 	uint32_t temp_addr = subsys->flash_addr;
-	uint32_t total_size = subsys->size;
-	uint32_t checksum;
+	uint32_t total_size = subsys->len;
+	uint32_t checksum = 0, next_checksum = 0;
 	uint8_t cmdBuf[10] = {0};
+	uint8_t window[2][FW_STREAM_WINDOW];
+	const uint8_t *data = NULL, *next;
+	uint64_t deadline;
 	uint8_t flag;
 	int resend_rty = 3;
+	int cur = 0;
 	int retry;
-	uint32_t i;
 	int ret;
 
+	if (m_resuming) {
+		offset = journal->GetOffset(index);
+		if (offset > total_size || offset % 4096)
+			offset = 0;
+		if (offset)
+			gdix_info("Resume subsystem %d from 0x%x\n", index, offset);
+		temp_addr += offset;
+		total_size -= offset;
+	}
+	m_curSubsys = index;
+	m_curBase = 0;
+	m_ackedLen = offset;
+
+	if (total_size > 0) {
+		data_size = total_size > 4096 ? 4096 : total_size;
+		ret = fetchChunk(subsys, offset, data_size, window[cur], &data,
+						 &checksum);
+		if (ret < 0)
+			co_return ret;
+	}
+
 	while (total_size > 0) {
 		data_size = total_size > 4096 ? 4096 : total_size;
 resend:
 		/* send fw data to dram */
-		ret = dev->Write(0x14000, &subsys->data[offset], data_size);
+		ret = dev->Write(0x14000, data, data_size);
 		if (ret < 0) {
 			gdix_err("Write fw data failed\n");
-			return ret;
+			co_return ret;
 		}
 
 		/* send checksum */
-		for (i = 0, checksum = 0; i < data_size; i += 2) {
-			checksum +=
-				subsys->data[offset + i] + (subsys->data[offset + i + 1] << 8);
-		}
 
 		cmdBuf[0] = (data_size >> 8) & 0xFF;
 		cmdBuf[1] = data_size & 0xFF;
@@ -204,13 +276,26 @@ resend:
 		ret = dev->SendCmd(0x12, cmdBuf, 10);
 		if (ret < 0) {
 			gdix_err("Failed send start update cmd\n");
-			return ret;
+			co_return ret;
+		}
+		deadline = update_deadline(20000);
+
+		/* read and sum the next chunk while the IC flashes this one */
+		next = NULL;
+		if (total_size > data_size) {
+			next_size = total_size - data_size;
+			if (next_size > 4096)
+				next_size = 4096;
+			ret = fetchChunk(subsys, offset + data_size, next_size,
+							 window[!cur], &next, &next_checksum);
+			if (ret < 0)
+				co_return ret;
 		}
 
 		/* wait update finish */
 		retry = 10;
 		while (retry--) {
-			usleep(20000);
+			co_await update_sleep_until(deadline);
 			ret = dev->Read(0x10011, &flag, 1);
 			if (ret == 1 && flag == 0xAA)
 				break;
@@ -220,29 +305,37 @@ resend:
 					goto resend;
 				}
 			}
+			deadline = update_deadline(20000);
 		}
 		if (retry < 0) {
 			gdix_err("Failed get valid ack, ret=%d flag=0x%02x\n", ret, flag);
-			return -EINVAL;
+			co_return -EINVAL;
 		}
 
 		gdix_info("Flash package ok, addr:0x%06x\n", temp_addr);
+		chunk_acked(data_size);
 		resend_rty = 3;
 		offset += data_size;
 		temp_addr += data_size;
 		total_size -= data_size;
+		if (next) {
+			data = next;
+			checksum = next_checksum;
+			cur = !cur;
+		}
 	}
 
-	return 0;
+	if (journal)
+		journal->Done(index);
+	co_return 0;
 }
 
 #define CFG_MAX_SIZE 4096
-int GTx9Update::fw_update(unsigned int firmware_flag)
+UpdateTask GTx9Update::flashFirmware(unsigned int firmware_flag)
 {
-	struct firmware_summary *fw_info =
-		(struct firmware_summary *)image->GetFirmwareSummary();
-	struct fw_subsys_info *fw_x;
-	struct fw_subsys_info subsys_cfg;
+	const struct image_subsys *fw_x;
+	const struct image_config *cfg;
+	struct image_subsys subsys_cfg;
 	int i;
 	int ret;
 	uint8_t buf[1];
@@ -253,34 +346,49 @@ int GTx9Update::fw_update(unsigned int firmware_flag)
 
 	gdix_info("IN\n");
 	/* flash config */
-	if (image->HasConfig()) {
-		memcpy(temp_buf,
-			   image->GetFirmwareData() + image->GetFirmwareSize() + 64,
-			   image->GetConfigSize());
+	if (image->HasConfig() && !journal_done(JOURNAL_SUBSYS_CFG)) {
+		cfg = image->FindConfig(sensor_id());
+		if (!cfg) {
+			gdix_err("No config in image\n");
+			co_return -EINVAL;
+		}
+		if (cfg->len > CFG_MAX_SIZE) {
+			gdix_err("Invalid config size:%d\n", cfg->len);
+			co_return -EINVAL;
+		}
+		ret = image->ReadData(cfg->offset, temp_buf, cfg->len);
+		if (ret < 0)
+			co_return ret;
 
+		/* config is flashed as a whole sector, padded with 0 */
+		memset(&subsys_cfg, 0, sizeof(subsys_cfg));
 		subsys_cfg.data = temp_buf;
-		subsys_cfg.size = CFG_MAX_SIZE;
+		subsys_cfg.len = CFG_MAX_SIZE;
 		subsys_cfg.flash_addr = 0x40000;
 		subsys_cfg.type = 4;
-		ret = flashSubSystem(&subsys_cfg);
+		ret = co_await flashSubSystem(&subsys_cfg, JOURNAL_SUBSYS_CFG);
 		if (ret < 0) {
 			gdix_err("failed flash config with ISP\n");
-			return ret;
+			co_return ret;
 		}
 		gdix_info("success flash config with ISP\n");
-		usleep(20000);
+		co_await update_sleep(20000);
 	}
 
-	for (i = 1; i < fw_info->subsys_num; i++) {
-		fw_x = &fw_info->subsys[i];
+	for (i = 1; i < image->GetSubsysNum(); i++) {
+		fw_x = image->GetSubsys(i);
 		if (fw_x->type == (uint8_t)firmware_flag) {
 			gdix_info("skip type[%02X] subsystem[%d]\n", fw_x->type, i);
 			continue;
 		}
-		ret = flashSubSystem(fw_x);
+		if (journal_done(i)) {
+			gdix_info("subsystem %d already flashed\n", i);
+			continue;
+		}
+		ret = co_await flashSubSystem(fw_x, i);
 		if (ret < 0) {
 			gdix_err("-------- Failed flash subsystem %d --------\n", i);
-			return ret;
+			co_return ret;
 		}
 		gdix_info("-------- Success flash subsystem %d --------\n", i);
 	}
@@ -291,9 +399,9 @@ int GTx9Update::fw_update(unsigned int firmware_flag)
 	ret = dev->SendCmd(0x13, buf, 1);
 	if (ret < 0) {
 		gdix_err("Failed reset IC\n");
-		return ret;
+		co_return ret;
 	}
-	usleep(100000);
+	co_await update_sleep(100000);
 
 	/* compare version */
 	dev->SetBasicProperties();
@@ -311,8 +419,8 @@ int GTx9Update::fw_update(unsigned int firmware_flag)
 		gdix_info("Current version:%d.%d\n", dev->GetFirmwareVersionMajor(),
 				  dev->GetFirmwareVersionMinor());
 		gdix_info("Firmware version:%d.%d\n", majorVer, minorVer);
-		return -1;
+		co_return -1;
 	}
 
-	return 0;
+	co_return 0;
 }
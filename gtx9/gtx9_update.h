@@ -34,14 +34,20 @@ class GTx9Update : public GTupdate
 {
 public:
 	int Run(void *para);
+	int Plan() { return check_update(); }
 
 protected:
 	int check_update();
-	int fw_update(unsigned int firmware_flag);
+	UpdateTask check_bootloader();
+	UpdateTask Flow(void *para);
 
 private:
-	int prepareUpdate();
-	int flashSubSystem(struct fw_subsys_info *subsys);
+	UpdateTask prepareUpdate();
+	UpdateTask flashFirmware(unsigned int firmware_flag);
+	UpdateTask flashSubSystem(const struct image_subsys *subsys, int index);
+	int fetchChunk(const struct image_subsys *subsys, uint32_t offset,
+				   uint32_t len, uint8_t *window, const uint8_t **data,
+				   uint32_t *checksum);
 };
 
 #endif
\ No newline at end of file
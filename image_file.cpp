@@ -0,0 +1,593 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gtp_util.h"
+#include "image_file.h"
+#include "lz.h"
+
+/* firmware files are a few hundred KB, refuse anything absurd */
+#define IMAGE_FILE_MAX_SIZE (64 * 1024 * 1024)
+
+/*
+ * Compressed file layout: header, a table with one entry per block, then
+ * the blocks back to back. Each block of the raw image is compressed on
+ * its own, a block that doesn't shrink is stored as it is. All fields
+ * are little endian.
+ */
+#define PACKED_MAGIC "GDIXLZ1"
+#define PACKED_VERSION 1
+/* the flash chunk size, a chunk then costs about one block to decode */
+#define PACKED_BLOCK_SIZE 4096
+#define PACKED_MIN_BLOCK_SIZE 512
+#define PACKED_MAX_BLOCK_SIZE 65536
+#define PACKED_STORED 0x80000000
+
+struct packed_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t raw_size;
+	uint32_t block_size;
+	uint32_t block_num;
+};
+
+struct packed_entry {
+	uint32_t len; /* PACKED_STORED set if not compressed */
+	uint32_t hash; /* of the raw block */
+};
+
+struct packed_block {
+	uint32_t offset; /* in the compressed file */
+	uint32_t len;
+	uint32_t hash;
+};
+
+static uint32_t packed_hash(const unsigned char *data, unsigned int len)
+{
+	uint32_t hash = 0x811C9DC5;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+ImageFile *ImageFile::s_files = NULL;
+/* guards s_files and the reference counts */
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+ImageFile::ImageFile()
+{
+	m_fd = -1;
+	m_dev = 0;
+	m_ino = 0;
+	m_size = 0;
+	m_fileSize = 0;
+	memset(&m_mtime, 0, sizeof(m_mtime));
+	m_data = NULL;
+	m_mapped = false;
+	m_refs = 0;
+	m_next = NULL;
+	m_parent = NULL;
+	m_base = 0;
+	m_blocks = NULL;
+	m_blockNum = 0;
+	m_blockSize = 0;
+	m_packBuf = NULL;
+	m_cache = NULL;
+	m_cacheBlock = -1;
+	pthread_mutex_init(&m_lock, NULL);
+}
+
+ImageFile::~ImageFile()
+{
+	delete[] m_blocks;
+	delete[] m_packBuf;
+	delete[] m_cache;
+	pthread_mutex_destroy(&m_lock);
+	if (m_parent) {
+		m_parent->Release();
+		return;
+	}
+	if (m_fd >= 0)
+		close(m_fd);
+	if (m_mapped)
+		munmap((void *)m_data, m_size);
+	else
+		delete[] m_data;
+}
+
+bool ImageFile::Same(const struct stat *st)
+{
+	return m_dev == st->st_dev && m_ino == st->st_ino &&
+		   m_fileSize == st->st_size && m_mtime.tv_sec == st->st_mtim.tv_sec &&
+		   m_mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/*
+ * The file on disk is not the one opened any more, rewritten in place.
+ * A copy in memory is still good, only its source is stale.
+ */
+bool ImageFile::Changed()
+{
+	struct stat st;
+
+	if (m_parent)
+		return m_parent->Changed();
+	if (m_fd < 0)
+		return false;
+	return fstat(m_fd, &st) < 0 || !Same(&st);
+}
+
+int ImageFile::Load(int fd, const struct stat *st)
+{
+	void *addr;
+	unsigned char *buf;
+	int ret;
+
+	m_dev = st->st_dev;
+	m_ino = st->st_ino;
+	m_size = st->st_size;
+	m_fileSize = st->st_size;
+	m_mtime = st->st_mtim;
+
+	/*
+	 * the whole image is parsed right away, prefault it in one go,
+	 * MAP_POPULATE is best effort so also hint the readahead
+	 */
+	addr = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	if (addr != MAP_FAILED) {
+		madvise(addr, m_size, MADV_WILLNEED);
+		m_data = (const unsigned char *)addr;
+		m_mapped = true;
+		/* kept open to tell later if the file changed under the map */
+		m_fd = fd;
+		return 0;
+	}
+
+	/* not mappable, e.g. a pipe or an odd filesystem */
+	gdix_dbg("mmap failed, %s, read file\n", strerror(errno));
+	buf = new unsigned char[m_size];
+	ret = pread(fd, buf, m_size, 0);
+	if (ret != m_size) {
+		gdix_err("Failed read file, ret=%d\n", ret);
+		delete[] buf;
+		return -1;
+	}
+	m_data = buf;
+	return 0;
+}
+
+/* raw bytes of the file, whatever it holds */
+int ImageFile::RawRead(unsigned int offset, void *buf, unsigned int len)
+{
+	int ret;
+
+	ret = pread(m_fd, buf, len, offset);
+	if (ret != (int)len) {
+		gdix_err("Failed read 0x%x+%u, ret=%d\n", offset, len, ret);
+		return -1;
+	}
+	return ret;
+}
+
+/* parse the block table of the compressed file open on m_fd */
+int ImageFile::LoadPacked()
+{
+	struct packed_header header;
+	struct packed_entry *table;
+	uint32_t offset, len;
+	unsigned int i;
+	bool bad;
+	int ret = -1;
+
+	if (RawRead(0, &header, sizeof(header)) < 0 ||
+		header.version != PACKED_VERSION || !header.raw_size ||
+		header.raw_size > IMAGE_FILE_MAX_SIZE ||
+		header.block_size < PACKED_MIN_BLOCK_SIZE ||
+		header.block_size > PACKED_MAX_BLOCK_SIZE ||
+		header.block_num != (header.raw_size + header.block_size - 1) /
+								header.block_size ||
+		(off_t)(header.block_num * sizeof(struct packed_entry)) >
+			m_fileSize) {
+		gdix_err("Invalid compressed image header\n");
+		return -1;
+	}
+
+	table = new struct packed_entry[header.block_num];
+	m_blocks = new struct packed_block[header.block_num];
+	if (RawRead(sizeof(header), table, header.block_num * sizeof(*table)) < 0)
+		goto out;
+
+	m_size = header.raw_size;
+	m_blockSize = header.block_size;
+	m_blockNum = header.block_num;
+	offset = sizeof(header) + header.block_num * sizeof(*table);
+	for (i = 0; i < m_blockNum; i++) {
+		len = table[i].len & ~PACKED_STORED;
+		if (table[i].len & PACKED_STORED)
+			bad = len != BlockLen(i);
+		else
+			bad = len > LZ_BOUND(m_blockSize);
+		if (bad || offset > m_fileSize || len > m_fileSize - offset) {
+			gdix_err("Bad compressed block %u\n", i);
+			goto out;
+		}
+		m_blocks[i].offset = offset;
+		m_blocks[i].len = table[i].len;
+		m_blocks[i].hash = table[i].hash;
+		offset += len;
+	}
+	m_packBuf = new unsigned char[LZ_BOUND(m_blockSize)];
+	m_cache = new unsigned char[m_blockSize];
+	ret = 0;
+
+out:
+	delete[] table;
+	return ret;
+}
+
+unsigned int ImageFile::BlockLen(unsigned int index)
+{
+	if (index == m_blockNum - 1)
+		return m_size - index * m_blockSize;
+	return m_blockSize;
+}
+
+/* decode one block into buf and check it against the table hash */
+int ImageFile::DecodeBlock(unsigned int index, unsigned char *buf)
+{
+	struct packed_block *block = &m_blocks[index];
+	unsigned int packLen = block->len & ~PACKED_STORED;
+	unsigned int len = BlockLen(index);
+
+	if (block->len & PACKED_STORED) {
+		if (RawRead(block->offset, buf, len) < 0)
+			return -1;
+	} else {
+		if (RawRead(block->offset, m_packBuf, packLen) < 0)
+			return -1;
+		if (gdix_lz_decompress(m_packBuf, packLen, buf, len) < 0) {
+			gdix_err("Failed decompress block %u\n", index);
+			return -1;
+		}
+	}
+
+	if (packed_hash(buf, len) != block->hash) {
+		gdix_err("Compressed block %u is corrupted\n", index);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Whole blocks go straight into buf, a partial one is decoded into the
+ * cache first. Reads walk the image forward, so every block is decoded
+ * about once even if chunks and blocks are not aligned.
+ */
+int ImageFile::ReadPacked(unsigned int offset, unsigned char *buf,
+						  unsigned int len)
+{
+	unsigned int index, pos, blockLen, n, done;
+
+	for (done = 0; done < len; done += n) {
+		index = (offset + done) / m_blockSize;
+		pos = (offset + done) % m_blockSize;
+		blockLen = BlockLen(index);
+		n = blockLen - pos;
+		if (n > len - done)
+			n = len - done;
+
+		if (n == blockLen) {
+			if (DecodeBlock(index, buf + done) < 0)
+				return -1;
+			continue;
+		}
+		if (m_cacheBlock != (int)index) {
+			m_cacheBlock = -1;
+			if (DecodeBlock(index, m_cache) < 0)
+				return -1;
+			m_cacheBlock = index;
+		}
+		memcpy(buf + done, m_cache + pos, n);
+	}
+	return len;
+}
+
+static bool is_packed(int fd)
+{
+	char magic[8];
+
+	return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+		   !memcmp(magic, PACKED_MAGIC, sizeof(magic));
+}
+
+ImageFile *ImageFile::Open(const char *filename, bool stream)
+{
+	ImageFile *file;
+	struct stat st;
+	int fd, ret;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		gdix_err("file:%s, %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size <= 0 ||
+		st.st_size > IMAGE_FILE_MAX_SIZE) {
+		gdix_err("Invalid firmware file:%s\n", filename);
+		close(fd);
+		return NULL;
+	}
+
+	if (stream) {
+		file = new ImageFile;
+		file->m_fd = fd;
+		file->m_dev = st.st_dev;
+		file->m_ino = st.st_ino;
+		file->m_size = st.st_size;
+		file->m_fileSize = st.st_size;
+		file->m_mtime = st.st_mtim;
+		file->m_refs = 1;
+		if (is_packed(fd) && file->LoadPacked() < 0) {
+			delete file;
+			return NULL;
+		}
+		return file;
+	}
+
+	/* held while loading so a file opened by two threads is loaded once */
+	pthread_mutex_lock(&s_lock);
+	for (file = s_files; file; file = file->m_next) {
+		if (file->Same(&st)) {
+			file->m_refs++;
+			pthread_mutex_unlock(&s_lock);
+			close(fd);
+			return file;
+		}
+	}
+
+	/* a packed file is decoded a block at a time as it is read, keep
+	 * it open for that
+	 */
+	file = new ImageFile;
+	if (is_packed(fd)) {
+		file->m_fd = fd;
+		file->m_dev = st.st_dev;
+		file->m_ino = st.st_ino;
+		file->m_size = st.st_size;
+		file->m_fileSize = st.st_size;
+		file->m_mtime = st.st_mtim;
+		ret = file->LoadPacked();
+	} else {
+		ret = file->Load(fd, &st);
+		if (file->m_fd < 0)
+			close(fd);
+	}
+	if (ret < 0) {
+		pthread_mutex_unlock(&s_lock);
+		delete file;
+		return NULL;
+	}
+
+	file->m_refs = 1;
+	file->m_next = s_files;
+	s_files = file;
+	pthread_mutex_unlock(&s_lock);
+	return file;
+}
+
+ImageFile *ImageFile::OpenMemory(const void *data, unsigned int len)
+{
+	ImageFile *file;
+	unsigned char *buf;
+
+	if (!len || len > IMAGE_FILE_MAX_SIZE) {
+		gdix_err("Invalid firmware size %u\n", len);
+		return NULL;
+	}
+	if (len >= sizeof(PACKED_MAGIC) &&
+		!memcmp(data, PACKED_MAGIC, sizeof(PACKED_MAGIC))) {
+		gdix_err("Compressed images are only read from files\n");
+		return NULL;
+	}
+
+	/* not a file, never shared with Open() */
+	buf = new unsigned char[len];
+	memcpy(buf, data, len);
+	file = new ImageFile;
+	file->m_data = buf;
+	file->m_size = len;
+	file->m_fileSize = len;
+	file->m_refs = 1;
+	return file;
+}
+
+ImageFile *ImageFile::OpenSlice(ImageFile *file, unsigned int offset,
+								 unsigned int len)
+{
+	ImageFile *slice;
+
+	if (offset > file->m_size || len > file->m_size - offset || !len) {
+		gdix_err("Slice 0x%x+%u exceed file size %d\n", offset, len,
+				 (int)file->m_size);
+		return NULL;
+	}
+
+	slice = new ImageFile;
+	file->Get();
+	slice->m_parent = file;
+	slice->m_base = offset;
+	slice->m_dev = file->m_dev;
+	slice->m_ino = file->m_ino;
+	slice->m_size = len;
+	slice->m_mtime = file->m_mtime;
+	slice->m_data = file->m_data ? file->m_data + offset : NULL;
+	slice->m_refs = 1;
+	return slice;
+}
+
+int ImageFile::Read(unsigned int offset, unsigned char *buf, unsigned int len)
+{
+	int ret;
+
+	if (offset > m_size || len > m_size - offset) {
+		gdix_err("Read 0x%x+%u exceed file size %d\n", offset, len,
+				 (int)m_size);
+		return -1;
+	}
+
+	if (m_data) {
+		memcpy(buf, m_data + offset, len);
+		return len;
+	}
+	if (m_blocks) {
+		pthread_mutex_lock(&m_lock);
+		ret = ReadPacked(offset, buf, len);
+		pthread_mutex_unlock(&m_lock);
+		return ret;
+	}
+	if (m_parent)
+		return m_parent->Read(m_base + offset, buf, len);
+
+	return RawRead(offset, buf, len);
+}
+
+void ImageFile::Get()
+{
+	pthread_mutex_lock(&s_lock);
+	m_refs++;
+	pthread_mutex_unlock(&s_lock);
+}
+
+void ImageFile::Release()
+{
+	ImageFile **pos;
+
+	pthread_mutex_lock(&s_lock);
+	if (--m_refs > 0) {
+		pthread_mutex_unlock(&s_lock);
+		return;
+	}
+
+	for (pos = &s_files; *pos; pos = &(*pos)->m_next) {
+		if (*pos == this) {
+			*pos = m_next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s_lock);
+	/* a slice releases its parent, so not under the lock */
+	delete this;
+}
+
+/*
+ * Write the image in srcName compressed to dstName, written aside and
+ * renamed so dstName may be the file being compressed.
+ */
+int ImageFile::Compress(const char *srcName, const char *dstName)
+{
+	struct packed_header header;
+	struct packed_entry *table;
+	const unsigned char *data;
+	unsigned char *out;
+	char tmpname[PATH_MAX];
+	unsigned int i, len, pos = 0;
+	ImageFile *file;
+	int fd, ret = -1, packLen;
+
+	file = Open(srcName);
+	if (!file)
+		return -1;
+
+	data = file->GetData();
+	if (!data) {
+		gdix_err("%s is compressed already\n", srcName);
+		file->Release();
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACKED_MAGIC, sizeof(header.magic));
+	header.version = PACKED_VERSION;
+	header.raw_size = file->GetSize();
+	header.block_size = PACKED_BLOCK_SIZE;
+	header.block_num = (header.raw_size + PACKED_BLOCK_SIZE - 1) /
+					   PACKED_BLOCK_SIZE;
+
+	table = new struct packed_entry[header.block_num];
+	out = new unsigned char[header.block_num * LZ_BOUND(PACKED_BLOCK_SIZE)];
+	for (i = 0; i < header.block_num; i++, data += len) {
+		len = header.raw_size - i * PACKED_BLOCK_SIZE;
+		if (len > PACKED_BLOCK_SIZE)
+			len = PACKED_BLOCK_SIZE;
+		packLen = gdix_lz_compress(data, len, out + pos,
+								   LZ_BOUND(PACKED_BLOCK_SIZE));
+		if (packLen < 0 || packLen >= (int)len) {
+			memcpy(out + pos, data, len);
+			table[i].len = len | PACKED_STORED;
+			packLen = len;
+		} else {
+			table[i].len = packLen;
+		}
+		table[i].hash = packed_hash(data, len);
+		pos += packLen;
+	}
+
+	if (snprintf(tmpname, sizeof(tmpname), "%s.%d", dstName, getpid()) >=
+		(int)sizeof(tmpname))
+		goto out;
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		gdix_err("Can't create %s, %s\n", tmpname, strerror(errno));
+		goto out;
+	}
+
+	len = header.block_num * sizeof(*table);
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+		write(fd, table, len) != (int)len ||
+		write(fd, out, pos) != (int)pos || fsync(fd) < 0) {
+		gdix_err("Failed write %s, %s\n", tmpname, strerror(errno));
+		close(fd);
+		unlink(tmpname);
+		goto out;
+	}
+	close(fd);
+
+	if (rename(tmpname, dstName) < 0) {
+		gdix_err("Failed rename %s, %s\n", tmpname, strerror(errno));
+		unlink(tmpname);
+		goto out;
+	}
+	gdix_info("%s: %u bytes compressed to %u\n", dstName, header.raw_size,
+			  (unsigned int)(sizeof(header) + len + pos));
+	ret = 0;
+
+out:
+	delete[] out;
+	delete[] table;
+	file->Release();
+	return ret;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _IMAGE_FILE_H_
+#define _IMAGE_FILE_H_
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * Read-only mapping of a firmware file. Opening the same unchanged file
+ * again returns the existing mapping, so the images of several devices
+ * updated in one process share one copy of the data.
+ *
+ * A file opened for streaming is not mapped at all, GetData() returns
+ * NULL and the data is fetched with Read() on demand.
+ *
+ * A slice is a view of part of another file, such as one image of a
+ * bundle. It holds a reference on that file and copies nothing.
+ *
+ * A memory file holds a copy of data handed over by the caller.
+ *
+ * A file written by Compress() is decoded transparently, one block at a
+ * time as it is read. GetData() returns NULL for it, streamed or not.
+ *
+ * A mapped file must be replaced by rename, never rewritten in place:
+ * truncating it under the mapping faults whoever reads the data next.
+ * Changed() tells that it was rewritten since it was opened.
+ *
+ * Files may be opened, read and released from several threads.
+ */
+struct packed_block;
+
+class ImageFile
+{
+public:
+	static ImageFile *Open(const char *filename, bool stream = false);
+	static ImageFile *OpenMemory(const void *data, unsigned int len);
+	static ImageFile *OpenSlice(ImageFile *file, unsigned int offset,
+								unsigned int len);
+	static int Compress(const char *srcName, const char *dstName);
+	void Get();
+	void Release();
+
+	const unsigned char *GetData() { return m_data; }
+	int GetSize() { return m_size; }
+	ino_t GetIno() { return m_ino; }
+	const struct timespec *GetMTime() { return &m_mtime; }
+	bool Changed();
+	int Read(unsigned int offset, unsigned char *buf, unsigned int len);
+
+private:
+	ImageFile();
+	~ImageFile();
+	int Load(int fd, const struct stat *st);
+	int LoadPacked();
+	bool Same(const struct stat *st);
+	int RawRead(unsigned int offset, void *buf, unsigned int len);
+	unsigned int BlockLen(unsigned int index);
+	int DecodeBlock(unsigned int index, unsigned char *buf);
+	int ReadPacked(unsigned int offset, unsigned char *buf, unsigned int len);
+
+	int m_fd;
+	dev_t m_dev;
+	ino_t m_ino;
+	off_t m_size;
+	off_t m_fileSize; /* on disk, less than m_size when compressed */
+	struct timespec m_mtime;
+	const unsigned char *m_data;
+	bool m_mapped;
+	int m_refs;
+	ImageFile *m_next;
+	ImageFile *m_parent; /* file a slice is cut from */
+	unsigned int m_base;
+	struct packed_block *m_blocks; /* set for a packed file */
+	unsigned int m_blockNum;
+	unsigned int m_blockSize;
+	unsigned char *m_packBuf; /* one compressed block */
+	unsigned char *m_cache;   /* last decoded block */
+	int m_cacheBlock;
+	pthread_mutex_t m_lock; /* guards the block cache */
+
+	static ImageFile *s_files;
+};
+
+#endif
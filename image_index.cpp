@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gtp_util.h"
+#include "image_index.h"
+
+#define IMAGE_INDEX_MAGIC "GDIXIDX"
+#define IMAGE_INDEX_VERSION 2
+#define IMAGE_INDEX_MAX_SIZE (4 * 1024 * 1024)
+
+struct image_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t body_len;
+	uint32_t body_hash;
+	uint32_t reserved;
+	struct image_index_key key;
+};
+
+static uint32_t index_hash(const unsigned char *buf, unsigned int len)
+{
+	uint32_t hash = 0x811C9DC5;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= buf[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+ImageIndex::ImageIndex()
+{
+	m_buf = NULL;
+	m_len = 0;
+	m_size = 0;
+	m_pos = 0;
+}
+
+ImageIndex::~ImageIndex() { delete[] m_buf; }
+
+int ImageIndex::Load(const char *filename, const struct image_index_key *key)
+{
+	struct image_index_header header;
+	struct stat st;
+	int fd, ret = -1;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		gdix_dbg("No index %s, %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(header) ||
+		st.st_size > IMAGE_INDEX_MAX_SIZE ||
+		read(fd, &header, sizeof(header)) != sizeof(header))
+		goto out;
+
+	if (memcmp(header.magic, IMAGE_INDEX_MAGIC, sizeof(header.magic)) ||
+		header.version != IMAGE_INDEX_VERSION ||
+		header.body_len != st.st_size - sizeof(header)) {
+		gdix_dbg("Index %s is invalid\n", filename);
+		goto out;
+	}
+	if (memcmp(&header.key, key, sizeof(*key))) {
+		gdix_dbg("Index %s is for another image\n", filename);
+		goto out;
+	}
+
+	delete[] m_buf;
+	m_buf = new unsigned char[header.body_len];
+	m_size = header.body_len;
+	m_len = header.body_len;
+	m_pos = 0;
+	if (read(fd, m_buf, m_len) != (int)m_len ||
+		index_hash(m_buf, m_len) != header.body_hash) {
+		gdix_dbg("Index %s is corrupted\n", filename);
+		m_len = 0;
+		goto out;
+	}
+	ret = 0;
+
+out:
+	close(fd);
+	return ret;
+}
+
+/* written aside and renamed, a reader never sees half an index */
+int ImageIndex::Save(const char *filename, const struct image_index_key *key)
+{
+	struct image_index_header header;
+	char tmpname[PATH_MAX];
+	int fd;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IMAGE_INDEX_MAGIC, sizeof(header.magic));
+	header.version = IMAGE_INDEX_VERSION;
+	header.body_len = m_len;
+	header.body_hash = index_hash(m_buf, m_len);
+	header.key = *key;
+
+	if (snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, getpid()) >=
+		(int)sizeof(tmpname))
+		return -1;
+
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		gdix_dbg("Can't create index %s, %s\n", tmpname, strerror(errno));
+		return -1;
+	}
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+		write(fd, m_buf, m_len) != (int)m_len || fsync(fd) < 0) {
+		gdix_dbg("Failed write index, %s\n", strerror(errno));
+		close(fd);
+		unlink(tmpname);
+		return -1;
+	}
+	close(fd);
+
+	if (rename(tmpname, filename) < 0) {
+		gdix_dbg("Failed rename index, %s\n", strerror(errno));
+		unlink(tmpname);
+		return -1;
+	}
+	return 0;
+}
+
+void ImageIndex::Put(const void *data, unsigned int len)
+{
+	unsigned char *buf;
+
+	if (m_len + len > m_size) {
+		m_size = (m_len + len) * 2;
+		buf = new unsigned char[m_size];
+		if (m_len)
+			memcpy(buf, m_buf, m_len);
+		delete[] m_buf;
+		m_buf = buf;
+	}
+	memcpy(m_buf + m_len, data, len);
+	m_len += len;
+}
+
+int ImageIndex::Get(void *data, unsigned int len)
+{
+	if (len > m_len - m_pos)
+		return -1;
+	memcpy(data, m_buf + m_pos, len);
+	m_pos += len;
+	return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _IMAGE_INDEX_H_
+#define _IMAGE_INDEX_H_
+
+#include <stdint.h>
+
+#define IMAGE_INDEX_SUFFIX ".gdixidx"
+
+/* identifies the image an index was built from */
+struct image_index_key {
+	uint64_t size;
+	uint64_t ino;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t sample_hash; /* head and tail of the image */
+	uint32_t parser;	  /* image class that built the index */
+};
+
+/*
+ * Sidecar file holding what an image parser worked out, so the next run
+ * on the same unchanged image can skip validation. The body is a plain
+ * byte stream, writer and reader agree on its layout.
+ */
+class ImageIndex
+{
+public:
+	ImageIndex();
+	~ImageIndex();
+
+	/* 0 when the file exists, is intact and matches key */
+	int Load(const char *filename, const struct image_index_key *key);
+	int Save(const char *filename, const struct image_index_key *key);
+
+	void Put(const void *data, unsigned int len);
+	void PutU32(uint32_t val) { Put(&val, sizeof(val)); }
+	int Get(void *data, unsigned int len);
+	int GetU32(uint32_t *val) { return Get(val, sizeof(*val)); }
+
+private:
+	unsigned char *m_buf;
+	unsigned int m_len;
+	unsigned int m_size;
+	unsigned int m_pos;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/hidraw.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gtp_util.h"
+#include "lease.h"
+
+#define LEASE_POLL_MS 20
+
+static char lease_dir[PATH_MAX] = LEASE_DEFAULT_DIR;
+static bool lease_enabled = true;
+static int lease_wait_ms = 0;
+
+DeviceLease::DeviceLease()
+{
+	m_lockFd = -1;
+	m_devFd = -1;
+}
+
+void DeviceLease::Setup(const char *dir, int waitMs)
+{
+	lease_enabled = dir != NULL;
+	if (dir)
+		snprintf(lease_dir, sizeof(lease_dir), "%s", dir);
+	lease_wait_ms = waitMs;
+}
+
+/*
+ * The USB or I2C device the node belongs to, the same for all its
+ * interfaces and after it comes back under another hidraw number.
+ * Devices that aren't hidraw go by their path.
+ */
+static void lease_key(int fd, const char *device, char *key, int len)
+{
+	char phys[LEASE_KEY_LEN] = {0};
+	char *pos;
+
+	if (fd >= 0 && ioctl(fd, HIDIOCGRAWPHYS(sizeof(phys) - 1), phys) > 0 &&
+		phys[0]) {
+		pos = strchr(phys, '/');
+		if (pos)
+			*pos = '\0';
+		snprintf(key, len, "%s", phys);
+	} else {
+		snprintf(key, len, "%s", device);
+	}
+	for (pos = key; *pos; pos++) {
+		if (!isalnum((unsigned char)*pos) && !strchr(".:-", *pos))
+			*pos = '_';
+	}
+}
+
+void DeviceLease::GetKey(const char *device, char *key, int len)
+{
+	int fd = open(device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	lease_key(fd, device, key, len);
+	if (fd >= 0)
+		close(fd);
+}
+
+static int lease_lock(int fd, const char *name)
+{
+	int waited = 0;
+
+	while (flock(fd, LOCK_EX | LOCK_NB)) {
+		if (errno != EWOULDBLOCK) {
+			gdix_err("Failed lock %s, %s\n", name, strerror(errno));
+			return -errno;
+		}
+		if (lease_wait_ms != LEASE_WAIT_FOREVER && waited >= lease_wait_ms) {
+			gdix_err("%s is in use by another process\n", name);
+			return -EBUSY;
+		}
+		if (!waited)
+			gdix_info("%s is in use, wait for it\n", name);
+		usleep(LEASE_POLL_MS * 1000);
+		waited += LEASE_POLL_MS;
+	}
+	return 0;
+}
+
+/*
+ * A lock file named after the physical device, and a lock on the node
+ * itself for the tools that lock the node. A device that can't be opened
+ * or a lock directory that can't be written takes no lease, the update
+ * itself reports what is wrong.
+ */
+int DeviceLease::Acquire(const char *device)
+{
+	char key[LEASE_KEY_LEN], lockName[PATH_MAX + LEASE_KEY_LEN + 8];
+	int ret;
+
+	Release();
+	if (!lease_enabled)
+		return 0;
+	m_devFd = open(device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (m_devFd < 0)
+		return 0;
+
+	lease_key(m_devFd, device, key, sizeof(key));
+	snprintf(lockName, sizeof(lockName), "%s/%s.lock", lease_dir, key);
+	if (mkdir(lease_dir, 0755) && errno != EEXIST)
+		gdix_dbg("can't create %s, %s\n", lease_dir, strerror(errno));
+	m_lockFd = open(lockName, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (m_lockFd < 0) {
+		gdix_info("no lease on %s, %s: %s\n", device, lockName,
+				  strerror(errno));
+	} else {
+		ret = lease_lock(m_lockFd, device);
+		if (ret)
+			goto err;
+	}
+
+	ret = lease_lock(m_devFd, device);
+	if (ret)
+		goto err;
+	gdix_dbg("leased %s as %s\n", device, key);
+	return 0;
+
+err:
+	Release();
+	return ret;
+}
+
+void DeviceLease::Release()
+{
+	/* closing drops the locks */
+	if (m_lockFd >= 0)
+		close(m_lockFd);
+	if (m_devFd >= 0)
+		close(m_devFd);
+	m_lockFd = -1;
+	m_devFd = -1;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LEASE_H_
+#define _LEASE_H_
+
+#include "gdixupdate.h"
+
+#define LEASE_DEFAULT_DIR GDIX_LEASE_DIR
+#define LEASE_WAIT_FOREVER -1
+#define LEASE_KEY_LEN 128
+
+/*
+ * Advisory lease on a device, held from before the first report to the
+ * device until the update or query is over. Processes that take leases
+ * never talk to the same device at once.
+ */
+class DeviceLease
+{
+public:
+	DeviceLease();
+	~DeviceLease() { Release(); }
+
+	/* dir NULL takes no leases, waitMs 0 fails at once when taken */
+	static void Setup(const char *dir, int waitMs);
+	/*
+	 * Name of the physical device behind the node, stable across replug
+	 * and reboot, for anything kept per device
+	 */
+	static void GetKey(const char *device, char *key, int len);
+	/*
+	 * 0 when held, -EBUSY if still taken when the wait is over, -errno
+	 * when it can't be locked
+	 */
+	int Acquire(const char *device);
+	void Release();
+
+private:
+	int m_lockFd;
+	int m_devFd;
+};
+
+#endif
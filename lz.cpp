@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_HASH_BITS 12
+#define LZ_MAX_DIST 0xFFFF
+/* matches stop short of the end so the tail is always literals */
+#define LZ_END_LITERALS 5
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+	uint32_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static inline unsigned int lz_hash(uint32_t seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* length continuation bytes of a nibble that hit 15 */
+static uint8_t *lz_put_len(uint8_t *op, unsigned int len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+static uint8_t *lz_put_seq(uint8_t *op, const uint8_t *lit, unsigned int litLen,
+						   unsigned int matchLen, unsigned int dist)
+{
+	uint8_t *token = op++;
+
+	*token = (litLen >= 15 ? 15 : litLen) << 4;
+	if (litLen >= 15)
+		op = lz_put_len(op, litLen - 15);
+	memcpy(op, lit, litLen);
+	op += litLen;
+	if (!matchLen)
+		return op;
+
+	matchLen -= LZ_MIN_MATCH;
+	*token |= matchLen >= 15 ? 15 : matchLen;
+	*op++ = dist & 0xFF;
+	*op++ = dist >> 8;
+	if (matchLen >= 15)
+		op = lz_put_len(op, matchLen - 15);
+	return op;
+}
+
+int gdix_lz_compress(const uint8_t *src, unsigned int len, uint8_t *dst,
+					 unsigned int size)
+{
+	const uint8_t *ip = src, *anchor = src, *ref;
+	const uint8_t *end = src + len;
+	const uint8_t *limit = len > LZ_END_LITERALS ? end - LZ_END_LITERALS : src;
+	uint32_t table[1 << LZ_HASH_BITS];
+	unsigned int h, matchLen;
+	uint8_t *op = dst;
+
+	if (size < LZ_BOUND(len))
+		return -1;
+
+	memset(table, 0xFF, sizeof(table));
+	while (ip + LZ_MIN_MATCH <= limit) {
+		h = lz_hash(lz_read32(ip));
+		ref = table[h] == 0xFFFFFFFF ? NULL : src + table[h];
+		table[h] = ip - src;
+		if (!ref || ip - ref > LZ_MAX_DIST ||
+			lz_read32(ref) != lz_read32(ip)) {
+			ip++;
+			continue;
+		}
+
+		matchLen = LZ_MIN_MATCH;
+		while (ip + matchLen < limit && ref[matchLen] == ip[matchLen])
+			matchLen++;
+		op = lz_put_seq(op, anchor, ip - anchor, matchLen, ip - ref);
+		ip += matchLen;
+		anchor = ip;
+	}
+
+	op = lz_put_seq(op, anchor, end - anchor, 0, 0);
+	return op - dst;
+}
+
+static int lz_get_len(const uint8_t **ip, const uint8_t *end,
+					  unsigned int *len)
+{
+	unsigned int val;
+
+	do {
+		if (*ip >= end)
+			return -1;
+		val = *(*ip)++;
+		*len += val;
+	} while (val == 255);
+	return 0;
+}
+
+int gdix_lz_decompress(const uint8_t *src, unsigned int srcLen, uint8_t *dst,
+					   unsigned int len)
+{
+	const uint8_t *ip = src, *end = src + srcLen;
+	uint8_t *op = dst, *oend = dst + len;
+	unsigned int litLen, matchLen, dist;
+	uint8_t token;
+
+	while (ip < end) {
+		token = *ip++;
+		litLen = token >> 4;
+		if (litLen == 15 && lz_get_len(&ip, end, &litLen) < 0)
+			return -1;
+		if (litLen > (unsigned int)(end - ip) ||
+			litLen > (unsigned int)(oend - op))
+			return -1;
+		memcpy(op, ip, litLen);
+		ip += litLen;
+		op += litLen;
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return -1;
+		dist = ip[0] | (ip[1] << 8);
+		ip += 2;
+		matchLen = token & 0x0F;
+		if (matchLen == 15 && lz_get_len(&ip, end, &matchLen) < 0)
+			return -1;
+		matchLen += LZ_MIN_MATCH;
+		if (!dist || dist > (unsigned int)(op - dst) ||
+			matchLen > (unsigned int)(oend - op))
+			return -1;
+
+		/* byte by byte, a match may overlap what it produces */
+		for (; matchLen; matchLen--, op++)
+			*op = *(op - dist);
+	}
+
+	return op == oend ? 0 : -1;
+}
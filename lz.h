@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include <stdint.h>
+
+/*
+ * Byte oriented LZ77 codec for compressed images. Every block is coded
+ * on its own so any block can be decoded without the ones before it.
+ *
+ * A block is a run of sequences: a token whose high nibble is the
+ * literal count and low nibble the match length minus LZ_MIN_MATCH, a
+ * nibble of 15 is continued by bytes added until one is below 255. Then
+ * the literals, then a 16 bit little endian match distance. The last
+ * sequence has literals only.
+ */
+#define LZ_MIN_MATCH 4
+
+/* worst case size of a compressed block of len bytes */
+#define LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+/* compressed length, or -1 if dst is too small */
+int gdix_lz_compress(const uint8_t *src, unsigned int len, uint8_t *dst,
+					 unsigned int size);
+/* 0 when src decodes to exactly len bytes, -1 on malformed input */
+int gdix_lz_decompress(const uint8_t *src, unsigned int srcLen, uint8_t *dst,
+					   unsigned int len);
+
+#endif
@@ -18,8 +18,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <linux/hidraw.h>
-#include <regex.h>
+#include <pthread.h>
 #include <sstream>
 #include <stdint.h>
 #include <stdio.h>
@@ -32,51 +33,53 @@
 #include <time.h>
 #include <unistd.h>
 
-#include "firmware_image.h"
-#include "gt7868q/gt7868q.h"
-#include "gt7868q/gt7868q_firmware_image.h"
-#include "gt7868q/gt7868q_update.h"
-#include "gt_update.h"
-#include "gtmodel.h"
+#include "bundle.h"
+#include "catalog.h"
+#include "daemon.h"
+#include "discover.h"
+#include "family.h"
+#include "fleet.h"
+#include "gdixupdate.h"
 #include "gtp_util.h"
-#include "gtx2/gtx2.h"
-#include "gtx2/gtx2_firmware_image.h"
-#include "gtx2/gtx2_update.h"
-#include "gtx3/gtx3.h"
-#include "gtx3/gtx3_firmware_image.h"
-#include "gtx3/gtx3_update.h"
-#include "gtx5/gtx5.h"
-#include "gtx5/gtx5_firmware_image.h"
-#include "gtx5/gtx5_update.h"
-#include "gtx8/gtx8.h"
-#include "gtx8/gtx8_firmware_image.h"
-#include "gtx8/gtx8_update.h"
-#include "gtx9/gtx9.h"
-#include "gtx9/gtx9_firmware_image.h"
-#include "gtx9/gtx9_update.h"
-#include "berlin_a/brla.h"
-#include "berlin_a/brla_firmware_image.h"
-#include "berlin_a/brla_update.h"
-
-#define GTPUPDATE_GETOPTS "hfd:pvt:s:ima:"
+#include "lease.h"
+#include "manifest.h"
+#include "query.h"
+
+#define GTPUPDATE_GETOPTS "hfd:pvt:s:ima:j:"
 
 #define VERSION "1.7.9"
 
-enum IC_TYPE {
-	TYPE_PHOENIX,
-	TYPE_NANJING,
-	TYPE_MOUSEPAD,
-	TYPE_NORMANDYL,
-	TYPE_YELLOWSTONE,
-	TYPE_BERLINA,
-	TYPE_BERLINB,
+/* options that only have a long form */
+enum LONG_OPT {
+	OPT_STREAM = 0x100,
+	OPT_INDEX,
+	OPT_BUNDLE_CREATE,
+	OPT_COMPRESS,
+	OPT_CATALOG_BUILD,
+	OPT_CATALOG_LOOKUP,
+	OPT_MAX_PER_BUS,
+	OPT_DISCOVER,
+	OPT_DAEMON,
+	OPT_MANIFEST,
+	OPT_QUERY_JSON,
+	OPT_LOCK_DIR,
+	OPT_LOCK_WAIT,
 };
 
-bool pdebug = false;
-
 extern int gdix_do_fw_update(const char *devname, const char *filename,
 							 uint8_t i2c_addr);
 
+/* the i2c updater doesn't go through the library, lease the device here */
+static int run_i2c_update(const char *deviceName, const char *firmwareName,
+						  uint8_t i2cAddr)
+{
+	DeviceLease lease;
+
+	if (lease.Acquire(deviceName))
+		return GDIX_ERR_BUSY;
+	return gdix_do_fw_update(deviceName, firmwareName, i2cAddr);
+}
+
 static void printHelp(const char *prog_name)
 {
 	fprintf(stdout, "Usage: %s [OPTIONS] FIRMWAREFILE\n", prog_name);
@@ -85,7 +88,8 @@ static void printHelp(const char *prog_name)
 			"\t-f, --force\tForce updating firmware with check PID and VID\n");
 	fprintf(stdout,
 			"\t-d, --device\thidraw device file associated with the device "
-			"being updated.\n");
+			"being updated, given several times the devices are updated "
+			"in parallel.\n");
 	fprintf(stdout,
 			"\t-p, --fw-props\tPrint the firmware properties, format like PID "
 			"7589:VID 1.1.\n");
@@ -99,6 +103,57 @@ static void printHelp(const char *prog_name)
 	fprintf(stdout,
 			"\t-a, --i2c-addr\t if this option is set, will be upgraded by "
 			"i2c.(only support berlinB)\n");
+	fprintf(stdout,
+			"\t-j, --journal\t journal file, an interrupted update is "
+			"resumed from it on the next run.\n");
+	fprintf(stdout,
+			"\t--stream\t stream the image from file instead of loading "
+			"it.(only support berlinB)\n");
+	fprintf(stdout,
+			"\t--index	 keep the parse result in FIRMWAREFILE%s, later runs "
+			"on the same image skip validation.\n",
+			IMAGE_INDEX_SUFFIX);
+	fprintf(stdout,
+			"\t--bundle-create BUNDLE\t add the FIRMWAREFILE images to "
+			"BUNDLE, FILE@SENSOR binds an image to one sensor ID.\n");
+	fprintf(stdout,
+			"\t--compress FILE\t write FIRMWAREFILE compressed to FILE, "
+			"compressed images are decoded while flashing.\n");
+	fprintf(stdout,
+			"\t--catalog-build CATALOG\t index the images of the family "
+			"found under the FIRMWAREFILE directories in CATALOG.\n");
+	fprintf(stdout,
+			"\t--catalog-lookup CATALOG\t print the CATALOG file to flash "
+			"the device with, no FIRMWAREFILE needed.\n");
+	fprintf(stdout,
+			"\t--max-per-bus N\t update at most N devices behind one hub "
+			"or I2C adapter at once, 0 for no limit, default %d.\n",
+			FLEET_DEFAULT_PER_BUS);
+	fprintf(stdout,
+			"\t--discover\t list the Goodix hidraw devices, with FIRMWAREFILE "
+			"update all of them, -s and -t only pick a family.\n");
+	fprintf(stdout,
+			"\t--daemon SOCKET\t stay resident, check every Goodix device "
+			"that shows up against FIRMWAREFILE and update it when needed, "
+			"SOCKET takes status, check [hidrawN], reload and quit.\n");
+	fprintf(stdout,
+			"\t--manifest FILE\t update the devices FILE names, each line "
+			"is DEVICE IMAGE [force] [flag=N] [i2c=ADDR], "
+			"DEVICE a path, phys:PHYS or pid:PID, no FIRMWAREFILE needed.\n");
+	fprintf(stdout,
+			"\t--query-json[=MS]\t print as JSON the version of the -d "
+			"devices or of every Goodix device found, all read at once, "
+			"giving up on a device after MS, default %d.\n",
+			QUERY_DEFAULT_TIMEOUT_MS);
+	fprintf(stdout,
+			"\t--lock-dir DIR\t where the device leases are, default %s. "
+			"A device in use by another gdixupdate fails with %d.\n",
+			LEASE_DEFAULT_DIR, GDIX_ERR_BUSY);
+	fprintf(stdout,
+			"\t--lock-wait[=SEC]\t wait for a device in use instead, "
+			"at most SEC seconds.\n");
+	fprintf(stdout, "\tFIRMWAREFILE may be a bundle, the image matching the "
+					"device is picked from it.\n");
 }
 
 static void printVersion()
@@ -115,6 +170,652 @@ static void lowercase_str(unsigned char *str)
 	}
 }
 
+/*
+ * Without a firmware file list the Goodix devices found, otherwise add
+ * the ones of the family to the devices to update, one node per IC. With
+ * no PID or series given the family is taken from the devices, they must
+ * all agree.
+ */
+static int discover_devices(struct hid_node *nodes, int nodeNum, bool list,
+							int *chipType, char **deviceNames, int *deviceNum)
+{
+	char pid[8], key[LEASE_KEY_LEN];
+	char(*keys)[LEASE_KEY_LEN] = NULL;
+	bool given = *chipType >= 0;
+	int i, j, type, found = 0, ret = -1;
+
+	if (!list) {
+		keys = new char[FLEET_MAX_DEVICES][LEASE_KEY_LEN];
+		for (j = 0; j < *deviceNum; j++)
+			DeviceLease::GetKey(deviceNames[j], keys[j], LEASE_KEY_LEN);
+	}
+
+	for (i = 0; i < nodeNum; i++) {
+		snprintf(pid, sizeof(pid), "%04x", nodes[i].product);
+		type = gdix_family_from_pid(pid);
+		if (list) {
+			printf("%s %s %04x:%s %s\n", nodes[i].path,
+				   gdix_bus_name(nodes[i].bustype)
+					   ? gdix_bus_name(nodes[i].bustype)
+					   : "unknown",
+				   nodes[i].vendor, pid, gdix_family_name(type));
+			continue;
+		}
+		if (type < 0) {
+			gdix_info("skip %s, unknown pid %s\n", nodes[i].path, pid);
+			continue;
+		}
+		if (*chipType >= 0 && type != *chipType) {
+			if (given) {
+				gdix_info("skip %s, it is %s\n", nodes[i].path,
+						  gdix_family_name(type));
+				continue;
+			}
+			gdix_err("%s is %s while others are %s, give -s or -t\n",
+					 nodes[i].path, gdix_family_name(type),
+					 gdix_family_name(*chipType));
+			goto out;
+		}
+		*chipType = type;
+
+		/* another interface of an IC already in the list */
+		DeviceLease::GetKey(nodes[i].path, key, sizeof(key));
+		for (j = 0; j < *deviceNum; j++) {
+			if (!strcmp(keys[j], key))
+				break;
+		}
+		if (j < *deviceNum) {
+			gdix_dbg("skip %s, same IC as %s\n", nodes[i].path,
+					 deviceNames[j]);
+			continue;
+		}
+		if (*deviceNum >= FLEET_MAX_DEVICES) {
+			gdix_err("Too many devices, max %d\n", FLEET_MAX_DEVICES);
+			goto out;
+		}
+		memcpy(keys[*deviceNum], key, sizeof(key));
+		deviceNames[(*deviceNum)++] = nodes[i].path;
+		found++;
+	}
+	if (!list && !found) {
+		gdix_err("No Goodix device found\n");
+		goto out;
+	}
+	ret = 0;
+out:
+	delete[] keys;
+	return ret;
+}
+
+/*
+ * Add images of one family to a bundle, creating it when missing. An
+ * image already in the bundle under the same key is replaced.
+ */
+static int create_bundle(const char *bundleName, int chipType,
+						 FirmwareImage *fw_image, int num, char **files)
+{
+	FirmwareBundle bundle;
+	const struct bundle_entry *entry;
+	struct bundle_item *items, *item;
+	char *sensor;
+	int itemNum = 0, oldNum, i, j, ret = -1;
+
+	if (FirmwareBundle::IsBundle(bundleName) && bundle.Open(bundleName) < 0)
+		return -1;
+	oldNum = bundle.GetEntryNum();
+	items = new struct bundle_item[oldNum + num];
+
+	for (i = 0; i < num; i++) {
+		item = &items[itemNum];
+		memset(&item->entry, 0, sizeof(item->entry));
+		sensor = strrchr(files[i], '@');
+		if (sensor)
+			*sensor++ = '\0';
+		item->entry.sensor_id =
+			sensor ? strtoul(sensor, NULL, 0) : BUNDLE_ANY_SENSOR;
+
+		/* only valid images go in, the key comes from the image */
+		if (fw_image->Initialize(files[i])) {
+			gdix_err("Failed read firmware file:%s\n", files[i]);
+			goto out;
+		}
+		item->entry.family = chipType;
+		FirmwareBundle::SetPid(&item->entry, fw_image->GetProductID());
+		item->entry.ver_major = fw_image->GetFirmwareVersionMajor();
+		item->entry.ver_minor = fw_image->GetFirmwareVersionMinor();
+		fw_image->Close();
+
+		item->file = ImageFile::Open(files[i]);
+		if (!item->file)
+			goto out;
+		gdix_info("Add %s, PID %.8s version 0x%x 0x%x\n", files[i],
+				  item->entry.pid, item->entry.ver_major,
+				  item->entry.ver_minor);
+		itemNum++;
+	}
+
+	for (i = 0; i < oldNum; i++) {
+		entry = bundle.GetEntry(i);
+		for (j = 0; j < num; j++) {
+			if (!memcmp(entry, &items[j].entry,
+						offsetof(struct bundle_entry, reserved)))
+				break;
+		}
+		if (j < num)
+			continue;
+		items[itemNum].entry = *entry;
+		items[itemNum].file = bundle.OpenEntry(entry);
+		if (!items[itemNum].file)
+			goto out;
+		itemNum++;
+	}
+
+	ret = FirmwareBundle::Create(bundleName, items, itemNum);
+	if (!ret)
+		printf("bundle %s holds %d images\n", bundleName, itemNum);
+
+out:
+	for (i = 0; i < itemNum; i++)
+		items[i].file->Release();
+	delete[] items;
+	return ret;
+}
+
+/* shared by the updates of all devices */
+struct update_ctx {
+	struct gdix_image *image;
+	const char *journalName;
+	bool journalPerDevice; /* journalName is a prefix */
+	struct gdix_update_opts opts;
+	int lockWaitMs; /* stepped updates retry a leased device that long */
+};
+
+/* open the update of a device with its own journal */
+static int open_device_update(const char *deviceName, struct update_ctx *ctx,
+							  struct gdix_update **update)
+{
+	struct gdix_update_opts opts = ctx->opts;
+	char journalFile[PATH_MAX + LEASE_KEY_LEN];
+	char key[LEASE_KEY_LEN];
+
+	if (ctx->journalName) {
+		/* named after the IC, not the node it happens to be */
+		DeviceLease::GetKey(deviceName, key, sizeof(key));
+		if (ctx->journalPerDevice)
+			snprintf(journalFile, sizeof(journalFile), "%s.%s",
+					 ctx->journalName, key);
+		else
+			snprintf(journalFile, sizeof(journalFile), "%s",
+					 ctx->journalName);
+		opts.journal = journalFile;
+	}
+	return gdix_update_open(deviceName, ctx->image, &opts, update);
+}
+
+static int run_device_update(const char *deviceName, void *arg)
+{
+	struct gdix_update *update;
+	int ret;
+
+	ret = open_device_update(deviceName, (struct update_ctx *)arg, &update);
+	if (ret)
+		return ret;
+	ret = gdix_update_run(update);
+	gdix_update_close(update);
+	return ret;
+}
+
+#define LEASE_RETRY_MS 100
+
+/* stepped update of a device, opened by its first steps */
+struct stepped_update {
+	const char *deviceName;
+	struct update_ctx *ctx;
+	struct gdix_update *update;
+	int waitedMs;
+};
+
+/* stepped updates of a fleet driven from one thread */
+static void *fleet_begin_update(const char *deviceName, void *arg,
+								int *result)
+{
+	struct stepped_update *su = new struct stepped_update;
+
+	su->deviceName = deviceName;
+	su->ctx = (struct update_ctx *)arg;
+	su->update = NULL;
+	su->waitedMs = 0;
+	*result = 0;
+	return su;
+}
+
+/*
+ * The leases are taken without waiting, a device leased by another
+ * process is tried again from the engine until the lock wait is over.
+ */
+static int fleet_step_update(void *handle, unsigned int *delayUs)
+{
+	struct stepped_update *su = (struct stepped_update *)handle;
+	int lockWaitMs = su->ctx->lockWaitMs;
+	int ret;
+
+	if (su->update)
+		return gdix_update_step(su->update, delayUs);
+
+	ret = open_device_update(su->deviceName, su->ctx, &su->update);
+	if (ret == GDIX_ERR_BUSY &&
+		(lockWaitMs == LEASE_WAIT_FOREVER || su->waitedMs < lockWaitMs)) {
+		if (!su->waitedMs)
+			gdix_info("%s is in use, wait for it\n", su->deviceName);
+		su->waitedMs += LEASE_RETRY_MS;
+		*delayUs = LEASE_RETRY_MS * 1000;
+		return GDIX_STEP_WAIT;
+	}
+	if (ret)
+		return ret;
+	gdix_update_start(su->update);
+	*delayUs = 0;
+	return GDIX_STEP_WAIT;
+}
+
+static int fleet_end_update(void *handle, int ret)
+{
+	struct stepped_update *su = (struct stepped_update *)handle;
+
+	if (su->update)
+		gdix_update_close(su->update);
+	delete su;
+	return ret;
+}
+
+/* bytes to flash, devices with bigger images are started first */
+static long estimate_device_update(const char *deviceName, void *arg)
+{
+	struct update_ctx *ctx = (struct update_ctx *)arg;
+
+	return gdix_image_bytes(ctx->image, deviceName);
+}
+
+/* resident updater, the images are loaded at start and on reload */
+struct daemon_ctx {
+	struct update_ctx update;
+	const char *firmwareName;
+	int chipType; /* GDIX_FAMILY_ANY for all that a bundle has */
+	unsigned int flags;
+};
+
+static int daemon_load(void *arg)
+{
+	struct daemon_ctx *dctx = (struct daemon_ctx *)arg;
+	struct gdix_image *image;
+
+	if (gdix_image_open(dctx->chipType, dctx->firmwareName, dctx->flags,
+						&image))
+		return -1;
+
+	/* the old images go only once the new ones are good */
+	gdix_image_close(dctx->update.image);
+	dctx->update.image = image;
+	gdix_info("Loaded %s\n", dctx->firmwareName);
+	return 0;
+}
+
+static int daemon_device_update(const struct hid_node *node, void *arg)
+{
+	struct daemon_ctx *dctx = (struct daemon_ctx *)arg;
+	char pid[8];
+	int type;
+
+	snprintf(pid, sizeof(pid), "%04x", node->product);
+	type = gdix_family_from_pid(pid);
+	if (type < 0 || (dctx->chipType >= 0 && type != dctx->chipType)) {
+		gdix_info("%s pid %s is not handled\n", node->path, pid);
+		return 1;
+	}
+	return run_device_update(node->path, &dctx->update);
+}
+
+static int run_daemon(const char *socketName, struct daemon_ctx *dctx)
+{
+	UpdateDaemon daemon;
+	int ret = -1;
+
+	if (daemon_load(dctx))
+		goto out;
+	if (daemon.Open(socketName))
+		goto out;
+	printf("serving on %s\n", socketName);
+	fflush(stdout);
+	ret = daemon.Run(daemon_device_update, daemon_load, dctx);
+
+out:
+	gdix_image_close(dctx->update.image);
+	return ret;
+}
+
+/* a JSON string, the PID comes from the device and may hold anything */
+static void json_print_string(const char *str)
+{
+	const unsigned char *c;
+
+	putchar('"');
+	for (c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			printf("\\%c", *c);
+		else if (*c < 0x20 || *c >= 0x7F)
+			printf("\\u%04x", *c);
+		else
+			putchar(*c);
+	}
+	putchar('"');
+}
+
+static void print_query_json(const struct query_device *devices, int num)
+{
+	const struct query_device *dev;
+	int i;
+
+	printf("[");
+	for (i = 0; i < num; i++) {
+		dev = &devices[i];
+		printf("%s\n  {\"device\": ", i ? "," : "");
+		json_print_string(dev->name);
+		printf(", \"family\": ");
+		json_print_string(gdix_family_name(dev->family));
+		printf(", \"result\": %d, \"elapsed_ms\": %ld", dev->result,
+			   dev->elapsed_ms);
+		if (dev->result == QUERY_TIMEOUT) {
+			printf(", \"error\": \"timeout\"}");
+			continue;
+		}
+		if (dev->result) {
+			printf(", \"error\": \"%s\"}",
+				   dev->result == GDIX_ERR_BUSY ? "busy" : "failed");
+			continue;
+		}
+		printf(", \"pid\": ");
+		json_print_string(dev->version.pid);
+		printf(", \"vid\": ");
+		json_print_string(dev->version.vid);
+		printf(", \"config_id\": %u, \"sensor_id\": %d, "
+			   "\"firmware\": \"%d.%d\"}",
+			   dev->version.config_id, dev->version.sensor_id,
+			   dev->version.major, dev->version.minor);
+	}
+	printf("%s]\n", num ? "\n" : "");
+}
+
+/*
+ * Version of the -d devices, or of every Goodix device found, read in
+ * parallel. The family comes from the PID, -s or -t stand in for the
+ * devices of unknown PID.
+ */
+static int run_query(char **deviceNames, int deviceNum, int chipType,
+					 unsigned int timeoutMs)
+{
+	struct query_device *devices;
+	struct hid_node *nodes;
+	char pid[8];
+	int nodeNum, num = 0, i, j, failed;
+
+	nodes = new struct hid_node[FLEET_MAX_DEVICES];
+	nodeNum = gdix_discover(nodes, FLEET_MAX_DEVICES);
+	if (nodeNum < 0)
+		nodeNum = 0;
+	devices = new struct query_device[FLEET_MAX_DEVICES];
+
+	for (i = 0; i < (deviceNum ? deviceNum : nodeNum); i++) {
+		devices[num].name = deviceNum ? deviceNames[i] : nodes[i].path;
+		devices[num].family = chipType;
+		for (j = 0; j < nodeNum; j++) {
+			if (strcmp(devices[num].name, nodes[j].path))
+				continue;
+			snprintf(pid, sizeof(pid), "%04x", nodes[j].product);
+			if (gdix_family_from_pid(pid) >= 0)
+				devices[num].family = gdix_family_from_pid(pid);
+			break;
+		}
+		num++;
+	}
+
+	failed = gdix_query_devices(devices, num, timeoutMs);
+	print_query_json(devices, num);
+	delete[] devices;
+	delete[] nodes;
+	return failed || !num ? -1 : 0;
+}
+
+/* a device of a manifest and what to flash it with */
+struct manifest_device {
+	const char *name;
+	char key[LEASE_KEY_LEN]; /* the IC, whichever of its nodes is named */
+	const struct manifest_entry *entry;
+	int family;
+	struct gdix_image *image; /* NULL for an i2c update */
+	int result;				  /* why it can't start, when it can't */
+};
+
+struct manifest_image {
+	const char *path;
+	int family;
+	struct gdix_image *image;
+	int result;
+};
+
+struct manifest_ctx {
+	struct manifest_device devices[FLEET_MAX_DEVICES];
+	int deviceNum;
+	struct manifest_image images[FLEET_MAX_DEVICES];
+	int imageNum;
+	unsigned int imageFlags;
+	const char *journalName;
+};
+
+/* the i2c updater keeps its state in globals */
+static pthread_mutex_t i2c_update_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct manifest_device *manifest_find(struct manifest_ctx *mctx,
+											 const char *deviceName)
+{
+	int i;
+
+	for (i = 0; i < mctx->deviceNum; i++) {
+		if (!strcmp(mctx->devices[i].name, deviceName))
+			return &mctx->devices[i];
+	}
+	return NULL;
+}
+
+static int manifest_add(struct manifest_ctx *mctx, UpdateFleet *fleet,
+						const char *deviceName,
+						const struct manifest_entry *entry, int family)
+{
+	struct manifest_device *dev;
+	char key[LEASE_KEY_LEN];
+	int i;
+
+	/* an IC with several hidraw interfaces is updated once */
+	DeviceLease::GetKey(deviceName, key, sizeof(key));
+	for (i = 0; i < mctx->deviceNum; i++) {
+		dev = &mctx->devices[i];
+		if (strcmp(dev->key, key))
+			continue;
+		gdix_info("%s is taken by manifest line %d as %s, skip line %d\n",
+				  deviceName, dev->entry->line, dev->name, entry->line);
+		return 0;
+	}
+	if (fleet->AddDevice(deviceName) < 0)
+		return -1;
+	dev = &mctx->devices[mctx->deviceNum++];
+	dev->name = deviceName;
+	snprintf(dev->key, sizeof(dev->key), "%s", key);
+	dev->entry = entry;
+	dev->family = family;
+	dev->image = NULL;
+	dev->result = 0;
+	return 0;
+}
+
+/* each image is loaded once, whatever number of devices use it */
+static void manifest_load_image(struct manifest_ctx *mctx,
+								struct manifest_device *dev)
+{
+	struct manifest_image *img;
+	int i;
+
+	if (dev->entry->i2cAddr)
+		return;
+	if (dev->family < 0) {
+		gdix_err("%s: unknown family, give -s or -t\n", dev->name);
+		dev->result = GDIX_ERR_FAMILY;
+		return;
+	}
+	for (i = 0; i < mctx->imageNum; i++) {
+		img = &mctx->images[i];
+		if (img->family == dev->family && !strcmp(img->path, dev->entry->image))
+			break;
+	}
+	img = &mctx->images[i];
+	if (i == mctx->imageNum) {
+		img->path = dev->entry->image;
+		img->family = dev->family;
+		img->result = gdix_image_open(dev->family, img->path,
+									  mctx->imageFlags, &img->image);
+		mctx->imageNum++;
+	}
+	dev->image = img->image;
+	dev->result = img->result;
+}
+
+/*
+ * Match the manifest entries to the devices in order, the first entry
+ * naming a device wins. A device path nothing was found at is updated
+ * anyway and fails, an entry matching no device is counted as failed.
+ */
+static int manifest_resolve(UpdateManifest *manifest, struct hid_node *nodes,
+							int nodeNum, int chipType,
+							struct manifest_ctx *mctx, UpdateFleet *fleet)
+{
+	const struct manifest_entry *entry;
+	char pid[8];
+	int i, j, family, matched, unmatched = 0;
+
+	for (i = 0; i < manifest->GetEntryNum(); i++) {
+		entry = manifest->GetEntry(i);
+		matched = 0;
+		for (j = 0; j < nodeNum; j++) {
+			if (!manifest->Matches(entry, &nodes[j]))
+				continue;
+			snprintf(pid, sizeof(pid), "%04x", nodes[j].product);
+			family = gdix_family_from_pid(pid);
+			if (family < 0)
+				family = chipType;
+			if (manifest_add(mctx, fleet, nodes[j].path, entry, family))
+				return -1;
+			matched++;
+		}
+		if (matched)
+			continue;
+		if (entry->match == MATCH_PATH) {
+			family = entry->i2cAddr ? TYPE_BERLINB : chipType;
+			if (manifest_add(mctx, fleet, entry->device, entry, family))
+				return -1;
+			continue;
+		}
+		printf("manifest line %d: no device matches %s%s\n", entry->line,
+			   entry->match == MATCH_PHYS ? "phys:" : "pid:", entry->device);
+		unmatched++;
+	}
+
+	for (i = 0; i < mctx->deviceNum; i++)
+		manifest_load_image(mctx, &mctx->devices[i]);
+	return unmatched;
+}
+
+/* the options of the device's entry, a journal of its own */
+static void manifest_update_ctx(struct manifest_ctx *mctx,
+								struct manifest_device *dev,
+								struct update_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->image = dev->image;
+	ctx->journalName = mctx->journalName;
+	ctx->journalPerDevice = true;
+	ctx->opts.force = dev->entry->force;
+	ctx->opts.firmware_flag = dev->entry->firmwareFlag;
+}
+
+static int manifest_device_update(const char *deviceName, void *arg)
+{
+	struct manifest_ctx *mctx = (struct manifest_ctx *)arg;
+	struct manifest_device *dev = manifest_find(mctx, deviceName);
+	struct update_ctx ctx;
+	int ret;
+
+	if (dev->result)
+		return dev->result;
+	if (dev->entry->i2cAddr) {
+		pthread_mutex_lock(&i2c_update_lock);
+		ret = run_i2c_update(deviceName, dev->entry->image,
+							 dev->entry->i2cAddr);
+		pthread_mutex_unlock(&i2c_update_lock);
+		return ret;
+	}
+	manifest_update_ctx(mctx, dev, &ctx);
+	return run_device_update(deviceName, &ctx);
+}
+
+static long manifest_estimate(const char *deviceName, void *arg)
+{
+	struct manifest_ctx *mctx = (struct manifest_ctx *)arg;
+	struct manifest_device *dev = manifest_find(mctx, deviceName);
+
+	if (dev->result || !dev->image)
+		return 0;
+	return gdix_image_bytes(dev->image, deviceName);
+}
+
+static int run_manifest(const char *manifestName, int chipType,
+						unsigned int imageFlags, const char *journalName,
+						UpdateFleet *fleet)
+{
+	UpdateManifest manifest;
+	struct manifest_ctx *mctx;
+	struct hid_node *nodes;
+	int nodeNum, unmatched, failed = 0, i;
+
+	if (manifest.Load(manifestName))
+		return -1;
+	nodes = new struct hid_node[FLEET_MAX_DEVICES];
+	mctx = new struct manifest_ctx;
+	memset(mctx, 0, sizeof(*mctx));
+	mctx->imageFlags = imageFlags;
+	mctx->journalName = journalName;
+
+	nodeNum = gdix_discover(nodes, FLEET_MAX_DEVICES);
+	if (nodeNum < 0)
+		nodeNum = 0;
+	unmatched = manifest_resolve(&manifest, nodes, nodeNum, chipType, mctx,
+								 fleet);
+	if (unmatched < 0) {
+		failed = -1;
+		goto out;
+	}
+	if (mctx->deviceNum)
+		failed = fleet->Run(manifest_device_update, manifest_estimate, mctx);
+	fleet->Report();
+	if (unmatched)
+		printf("%d manifest entries matched no device\n", unmatched);
+	failed += unmatched;
+
+out:
+	for (i = 0; i < mctx->imageNum; i++)
+		gdix_image_close(mctx->images[i].image);
+	delete mctx;
+	delete[] nodes;
+	return failed ? -4 : 0;
+}
+
 int main(int argc, char **argv)
 {
 	int ret = 0;
@@ -123,25 +824,36 @@ int main(int argc, char **argv)
 	int chipType = -1;
 	GTmodel *gt_model = NULL;
 	FirmwareImage *fw_image = NULL;
-	GTupdate *gt_update = NULL;
-	GTUpdatePara *gt_update_para = NULL;
-	unsigned int firmware_flag = 0xFFFFFFFF;
+	struct gdix_version version;
+	unsigned int imageFlags = 0;
+	struct update_ctx ctx;
+	struct daemon_ctx dctx;
+	UpdateFleet fleet;
 	uint8_t i2cAddr = 0;
 
-	regex_t reg_x3xx;
-	regex_t reg_x5xx;
-	regex_t reg_x2xx;
-	regex_t reg_x8xx;
-	regex_t reg_x9xx;
-	regex_t reg_7868;
-	regex_t reg_brla;
-	regmatch_t pamtch[1]; // match container
-
 	char *deviceName = NULL;
+	char *deviceNames[FLEET_MAX_DEVICES];
+	int deviceNum = 0, i;
 	const char *firmwareName = NULL;
 	const char *pid = NULL;
 	const char *productionTypeName = NULL;
+	const char *journalName = NULL;
+	const char *bundleName = NULL;
+	const char *compressName = NULL;
+	const char *catalogName = NULL;
+	const char *daemonName = NULL;
+	const char *manifestName = NULL;
+	bool query = false;
+	unsigned int queryTimeoutMs = QUERY_DEFAULT_TIMEOUT_MS;
+	const char *lockDir = LEASE_DEFAULT_DIR;
+	int lockWaitMs = 0;
+	bool catalogLookup = false;
+	bool discover = false;
+	struct hid_node nodes[FLEET_MAX_DEVICES];
+	int nodeNum = 0;
 	bool force = false;
+	bool stream = false;
+	bool useIndex = false;
 	static struct option long_options[] = {
 		{"help", 0, NULL, 'h'},
 		{"force", 0, NULL, 'f'},
@@ -153,6 +865,20 @@ int main(int argc, char **argv)
 		{"info", 0, NULL, 'i'},
 		{"module", 0, NULL, 'm'},
 		{"i2c-addr", 1, NULL, 'a'},
+		{"journal", 1, NULL, 'j'},
+		{"stream", 0, NULL, OPT_STREAM},
+		{"index", 0, NULL, OPT_INDEX},
+		{"bundle-create", 1, NULL, OPT_BUNDLE_CREATE},
+		{"compress", 1, NULL, OPT_COMPRESS},
+		{"catalog-build", 1, NULL, OPT_CATALOG_BUILD},
+		{"catalog-lookup", 1, NULL, OPT_CATALOG_LOOKUP},
+		{"max-per-bus", 1, NULL, OPT_MAX_PER_BUS},
+		{"discover", 0, NULL, OPT_DISCOVER},
+		{"daemon", 1, NULL, OPT_DAEMON},
+		{"manifest", 1, NULL, OPT_MANIFEST},
+		{"query-json", 2, NULL, OPT_QUERY_JSON},
+		{"lock-dir", 1, NULL, OPT_LOCK_DIR},
+		{"lock-wait", 2, NULL, OPT_LOCK_WAIT},
 		{0, 0, 0, 0},
 	};
 	bool printFirmwareProps = false;
@@ -167,7 +893,13 @@ int main(int argc, char **argv)
 			force = true;
 			break;
 		case 'd':
-			deviceName = optarg;
+			if (deviceNum >= FLEET_MAX_DEVICES) {
+				gdix_err("Too many devices, max %d\n", FLEET_MAX_DEVICES);
+				return -1;
+			}
+			deviceNames[deviceNum++] = optarg;
+			if (!deviceName)
+				deviceName = optarg;
 			break;
 		case 'p':
 			printFirmwareProps = true;
@@ -185,7 +917,7 @@ int main(int argc, char **argv)
 			gdix_dbg("product type is %s\n", productionTypeName);
 			break;
 		case 'i':
-			pdebug = true;
+			gdix_set_debug(1);
 			break;
 		case 'm':
 			printModuleId = true;
@@ -193,268 +925,241 @@ int main(int argc, char **argv)
 		case 'a':
 			i2cAddr = strtol(optarg, NULL, 16);
 			break;
+		case 'j':
+			journalName = optarg;
+			break;
+		case OPT_STREAM:
+			stream = true;
+			break;
+		case OPT_INDEX:
+			useIndex = true;
+			break;
+		case OPT_BUNDLE_CREATE:
+			bundleName = optarg;
+			break;
+		case OPT_COMPRESS:
+			compressName = optarg;
+			break;
+		case OPT_CATALOG_BUILD:
+			catalogName = optarg;
+			catalogLookup = false;
+			break;
+		case OPT_CATALOG_LOOKUP:
+			catalogName = optarg;
+			catalogLookup = true;
+			break;
+		case OPT_MAX_PER_BUS:
+			fleet.SetMaxPerBus(atoi(optarg));
+			break;
+		case OPT_DISCOVER:
+			discover = true;
+			break;
+		case OPT_DAEMON:
+			daemonName = optarg;
+			break;
+		case OPT_MANIFEST:
+			manifestName = optarg;
+			break;
+		case OPT_QUERY_JSON:
+			query = true;
+			if (optarg)
+				queryTimeoutMs = strtoul(optarg, NULL, 0);
+			break;
+		case OPT_LOCK_DIR:
+			lockDir = optarg;
+			break;
+		case OPT_LOCK_WAIT:
+			lockWaitMs = optarg ? atoi(optarg) * 1000 : LEASE_WAIT_FOREVER;
+			break;
 		default:
 			break;
 		}
 	}
 
+	gdix_set_lease(lockDir, lockWaitMs);
+
 	if (optind < argc) {
 		firmwareName = argv[optind];
 		gdix_dbg("firmware name:%s\n", firmwareName);
 	}
-	if (NULL == productionTypeName && NULL == pid) {
+	/* compressing needs no device */
+	if (compressName) {
+		if (!firmwareName) {
+			gdix_err("file name not found\n");
+			return -1;
+		}
+		return ImageFile::Compress(firmwareName, compressName) ? -2 : 0;
+	}
+	/* -s or -t only stand for devices of unknown PID */
+	if (manifestName || query) {
+		if (pid)
+			chipType = gdix_family_from_pid(pid);
+		else if (productionTypeName)
+			chipType = gdix_family_from_series(productionTypeName);
+		if (query)
+			return run_query(deviceNames, deviceNum, chipType,
+							 queryTimeoutMs);
+		if (stream)
+			imageFlags |= GDIX_IMAGE_STREAM;
+		if (useIndex)
+			imageFlags |= GDIX_IMAGE_INDEX;
+		return run_manifest(manifestName, chipType, imageFlags, journalName,
+							&fleet);
+	}
+	if (discover) {
+		nodeNum = gdix_discover(nodes, FLEET_MAX_DEVICES);
+		if (nodeNum < 0)
+			return -1;
+		if (!firmwareName) {
+			discover_devices(nodes, nodeNum, true, &chipType, deviceNames,
+							 &deviceNum);
+			return nodeNum ? 0 : -1;
+		}
+	}
+	/* a bundle tells the images of all families apart */
+	if (NULL == productionTypeName && NULL == pid && !discover &&
+		!(daemonName && firmwareName &&
+		  FirmwareBundle::IsBundle(firmwareName))) {
 		gdix_err("please input pid or product type\n");
 		return -1;
 	}
-	if (!printModuleId && !printFirmwareProps && NULL == firmwareName) {
+	if (!printModuleId && !printFirmwareProps && !catalogLookup &&
+		NULL == firmwareName) {
 		gdix_err("file name not found\n");
 		return -1;
 	}
 
 	// check chip type
 	if (pid != NULL) {
-		regex_t reg_pid;
-		regcomp(&reg_pid, "^011[0-9A-Fa-f]$", REG_EXTENDED); // phoenix pid
-															 // 011x
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match phoenix pid 011x\n");
-			chipType = TYPE_PHOENIX;
-		}
-		regfree(&reg_pid);
-
-		regcomp(&reg_pid, "^0[eE][0-9A-Fa-f]{2}$",
-				REG_EXTENDED); // phoenix pid 0exx
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match phoenix pid 0exx\n");
-			chipType = TYPE_PHOENIX;
-		}
-		regfree(&reg_pid);
-
-		regcomp(&reg_pid, "^01[fF][0-9A-Fa-f]$",
-				REG_EXTENDED); // mouse pad pid 01fx
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match mousepad pid 01fx\n");
-			chipType = TYPE_MOUSEPAD;
-		}
-		regfree(&reg_pid);
-
-		regcomp(&reg_pid, "^0[fF][0-9A-Fa-f]{2}$",
-				REG_EXTENDED); // mouse pad pid 0fxx
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match mousepad pid 0fxx\n");
-			chipType = TYPE_MOUSEPAD;
-		}
-		regfree(&reg_pid);
-
-		regcomp(&reg_pid, "^01[eE][0-7]$",
-				REG_EXTENDED); // 7863 windows pid 01e0~01e7
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match GT7863 pid 01e0_01e7\n");
-			chipType = TYPE_NORMANDYL;
-		}
-		regfree(&reg_pid);
-
-		regcomp(&reg_pid, "^0[dD][0-7][0-9A-Fa-f]$",
-				REG_EXTENDED); // 7863 chrome pid 0d00~0d7f
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match GT7863 pid 0d00_0d7f\n");
-			chipType = TYPE_NORMANDYL;
-		}
-		regfree(&reg_pid);
-
-		regcomp(&reg_pid, "^0[dD][8-9A-Ba-b][0-9A-Fa-f]$",
-				REG_EXTENDED); // 7868Q chrome pid 0d80~0dbf
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match GT7868Q pid 0d80_0dbf\n");
-			chipType = TYPE_YELLOWSTONE;
-		}
-		regfree(&reg_pid);
-
-		/* 0EB* 0EC* is BerlinB */
-		regcomp(&reg_pid, "^0[eE][bBcC][0-9A-Fa-f]$", REG_EXTENDED);
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match BerlinB pid 0EBx\n");
-			chipType = TYPE_BERLINB;
-		}
-		regfree(&reg_pid);
-
-		/* 0EA5~0EAF is BerlinB */
-		regcomp(&reg_pid, "^0[eE][aA][5-9A-Fa-f]$", REG_EXTENDED);
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match BerlinB pid 0EA5~0EAF\n");
-			chipType = TYPE_BERLINB;
-		}
-		regfree(&reg_pid);
+		chipType = gdix_family_from_pid(pid);
+	} else if (productionTypeName != NULL) {
+		chipType = gdix_family_from_series(productionTypeName);
+	}
 
-		/* 0Cxx is BerlinB */
-		regcomp(&reg_pid, "^0[cC][0-9A-Fa-f]{2}$", REG_EXTENDED);
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match BerlinB pid 0Cxx\n");
-			chipType = TYPE_BERLINB;
-		}
-		regfree(&reg_pid);
+	if (stream)
+		imageFlags |= GDIX_IMAGE_STREAM;
+	if (useIndex)
+		imageFlags |= GDIX_IMAGE_INDEX;
 
-		/* 0F60~0F7F is BerlinA */
-		regcomp(&reg_pid, "^0[fF][6-7][0-9A-Fa-f]$", REG_EXTENDED);
-		if (REG_NOERROR == regexec(&reg_pid, pid, 1, pamtch, 0)) {
-			gdix_dbg("pid match BerlinA pid 0F60~0F7F\n");
-			chipType = TYPE_BERLINA;
-		}
-		regfree(&reg_pid);		
-	} else if (productionTypeName != NULL) {
-		regcomp(&reg_x3xx, "^[0-9]3[0-9]{2}", REG_EXTENDED);
-		regcomp(&reg_x5xx, "^[0-9]5[0-9]{2}", REG_EXTENDED);
-		regcomp(&reg_x2xx, "^[0-9]2[0-9]{2}", REG_EXTENDED);
-		regcomp(&reg_x8xx, "^[0-9]8[0-9]{2}", REG_EXTENDED);
-		regcomp(&reg_x9xx, "^[0-9]9[0-9]{2}", REG_EXTENDED);
-		regcomp(&reg_7868, "^7868", REG_EXTENDED);
-		regcomp(&reg_brla, "^7726", REG_EXTENDED);
-
-		if (REG_NOERROR == regexec(&reg_x3xx, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_PHOENIX; // 7388 match
-		else if (REG_NOERROR ==
-				 regexec(&reg_x5xx, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_NANJING; // 8589 match
-		else if (REG_NOERROR ==
-				 regexec(&reg_x2xx, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_MOUSEPAD; // 7288 match
-		else if (REG_NOERROR ==
-				 regexec(&reg_x8xx, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_NORMANDYL; // 7863 match
-		else if (REG_NOERROR ==
-				 regexec(&reg_x9xx, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_BERLINB; // 9966 match
-		else if (REG_NOERROR ==
-				 regexec(&reg_7868, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_YELLOWSTONE; // 7868 match
-		else if (REG_NOERROR ==
-				 regexec(&reg_brla, productionTypeName, 1, pamtch, 0))
-			chipType = TYPE_BERLINA; // 7726 match
-		else
-			chipType = -1; // no match
+	/* a PID or series that matches nothing is reported below */
+	if (daemonName && (chipType >= 0 || (!pid && !productionTypeName))) {
+		memset(&dctx, 0, sizeof(dctx));
+		dctx.firmwareName = firmwareName;
+		dctx.chipType = chipType >= 0 ? chipType : GDIX_FAMILY_ANY;
+		dctx.flags = imageFlags;
+		dctx.update.journalName = journalName;
+		dctx.update.journalPerDevice = true;
+		dctx.update.opts.force = force;
+		return run_daemon(daemonName, &dctx) ? -1 : 0;
+	}
 
-		regfree(&reg_x3xx);
-		regfree(&reg_x5xx);
-		regfree(&reg_x2xx);
-		regfree(&reg_x8xx);
-		regfree(&reg_x9xx);
-		regfree(&reg_7868);
-		regfree(&reg_brla);
+	if (discover && (chipType >= 0 || (!pid && !productionTypeName))) {
+		if (discover_devices(nodes, nodeNum, false, &chipType, deviceNames,
+							 &deviceNum))
+			return -1;
+		deviceName = deviceNames[0];
 	}
 
 	if (chipType < 0) {
 		gdix_err("Find No match pid or product\n");
-		delete gt_model;
 		return -6;
 	}
 
 	/* i2c update */
 	if (i2cAddr > 0 && chipType == TYPE_BERLINB) {
-		gdix_do_fw_update(deviceName, firmwareName, i2cAddr);
+		if (run_i2c_update(deviceName, firmwareName, i2cAddr) ==
+			GDIX_ERR_BUSY)
+			return GDIX_ERR_BUSY;
 		return 0;
 	}
 
-	if (chipType == TYPE_MOUSEPAD) {
-		gt_model = new GTx2Device;
-		fw_image = new GTX2FirmwareImage;
-		gt_update = new GTx2Update;
-		firmware_flag = 0x1400C; // update type:0x02,0x03,0x0e,0x10
-	} else if (chipType == TYPE_NANJING) {
-		gt_model = new GTx5Device;
-		fw_image = new GTX5FirmwareImage;
-		gt_update = new GTx5Update;
-		firmware_flag = 0x1400C; // update type:0x02,0x03,0x03,0x10;
-	} else if (chipType == TYPE_PHOENIX) {
-		gt_model = new GTx3Device;
-		fw_image = new GTX3FirmwareImage;
-		gt_update = new GTx3Update;
-		firmware_flag = 0x844; // update type:0x02,0x03,0x03,0x10;
-	} else if (chipType == TYPE_NORMANDYL) {
-		gt_model = new GTx8Device;
-		fw_image = new GTX8FirmwareImage;
-		gt_update = new GTx8Update;
-		firmware_flag = 0x0C; // update type:0x02,0x03;
-	} else if (chipType == TYPE_BERLINB) {
-		gt_model = new GTx9Device;
-		fw_image = new GTX9FirmwareImage;
-		gt_update = new GTx9Update;
-		firmware_flag = 0x0B; // don't update type:0x0B;
-	} else if (chipType == TYPE_YELLOWSTONE) {
-		gt_model = new GT7868QDevice;
-		fw_image = new GT7868QFirmwareImage;
-		gt_update = new GT7868QUpdate;
-		firmware_flag = 0x0C; // update type:0x02,0x03;
-	} else if (chipType == TYPE_BERLINA) {
-		gt_model = new BrlADevice;
-		fw_image = new BrlAFirmwareImage;
-		gt_update = new BrlAUpdate;
-	} else {
-		if (pid != NULL)
-			gdix_err("unsupported pid number:%s\n", pid);
+	if (bundleName || (catalogName && !catalogLookup)) {
+		fw_image = family_new_image(chipType);
+		if (bundleName)
+			ret = create_bundle(bundleName, chipType, fw_image,
+								argc - optind, &argv[optind]);
 		else
-			gdix_err("unsupported product type number:%s\n",
-					 productionTypeName);
-		return -1;
+			ret = FirmwareCatalog::Build(catalogName, chipType, fw_image,
+										 argc - optind, &argv[optind]);
+		delete fw_image;
+		return ret ? -2 : 0;
 	}
 
 	/* get and print active FW version */
 	if (printFirmwareProps) {
 		char props_buf[60] = {0};
+		gt_model = family_new_device(chipType);
 		ret = gt_model->GetFirmwareProps(deviceName, props_buf,
 										 sizeof(props_buf));
+		delete gt_model;
 		if (ret) {
 			printf("Failed to read properties from device %s\n", deviceName);
-			delete gt_model;
 			return 1;
-		} else {
-			printf("%s\n", props_buf);
-			delete gt_model;
-			return 0;
 		}
+		printf("%s\n", props_buf);
+		return 0;
 	}
 
-	ret = gt_model->Open(deviceName);
-	if (ret) {
-		gdix_err("failed open device:%s\n", deviceName);
-		delete gt_model;
-		return -1;
+	if (printModuleId || catalogLookup) {
+		if (gdix_device_query(chipType, deviceName, &version))
+			return -1;
 	}
 
 	if (printModuleId) {
-		printf("module_id:%d\n", gt_model->GetSensorID());
-		delete gt_model;
+		printf("module_id:%d\n", version.sensor_id);
 		return 0;
 	}
 
-	ret = fw_image->Initialize(firmwareName);
-	if (ret) {
-		gdix_err("Failed read firmware file:%s\n", firmwareName);
-		delete gt_model;
-		return -2;
-	}
+	if (catalogLookup) {
+		FirmwareCatalog catalog;
+		const struct catalog_entry *entry = NULL;
 
-	ret = gt_update->Initialize(gt_model, fw_image);
-	if (ret) {
-		// gdix_err("Failed read firmware file:%s\n", firmwareName);
-		delete gt_model;
-		return -2;
+		if (!catalog.Open(catalogName))
+			entry = catalog.Find(chipType, (unsigned char *)version.pid,
+								 version.sensor_id);
+		if (entry)
+			printf("%s\n", catalog.GetPath(entry));
+		else
+			gdix_err("No image for device:%s in catalog %s\n", deviceName,
+					 catalogName);
+		return entry ? 0 : -2;
 	}
 
-	// run update
-	gt_update_para = new GTUpdatePara;
-	gt_update_para->force = force;
-	gt_update_para->firmwareFlag = firmware_flag;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.journalName = journalName;
+	ctx.journalPerDevice = deviceNum > 1;
+	ctx.opts.force = force;
 
-	ret = gt_update->Run(gt_update_para);
-	if (ret) {
-		gdix_err("Firmware update err:ret=%d\n", ret);
-		delete gt_model;
-		return -4;
-	}
+	/* a bundle is parsed per device, each picks its image from it */
+	if (gdix_image_open(chipType, firmwareName, imageFlags, &ctx.image))
+		return -2;
 
-	delete gt_model;
-	delete fw_image;
-	delete gt_update;
+	if (deviceNum <= 1) {
+		ret = run_device_update(deviceName, &ctx);
+	} else {
+		for (i = 0; i < deviceNum; i++) {
+			if (fleet.AddDevice(deviceNames[i]) < 0) {
+				ret = -1;
+				goto out;
+			}
+		}
+		/* coroutine flows are all driven by one thread, the blocking
+		 * ones of the other families get a thread each
+		 */
+		if (family_stepped(chipType)) {
+			gdix_set_lease(lockDir, 0);
+			ctx.lockWaitMs = lockWaitMs;
+			ret = fleet.RunStepped(fleet_begin_update, fleet_step_update,
+								   fleet_end_update, estimate_device_update,
+								   &ctx);
+		} else
+			ret = fleet.Run(run_device_update, estimate_device_update,
+							&ctx);
+		ret = ret ? -4 : 0;
+		fleet.Report();
+	}
 
-	return 0;
+out:
+	gdix_image_close(ctx.image);
+	return ret;
 }
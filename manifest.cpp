@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gtp_util.h"
+#include "manifest.h"
+
+#define MANIFEST_LINE_LEN 4096
+
+UpdateManifest::UpdateManifest()
+{
+	m_entries = NULL;
+	m_entryNum = 0;
+}
+
+UpdateManifest::~UpdateManifest() { delete[] m_entries; }
+
+const struct manifest_entry *UpdateManifest::GetEntry(int index)
+{
+	if (index < 0 || index >= m_entryNum)
+		return NULL;
+	return &m_entries[index];
+}
+
+bool UpdateManifest::Matches(const struct manifest_entry *entry,
+							 const struct hid_node *node)
+{
+	unsigned int len;
+	char pid[8];
+
+	switch (entry->match) {
+	case MATCH_PATH:
+		return !strcmp(entry->device, node->path);
+	case MATCH_PHYS:
+		/* the device, or one of its interfaces */
+		len = strlen(entry->device);
+		return !strncmp(entry->device, node->phys, len) &&
+			   (!node->phys[len] || node->phys[len] == '/');
+	case MATCH_PID:
+		snprintf(pid, sizeof(pid), "%04x", node->product);
+		return !strcasecmp(entry->device, pid);
+	}
+	return false;
+}
+
+/* strtoul that takes the whole string or fails */
+static bool parse_number(const char *str, unsigned long max,
+						 unsigned long *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtoul(str, &end, 0);
+	return *str && !*end && !errno && *value <= max;
+}
+
+int UpdateManifest::ParseLine(char *line, int lineNum, const char *dir)
+{
+	struct manifest_entry *entry = &m_entries[m_entryNum];
+	char *save, *device, *image, *opt;
+	unsigned long value;
+
+	device = strtok_r(line, " \t\r\n", &save);
+	if (!device)
+		return 0;
+	image = strtok_r(NULL, " \t\r\n", &save);
+	if (!image) {
+		gdix_err("manifest line %d: no image\n", lineNum);
+		return -1;
+	}
+	if (m_entryNum >= MANIFEST_MAX_ENTRIES) {
+		gdix_err("Too many manifest entries, max %d\n",
+				 MANIFEST_MAX_ENTRIES);
+		return -1;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+	entry->line = lineNum;
+	if (!strncmp(device, "phys:", 5)) {
+		entry->match = MATCH_PHYS;
+		device += 5;
+	} else if (!strncmp(device, "pid:", 4)) {
+		entry->match = MATCH_PID;
+		device += 4;
+	} else {
+		entry->match = MATCH_PATH;
+	}
+	snprintf(entry->device, sizeof(entry->device), "%s", device);
+	if (image[0] == '/' || !dir)
+		snprintf(entry->image, sizeof(entry->image), "%s", image);
+	else
+		snprintf(entry->image, sizeof(entry->image), "%s/%s", dir, image);
+
+	while ((opt = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		if (!strcmp(opt, "force")) {
+			entry->force = true;
+		} else if (!strncmp(opt, "flag=", 5) &&
+				   parse_number(opt + 5, UINT32_MAX, &value)) {
+			entry->firmwareFlag = value;
+		} else if (!strncmp(opt, "i2c=", 4) &&
+				   parse_number(opt + 4, 0x7F, &value) && value) {
+			entry->i2cAddr = value;
+		} else {
+			gdix_err("manifest line %d: bad option %s\n", lineNum, opt);
+			return -1;
+		}
+	}
+	if (entry->i2cAddr && entry->match != MATCH_PATH) {
+		gdix_err("manifest line %d: i2c needs a device path\n", lineNum);
+		return -1;
+	}
+	m_entryNum++;
+	return 0;
+}
+
+int UpdateManifest::Load(const char *filename)
+{
+	char line[MANIFEST_LINE_LEN];
+	char dir[PATH_MAX];
+	const char *slash;
+	char *comment;
+	int lineNum = 0, ret = 0;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		gdix_err("file:%s, %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	/* images are found next to the manifest */
+	slash = strrchr(filename, '/');
+	if (slash)
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename),
+				 filename);
+
+	delete[] m_entries;
+	m_entries = new struct manifest_entry[MANIFEST_MAX_ENTRIES];
+	m_entryNum = 0;
+	while (!ret && fgets(line, sizeof(line), fp)) {
+		lineNum++;
+		comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		ret = ParseLine(line, lineNum, slash ? dir : NULL);
+	}
+	fclose(fp);
+	if (!ret && !m_entryNum) {
+		gdix_err("No entry in manifest %s\n", filename);
+		ret = -1;
+	}
+	return ret;
+}
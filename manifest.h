@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "discover.h"
+
+#define MANIFEST_MAX_ENTRIES 256
+
+/* how an entry names its devices */
+enum MANIFEST_MATCH {
+	MATCH_PATH, /* /dev/hidraw0, or /dev/i2c-N with i2c= */
+	MATCH_PHYS, /* phys:usb-0000:00:14.0-3, the HID physical path */
+	MATCH_PID,	/* pid:0eb1, every Goodix device with that PID */
+};
+
+struct manifest_entry {
+	int line;
+	int match;
+	char device[PATH_MAX];
+	char image[PATH_MAX]; /* relative paths are made relative to the
+						   * manifest file
+						   */
+	bool force;
+	unsigned int firmwareFlag; /* 0 for the family default */
+	uint8_t i2cAddr;		   /* 0 to update over HID */
+};
+
+/*
+ * Batch of updates, one entry per line:
+ *
+ *	DEVICE IMAGE [force] [flag=N] [i2c=ADDR]
+ *
+ * Blank lines and text after # are ignored.
+ */
+class UpdateManifest
+{
+public:
+	UpdateManifest();
+	~UpdateManifest();
+
+	int Load(const char *filename);
+	int GetEntryNum() { return m_entryNum; }
+	const struct manifest_entry *GetEntry(int index);
+	/* the entry naming node by its physical path or PID */
+	bool Matches(const struct manifest_entry *entry,
+				 const struct hid_node *node);
+
+private:
+	int ParseLine(char *line, int lineNum, const char *dir);
+
+	struct manifest_entry *m_entries;
+	int m_entryNum;
+};
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "gtp_util.h"
+#include "query.h"
+
+/*
+ * Shared by the caller and the threads, freed by whoever is last. A
+ * thread past the deadline can still be in the device, it must not
+ * touch the caller's data then, the device names are copied for it.
+ */
+struct query_state {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int refs;
+	int pending;
+	bool expired;
+	struct query_device *devices;
+	char (*names)[PATH_MAX]; /* devices[].name point here */
+	struct timespec start;
+};
+
+struct query_worker {
+	struct query_state *state;
+	int index;
+};
+
+static long elapsed_ms(const struct timespec *start)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec - start->tv_sec) * 1000 +
+		   (ts.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void query_put(struct query_state *state)
+{
+	bool last;
+
+	pthread_mutex_lock(&state->lock);
+	last = --state->refs == 0;
+	pthread_mutex_unlock(&state->lock);
+	if (!last)
+		return;
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+	delete[] state->devices;
+	delete[] state->names;
+	delete state;
+}
+
+static void *query_worker(void *arg)
+{
+	struct query_worker *worker = (struct query_worker *)arg;
+	struct query_state *state = worker->state;
+	struct query_device *dev = &state->devices[worker->index];
+	struct gdix_version version;
+	int ret;
+
+	delete worker;
+	ret = gdix_device_query(dev->family, dev->name, &version);
+
+	pthread_mutex_lock(&state->lock);
+	if (!state->expired) {
+		dev->result = ret;
+		dev->version = version;
+		dev->elapsed_ms = elapsed_ms(&state->start);
+		if (--state->pending == 0)
+			pthread_cond_signal(&state->cond);
+	}
+	pthread_mutex_unlock(&state->lock);
+	query_put(state);
+	return NULL;
+}
+
+int gdix_query_devices(struct query_device *devices, int num,
+					   unsigned int timeoutMs)
+{
+	struct query_state *state = new struct query_state;
+	struct query_worker *worker;
+	pthread_condattr_t attr;
+	struct timespec deadline;
+	pthread_t thread;
+	int i, ret, failed = 0;
+
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&state->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	state->refs = 1;
+	state->pending = 0;
+	state->expired = false;
+	state->devices = new struct query_device[num];
+	state->names = new char[num][PATH_MAX];
+	clock_gettime(CLOCK_MONOTONIC, &state->start);
+
+	for (i = 0; i < num; i++) {
+		devices[i].result = QUERY_TIMEOUT;
+		memset(&devices[i].version, 0, sizeof(devices[i].version));
+		devices[i].elapsed_ms = 0;
+		state->devices[i] = devices[i];
+		snprintf(state->names[i], PATH_MAX, "%s", devices[i].name);
+		state->devices[i].name = state->names[i];
+
+		worker = new struct query_worker;
+		worker->state = state;
+		worker->index = i;
+		pthread_mutex_lock(&state->lock);
+		state->refs++;
+		state->pending++;
+		pthread_mutex_unlock(&state->lock);
+		ret = pthread_create(&thread, NULL, query_worker, worker);
+		if (ret) {
+			gdix_err("Failed start query of %s, %s\n", devices[i].name,
+					 strerror(ret));
+			delete worker;
+			pthread_mutex_lock(&state->lock);
+			state->refs--;
+			state->pending--;
+			state->devices[i].result = GDIX_ERR_DEVICE;
+			pthread_mutex_unlock(&state->lock);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	deadline = state->start;
+	deadline.tv_sec += timeoutMs / 1000;
+	deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	while (state->pending > 0) {
+		if (pthread_cond_timedwait(&state->cond, &state->lock, &deadline) ==
+			ETIMEDOUT)
+			break;
+	}
+	state->expired = true;
+	for (i = 0; i < num; i++) {
+		devices[i].result = state->devices[i].result;
+		devices[i].version = state->devices[i].version;
+		devices[i].elapsed_ms = state->devices[i].result == QUERY_TIMEOUT
+									? timeoutMs
+									: state->devices[i].elapsed_ms;
+		if (devices[i].result)
+			failed++;
+	}
+	pthread_mutex_unlock(&state->lock);
+	query_put(state);
+	return failed;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _QUERY_H_
+#define _QUERY_H_
+
+#include "gdixupdate.h"
+
+#define QUERY_DEFAULT_TIMEOUT_MS 3000
+/* result of a device still not answering at the deadline */
+#define QUERY_TIMEOUT 1
+
+struct query_device {
+	const char *name;
+	int family;
+	/* filled in by gdix_query_devices() */
+	int result; /* GDIX_OK, a gdix_status or QUERY_TIMEOUT */
+	struct gdix_version version;
+	long elapsed_ms;
+};
+
+/*
+ * Read the version of all devices at once, one thread each. Waits until
+ * every device answered or timeoutMs passed, the devices still busy then
+ * are left to their threads. Returns the number of devices not read.
+ */
+int gdix_query_devices(struct query_device *devices, int num,
+					   unsigned int timeoutMs);
+
+#endif
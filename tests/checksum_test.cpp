@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Check every checksum kernel the CPU can run against the scalar
+ * reference, over lengths around the vector widths, odd lengths and
+ * unaligned starts, then random ones. Run by "make check".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../checksum.h"
+
+#define TEST_BUF_SIZE (64 * 1024)
+#define TEST_ALIGN 64
+#define TEST_RANDOM_RUNS 2000
+
+static uint8_t buf[TEST_BUF_SIZE + TEST_ALIGN];
+
+static int check(const struct checksum_ops *ops, unsigned int offset,
+				 unsigned int len)
+{
+	const uint8_t *data = buf + offset;
+
+	if (ops->u8(data, len) != gdix_sum_u8_scalar(data, len) ||
+		ops->u16_le(data, len) != gdix_sum_u16_le_scalar(data, len) ||
+		ops->u16_be(data, len) != gdix_sum_u16_be_scalar(data, len)) {
+		fprintf(stderr, "%s: mismatch at offset %u len %u\n", ops->name,
+				offset, len);
+		return -1;
+	}
+	return 0;
+}
+
+int main()
+{
+	const struct checksum_ops *ops;
+	unsigned int i, offset, len;
+	int k, fail, ret = 0;
+
+	srand(1);
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = rand();
+	/* all ones finds a lost carry sooner than random data */
+	memset(buf + TEST_BUF_SIZE / 2, 0xFF, TEST_BUF_SIZE / 4);
+
+	for (k = 0; (ops = gdix_checksum_kernel(k)); k++) {
+		fail = 0;
+		for (offset = 0; offset < TEST_ALIGN; offset++) {
+			for (len = 0; len <= 3 * TEST_ALIGN; len++)
+				fail |= check(ops, offset, len);
+		}
+		fail |= check(ops, 0, TEST_BUF_SIZE);
+		fail |= check(ops, TEST_ALIGN - 1, TEST_BUF_SIZE);
+		for (i = 0; i < TEST_RANDOM_RUNS; i++) {
+			offset = rand() % TEST_ALIGN;
+			len = rand() % (TEST_BUF_SIZE + 1);
+			fail |= check(ops, offset, len);
+		}
+		printf("checksum kernel %s: %s\n", ops->name, fail ? "FAIL" : "ok");
+		ret |= fail;
+	}
+
+	if (strcmp(gdix_checksum_impl(), gdix_checksum_kernel(0)->name)) {
+		fprintf(stderr, "kernel in use %s is not the best one %s\n",
+				gdix_checksum_impl(), gdix_checksum_kernel(0)->name);
+		ret = -1;
+	}
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Round trip the LZ codec over zero runs, random data and mixes of both,
+ * at the block sizes compressed images use and odd lengths, then feed
+ * the decoder truncated streams, bad distances and lengths running past
+ * either end. Run by "make check".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lz.h"
+
+#define TEST_MAX_LEN 65536
+#define TEST_RANDOM_RUNS 500
+
+static uint8_t src[TEST_MAX_LEN];
+static uint8_t packed[LZ_BOUND(TEST_MAX_LEN)];
+static uint8_t out[TEST_MAX_LEN];
+
+enum fill { FILL_ZERO, FILL_RANDOM, FILL_MIXED };
+
+static const char *fill_names[] = { "zero", "random", "mixed" };
+
+static void fill_data(enum fill fill, unsigned int len)
+{
+	unsigned int i, run;
+
+	for (i = 0; i < len; i++)
+		src[i] = fill == FILL_ZERO ? 0 : rand();
+	if (fill != FILL_MIXED)
+		return;
+	/* zero runs of every size, short ones stay literals */
+	for (i = 0; i < len; i += run + rand() % 64) {
+		run = rand() % 600;
+		if (run > len - i)
+			run = len - i;
+		memset(src + i, 0, run);
+	}
+}
+
+static int round_trip(enum fill fill, unsigned int len)
+{
+	int packLen;
+
+	fill_data(fill, len);
+	packLen = gdix_lz_compress(src, len, packed, LZ_BOUND(len));
+	if (packLen < 0 || packLen > (int)LZ_BOUND(len)) {
+		fprintf(stderr, "%s len %u: compressed to %d\n", fill_names[fill],
+				len, packLen);
+		return -1;
+	}
+	if (fill == FILL_ZERO && len >= 4096 && packLen >= (int)len / 8) {
+		fprintf(stderr, "zero len %u: only shrunk to %d\n", len, packLen);
+		return -1;
+	}
+	memset(out, 0xA5, len);
+	if (gdix_lz_decompress(packed, packLen, out, len) ||
+		memcmp(src, out, len)) {
+		fprintf(stderr, "%s len %u: round trip differs\n", fill_names[fill],
+				len);
+		return -1;
+	}
+	return 0;
+}
+
+/* every strict prefix of a good stream, and a wrong length, fail */
+static int check_truncated(unsigned int len)
+{
+	int packLen, cut;
+
+	fill_data(FILL_MIXED, len);
+	packLen = gdix_lz_compress(src, len, packed, LZ_BOUND(len));
+	for (cut = 0; cut < packLen; cut++) {
+		if (!gdix_lz_decompress(packed, cut, out, len)) {
+			fprintf(stderr, "len %u: stream cut at %d accepted\n", len,
+					cut);
+			return -1;
+		}
+	}
+	if (!gdix_lz_decompress(packed, packLen, out, len - 1) ||
+		!gdix_lz_decompress(packed, packLen, out, len + 1)) {
+		fprintf(stderr, "len %u: decoded to a wrong length\n", len);
+		return -1;
+	}
+	return 0;
+}
+
+struct bad_stream {
+	const char *name;
+	uint8_t data[16];
+	unsigned int srcLen;
+	unsigned int len;
+};
+
+static const struct bad_stream bad_streams[] = {
+	/* one literal then a match of 4 */
+	{ "distance 0", { 0x10, 'a', 0x00, 0x00 }, 4, 5 },
+	{ "distance before start", { 0x10, 'a', 0x02, 0x00 }, 4, 5 },
+	{ "distance 0xffff", { 0x10, 'a', 0xFF, 0xFF }, 4, 5 },
+	{ "match past output", { 0x1F, 'a', 0x01, 0x00, 0x00 }, 5, 10 },
+	{ "long match past output",
+	  { 0x1F, 'a', 0x01, 0x00, 0xFF, 0xFF, 0x10 }, 7, 300 },
+	{ "literals past output", { 0x50, 'a', 'b', 'c', 'd', 'e' }, 6, 4 },
+	{ "literals past input", { 0x50, 'a', 'b', 'c' }, 4, 5 },
+	{ "long literals past input", { 0xF0, 0xFF, 0x01, 'a', 'b' }, 5, 300 },
+	{ "literal length cut", { 0xF0, 0xFF }, 2, 300 },
+	{ "match length cut", { 0x1F, 'a', 0x01, 0x00, 0xFF }, 5, 300 },
+	{ "distance cut", { 0x10, 'a', 0x01 }, 3, 5 },
+};
+
+static int check_bad_streams()
+{
+	const struct bad_stream *bad;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < sizeof(bad_streams) / sizeof(bad_streams[0]); i++) {
+		bad = &bad_streams[i];
+		if (!gdix_lz_decompress(bad->data, bad->srcLen, out, bad->len)) {
+			fprintf(stderr, "%s: accepted\n", bad->name);
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+int main()
+{
+	/* around the minimum match, the length nibble and the block sizes */
+	static const unsigned int sizes[] = {
+		0, 1, 4, 5, 6, 15, 16, 255, 256, 511, 512, 4095, 4096, 4097,
+		65535, 65536,
+	};
+	unsigned int i, len;
+	int k, fail, ret = 0;
+
+	srand(1);
+	for (k = FILL_ZERO; k <= FILL_MIXED; k++) {
+		fail = 0;
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+			fail |= round_trip((enum fill)k, sizes[i]);
+		for (len = 1; len <= 300; len += 2)
+			fail |= round_trip((enum fill)k, len);
+		for (i = 0; i < TEST_RANDOM_RUNS; i++)
+			fail |= round_trip((enum fill)k, rand() % (TEST_MAX_LEN + 1));
+		printf("lz round trip %s: %s\n", fill_names[k], fail ? "FAIL" : "ok");
+		ret |= fail;
+	}
+
+	fail = 0;
+	for (len = 1; len <= 64; len++)
+		fail |= check_truncated(len);
+	fail |= check_truncated(4096);
+	if (gdix_lz_compress(src, 4096, packed, LZ_BOUND(4096) - 1) != -1) {
+		fprintf(stderr, "compress into a short buffer accepted\n");
+		fail = -1;
+	}
+	fail |= check_bad_streams();
+	printf("lz malformed streams: %s\n", fail ? "FAIL" : "ok");
+	ret |= fail;
+	return ret ? 1 : 0;
+}
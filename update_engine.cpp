@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "gtp_util.h"
+#include "update_engine.h"
+
+UpdateEngine::UpdateEngine()
+{
+	m_epollFd = -1;
+	m_taskNum = 0;
+}
+
+UpdateEngine::~UpdateEngine() { Close(); }
+
+int UpdateEngine::Open()
+{
+	m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epollFd < 0) {
+		gdix_err("Failed create epoll, %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+void UpdateEngine::Close()
+{
+	if (m_epollFd >= 0)
+		close(m_epollFd);
+	m_epollFd = -1;
+}
+
+/* a zero timer is a disarmed one, the next step is due at once then */
+int UpdateEngine::Arm(struct engine_task *task, unsigned int delayUs)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = delayUs / 1000000;
+	its.it_value.tv_nsec = (delayUs % 1000000) * 1000;
+	if (!delayUs)
+		its.it_value.tv_nsec = 1;
+	return timerfd_settime(task->timerFd, 0, &its, NULL);
+}
+
+int UpdateEngine::Add(engine_step_func step, engine_done_func done, void *arg)
+{
+	struct engine_task *task;
+	struct epoll_event ev;
+
+	task = new struct engine_task;
+	task->step = step;
+	task->done = done;
+	task->arg = arg;
+	task->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (task->timerFd < 0) {
+		gdix_err("Failed create timer, %s\n", strerror(errno));
+		goto err;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = task;
+	if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, task->timerFd, &ev) < 0 ||
+		Arm(task, 0) < 0) {
+		gdix_err("Failed add timer, %s\n", strerror(errno));
+		goto err;
+	}
+	m_taskNum++;
+	return 0;
+
+err:
+	if (task->timerFd >= 0)
+		close(task->timerFd);
+	delete task;
+	return -1;
+}
+
+void UpdateEngine::Finish(struct engine_task *task, int ret)
+{
+	engine_done_func done = task->done;
+	void *arg = task->arg;
+
+	epoll_ctl(m_epollFd, EPOLL_CTL_DEL, task->timerFd, NULL);
+	close(task->timerFd);
+	delete task;
+	m_taskNum--;
+	done(arg, ret);
+}
+
+int UpdateEngine::Run()
+{
+	struct epoll_event events[ENGINE_MAX_EVENTS];
+	struct engine_task *task;
+	unsigned int delayUs;
+	uint64_t expired;
+	int i, num, ret;
+
+	while (m_taskNum > 0) {
+		num = epoll_wait(m_epollFd, events, ENGINE_MAX_EVENTS, -1);
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			gdix_err("epoll failed, %s\n", strerror(errno));
+			return -1;
+		}
+		for (i = 0; i < num; i++) {
+			task = (struct engine_task *)events[i].data.ptr;
+			if (read(task->timerFd, &expired, sizeof(expired)) < 0)
+				continue;
+			delayUs = 0;
+			ret = task->step(task->arg, &delayUs);
+			if (ret != ENGINE_STEP_WAIT)
+				Finish(task, ret);
+			else if (Arm(task, delayUs) < 0)
+				Finish(task, -errno);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UPDATE_ENGINE_H_
+#define _UPDATE_ENGINE_H_
+
+#define ENGINE_MAX_EVENTS 64
+/* returned by a step while the update goes on */
+#define ENGINE_STEP_WAIT 1
+
+/*
+ * one step of an update, ENGINE_STEP_WAIT with the time to wait before
+ * the next one, or the result of the update
+ */
+typedef int (*engine_step_func)(void *arg, unsigned int *delayUs);
+/* an update is over, ret is what its Run would have returned */
+typedef void (*engine_done_func)(void *arg, int ret);
+
+struct engine_task {
+	engine_step_func step;
+	int timerFd; /* fires when the next step is due */
+	engine_done_func done;
+	void *arg;
+};
+
+/*
+ * Drives stepped updates from one thread. Each update has a timerfd in
+ * an epoll set, the wait a step asks for arms it and the next step runs
+ * when it fires, so the waits of all devices overlap.
+ */
+class UpdateEngine
+{
+public:
+	UpdateEngine();
+	~UpdateEngine();
+
+	int Open();
+	void Close();
+	/* step an update that was started, done may add more */
+	int Add(engine_step_func step, engine_done_func done, void *arg);
+	int GetTaskNum() { return m_taskNum; }
+	/* until all updates are done */
+	int Run();
+
+private:
+	int Arm(struct engine_task *task, unsigned int delayUs);
+	void Finish(struct engine_task *task, int ret);
+
+	int m_epollFd;
+	int m_taskNum;
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gtp_util.h"
+#include "update_journal.h"
+
+/*
+ * Journal records, one per line, each closed by a hash of the line so
+ * a record torn by a crash is dropped on load:
+ *   B <image hash> <sensor id> <device>   update begins
+ *   P <phase>                             phase changed
+ *   A <subsys> <offset>                   subsys acked up to offset
+ *   D <subsys>                            subsys flashed
+ */
+#define JOURNAL_LINE_LEN 256
+#define JOURNAL_MAX_SIZE (1024 * 1024)
+
+static unsigned int journal_line_hash(const char *buf, int len)
+{
+	unsigned int hash = 0x811C9DC5;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)buf[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+UpdateJournal::UpdateJournal()
+{
+	m_fd = -1;
+	m_devName[0] = '\0';
+	Reset();
+}
+
+UpdateJournal::~UpdateJournal() { Close(); }
+
+void UpdateJournal::Reset()
+{
+	m_pending = false;
+	m_imageHash = 0;
+	m_sensorID = 0;
+	m_phase = JOURNAL_PHASE_NONE;
+	m_doneMask = 0;
+	m_partSubsys = -1;
+	m_partOffset = 0;
+}
+
+int UpdateJournal::Open(const char *filename, const char *devName)
+{
+	Close();
+	m_fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (m_fd < 0) {
+		gdix_err("Can't open journal %s, %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	snprintf(m_devName, sizeof(m_devName), "%s", devName);
+	if (Load() < 0) {
+		Close();
+		return -1;
+	}
+
+	if (m_pending)
+		gdix_info("Journal has unfinished update of %s, phase %d\n",
+				  m_devName, m_phase);
+	return 0;
+}
+
+void UpdateJournal::Close()
+{
+	if (m_fd >= 0) {
+		close(m_fd);
+		m_fd = -1;
+	}
+	Reset();
+}
+
+int UpdateJournal::Load()
+{
+	struct stat st;
+	char *buf, *line, *end;
+	char dev[JOURNAL_DEV_NAME_LEN];
+	unsigned int hash, val1, val2;
+	int len, ret;
+
+	if (fstat(m_fd, &st) < 0 || st.st_size > JOURNAL_MAX_SIZE) {
+		gdix_err("Invalid journal file\n");
+		return -1;
+	}
+	if (st.st_size == 0)
+		return 0;
+
+	buf = new char[st.st_size + 1];
+	ret = pread(m_fd, buf, st.st_size, 0);
+	if (ret != st.st_size) {
+		gdix_err("Failed read journal, ret %d\n", ret);
+		delete[] buf;
+		return -1;
+	}
+	buf[st.st_size] = '\0';
+
+	for (line = buf; (end = strchr(line, '\n')) != NULL; line = end + 1) {
+		*end = '\0';
+		len = end - line - 9;
+		if (len <= 0 || line[len] != ' ' ||
+			sscanf(&line[len + 1], "%08x", &hash) != 1 ||
+			hash != journal_line_hash(line, len)) {
+			gdix_info("Drop broken journal record\n");
+			break;
+		}
+		line[len] = '\0';
+
+		switch (line[0]) {
+		case 'B':
+			Reset();
+			if (sscanf(line, "B %08x %u %127s", &val1, &val2, dev) != 3)
+				goto out;
+			if (strcmp(dev, m_devName))
+				break;
+			m_pending = true;
+			m_imageHash = val1;
+			m_sensorID = val2;
+			break;
+		case 'P':
+			if (sscanf(line, "P %u", &val1) == 1)
+				m_phase = val1;
+			break;
+		case 'A':
+			if (sscanf(line, "A %u %u", &val1, &val2) == 2) {
+				m_partSubsys = val1;
+				m_partOffset = val2;
+			}
+			break;
+		case 'D':
+			if (sscanf(line, "D %u", &val1) == 1 && val1 < 64)
+				m_doneMask |= (uint64_t)1 << val1;
+			break;
+		default:
+			goto out;
+		}
+	}
+
+out:
+	delete[] buf;
+	return 0;
+}
+
+int UpdateJournal::Append(const char *fmt, ...)
+{
+	char buf[JOURNAL_LINE_LEN];
+	va_list args;
+	int len;
+
+	if (m_fd < 0)
+		return -1;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, sizeof(buf) - 10, fmt, args);
+	va_end(args);
+	if (len < 0 || len >= (int)sizeof(buf) - 10)
+		return -1;
+	len += sprintf(&buf[len], " %08x\n", journal_line_hash(buf, len));
+
+	if (write(m_fd, buf, len) != len || fdatasync(m_fd) < 0) {
+		gdix_err("Failed write journal, %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+bool UpdateJournal::Matches(unsigned int imageHash)
+{
+	return m_pending && m_imageHash == imageHash;
+}
+
+int UpdateJournal::Begin(unsigned int imageHash, unsigned char sensorID)
+{
+	if (m_fd < 0)
+		return -1;
+
+	/* a new update drops whatever was recorded before */
+	if (ftruncate(m_fd, 0) < 0) {
+		gdix_err("Failed truncate journal, %s\n", strerror(errno));
+		return -1;
+	}
+	Reset();
+	m_pending = true;
+	m_imageHash = imageHash;
+	m_sensorID = sensorID;
+	return Append("B %08x %u %s", imageHash, sensorID, m_devName);
+}
+
+int UpdateJournal::SetPhase(int phase)
+{
+	if (!m_pending)
+		return 0;
+	m_phase = phase;
+	return Append("P %d", phase);
+}
+
+int UpdateJournal::Acked(int subsys, unsigned int offset)
+{
+	if (!m_pending)
+		return 0;
+	m_partSubsys = subsys;
+	m_partOffset = offset;
+	return Append("A %d %u", subsys, offset);
+}
+
+int UpdateJournal::Done(int subsys)
+{
+	if (!m_pending || subsys < 0 || subsys >= 64)
+		return 0;
+	m_doneMask |= (uint64_t)1 << subsys;
+	return Append("D %d", subsys);
+}
+
+int UpdateJournal::Finish()
+{
+	if (m_fd < 0)
+		return -1;
+
+	Reset();
+	if (ftruncate(m_fd, 0) < 0 || fdatasync(m_fd) < 0) {
+		gdix_err("Failed clear journal, %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+bool UpdateJournal::IsDone(int subsys)
+{
+	if (!m_pending || subsys < 0 || subsys >= 64)
+		return false;
+	return m_doneMask & ((uint64_t)1 << subsys);
+}
+
+unsigned int UpdateJournal::GetOffset(int subsys)
+{
+	if (!m_pending || subsys != m_partSubsys)
+		return 0;
+	return m_partOffset;
+}
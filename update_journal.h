@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UPDATE_JOURNAL_H_
+#define _UPDATE_JOURNAL_H_
+
+#include <stdint.h>
+
+#define JOURNAL_DEV_NAME_LEN 128
+#define JOURNAL_SUBSYS_CFG 63 /* config flashed with ISP */
+
+// update phase
+enum journalPhase {
+	JOURNAL_PHASE_NONE = 0,  /* switching to bootloader/mini system */
+	JOURNAL_PHASE_FLASH = 1, /* bootloader ready, flashing subsystems */
+};
+
+/*
+ * Append-only record of an update in progress. Every record is synced
+ * to disk before the update goes on, so an update that is killed can
+ * be continued by the next run from the last acknowledged chunk.
+ */
+class UpdateJournal
+{
+public:
+	UpdateJournal();
+	~UpdateJournal();
+
+	int Open(const char *filename, const char *devName);
+	void Close();
+
+	/* true when an unfinished update is recorded for this device */
+	bool Pending() { return m_pending; }
+	/* true when the unfinished update is for this image */
+	bool Matches(unsigned int imageHash);
+
+	int Begin(unsigned int imageHash, unsigned char sensorID);
+	int SetPhase(int phase);
+	int Acked(int subsys, unsigned int offset);
+	int Done(int subsys);
+	int Finish();
+
+	int GetPhase() { return m_phase; }
+	unsigned char GetSensorID() { return m_sensorID; }
+	bool IsDone(int subsys);
+	unsigned int GetOffset(int subsys);
+
+private:
+	int Load();
+	int Append(const char *fmt, ...);
+	void Reset();
+
+	int m_fd;
+	char m_devName[JOURNAL_DEV_NAME_LEN];
+	bool m_pending;
+	unsigned int m_imageHash;
+	unsigned char m_sensorID;
+	int m_phase;
+	uint64_t m_doneMask;
+	int m_partSubsys;
+	unsigned int m_partOffset;
+};
+
+#endif
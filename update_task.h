@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017 Goodix Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UPDATE_TASK_H_
+#define _UPDATE_TASK_H_
+
+#include <coroutine>
+#include <exception>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Coroutine returning an int, an update flow or a part of it. A flow
+ * co_awaits update_sleep() where the blocking code would usleep(), and
+ * co_awaits the tasks it calls. The outermost task is driven by Resume,
+ * which runs it up to its next sleep.
+ */
+class UpdateTask
+{
+public:
+	struct promise_type;
+	typedef std::coroutine_handle<promise_type> handle_type;
+
+	struct final_awaiter {
+		bool await_ready() noexcept { return false; }
+		/* a finished task goes on with the one awaiting it */
+		std::coroutine_handle<> await_suspend(handle_type handle) noexcept
+		{
+			promise_type &promise = handle.promise();
+
+			if (!promise.parent)
+				return std::noop_coroutine();
+			promise.root->current = promise.parent;
+			return promise.parent;
+		}
+		void await_resume() noexcept {}
+	};
+
+	struct promise_type {
+		int result = 0;
+		handle_type parent;
+		promise_type *root = this;
+		/* of the outermost task only */
+		handle_type current; /* innermost task, resumed next */
+		unsigned int delayUs = 0;
+
+		UpdateTask get_return_object()
+		{
+			current = handle_type::from_promise(*this);
+			return UpdateTask(current);
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		final_awaiter final_suspend() noexcept { return {}; }
+		void return_value(int value) { result = value; }
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	/* co_await of a task starts it, its result is the value */
+	struct awaiter {
+		handle_type handle;
+
+		bool await_ready() noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle_type caller) noexcept
+		{
+			handle.promise().parent = caller;
+			handle.promise().root = caller.promise().root;
+			handle.promise().root->current = handle;
+			return handle;
+		}
+		int await_resume() noexcept { return handle.promise().result; }
+	};
+
+	UpdateTask() : m_handle() {}
+	explicit UpdateTask(handle_type handle) : m_handle(handle) {}
+	UpdateTask(UpdateTask &&task) : m_handle(task.m_handle)
+	{
+		task.m_handle = handle_type();
+	}
+	UpdateTask &operator=(UpdateTask &&task)
+	{
+		if (this != &task) {
+			if (m_handle)
+				m_handle.destroy();
+			m_handle = task.m_handle;
+			task.m_handle = handle_type();
+		}
+		return *this;
+	}
+	UpdateTask(const UpdateTask &) = delete;
+	UpdateTask &operator=(const UpdateTask &) = delete;
+	~UpdateTask()
+	{
+		if (m_handle)
+			m_handle.destroy();
+	}
+
+	awaiter operator co_await() && noexcept { return awaiter{m_handle}; }
+
+	bool IsValid() { return (bool)m_handle; }
+	/* run up to the next sleep, true once the task has returned */
+	bool Resume(unsigned int *delayUs)
+	{
+		promise_type &promise = m_handle.promise();
+
+		promise.current.resume();
+		if (m_handle.done())
+			return true;
+		*delayUs = promise.delayUs;
+		return false;
+	}
+	int GetResult() { return m_handle.promise().result; }
+
+private:
+	handle_type m_handle;
+};
+
+static inline uint64_t update_now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* a point in time to sleep until, us from now */
+static inline uint64_t update_deadline(unsigned int us)
+{
+	return update_now_us() + us;
+}
+
+/* suspends the whole flow, the driver waits before resuming it */
+struct update_sleep_awaiter {
+	uint64_t deadline;
+
+	bool await_ready() noexcept { return false; }
+	void await_suspend(UpdateTask::handle_type handle) noexcept
+	{
+		UpdateTask::promise_type *root = handle.promise().root;
+		uint64_t now = update_now_us();
+
+		root->current = handle;
+		root->delayUs = deadline > now ? deadline - now : 0;
+	}
+	void await_resume() noexcept {}
+};
+
+static inline update_sleep_awaiter update_sleep_until(uint64_t deadline)
+{
+	return update_sleep_awaiter{deadline};
+}
+
+static inline update_sleep_awaiter update_sleep(unsigned int us)
+{
+	return update_sleep_awaiter{update_deadline(us)};
+}
+
+#endif